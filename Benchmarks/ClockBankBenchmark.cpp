@@ -0,0 +1,86 @@
+// ClockBankBenchmark.cpp : Headless timings of ClockBank::Advance and StepForestGrowth.
+//
+// Advance runs over banks of 1K to 1M clocks with mixed scales, reversed and stopped clocks, until it has taken at
+// least the minimum time, and reports nanoseconds per clock per call. StepForestGrowth runs over forests of small
+// synthetic trees and reports nanoseconds per tree per call, which is almost all fastForwardGrowth.
+//
+// Arguments, all optional: largest bank in clocks (1000000), largest forest in trees (4096) and minimum seconds per
+// measurement (0.25).
+// Build next to the static library sources and link WickedEngine, e.g.
+//   g++ -O2 -std=c++20 -pthread -I.. ClockBankBenchmark.cpp $(ls ../*.cpp | grep -v -e Example_ImGui -e FileManagerWin32) -lWickedEngine_Linux -o ClockBankBenchmark
+
+#include "pch.h"
+#include "ClockBank.h"
+#include "TwoOLSystem.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// Every fourth clock reversed and every seventh stopped, so Advance sees all three rates
+static void fill(ClockBank& clocks, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		const uint32_t index = clocks.Add(0.0, 0.5 + static_cast<double>(i % 8) * 0.25, i % 7 != 0);
+		clocks.SetReversed(index, i % 4 == 0);
+	}
+}
+
+// A chain of 64 nodes with stages spread over 0-32 s
+static std::vector<LSystemGeneration> makeTree() {
+	std::vector<LSystemGeneration> generations(2);
+	for (int i = 0; i < 64; ++i) {
+		LSystemNode node{};
+		node.type = i % 2 == 0 ? NodeType::Forward : NodeType::Branch;
+		node.parentid = i - 1;
+		node.nodeid = i;
+		node.stage = 0.5f * static_cast<float>(i);
+		node.length = 0.5f;
+		node.radius = 0.1f;
+		generations[i / 32].push_back(node);
+	}
+	return generations;
+}
+
+// Calls run until minimumSeconds have passed, returns nanoseconds per call
+template <typename Run>
+static double measure(double minimumSeconds, Run run) {
+	run();
+	size_t calls = 0;
+	const Clock::time_point start = Clock::now();
+	double seconds = 0.0;
+	do {
+		run();
+		calls++;
+		seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	} while (seconds < minimumSeconds);
+	return seconds * 1e9 / static_cast<double>(calls);
+}
+
+int main(int argc, char** argv) {
+	const size_t maxClocks = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+	const size_t maxTrees = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4096;
+	const double minimumSeconds = argc > 3 ? std::atof(argv[3]) : 0.25;
+	wi::jobsystem::Initialize();
+
+	std::printf("%12s %16s\n", "clocks", "Advance ns/clock");
+	for (size_t count = 1000; count <= maxClocks; count *= 10) {
+		ClockBank clocks;
+		fill(clocks, count);
+		const double nanoseconds = measure(minimumSeconds, [&]() { clocks.Advance(1.0 / 60.0); });
+		std::printf("%12zu %16.3f\n", count, nanoseconds / static_cast<double>(count));
+	}
+
+	const std::vector<LSystemGeneration> tree = makeTree();
+	std::printf("%12s %16s\n", "trees", "Step ns/tree");
+	for (size_t count = 64; count <= maxTrees; count *= 4) {
+		ClockBank clocks;
+		fill(clocks, count);
+		std::vector<std::vector<LSystemGeneration>> forest(count, tree);
+		const double nanoseconds = measure(minimumSeconds, [&]() { StepForestGrowth(clocks, forest, 1.0 / 60.0); });
+		std::printf("%12zu %16.1f\n", count, nanoseconds / static_cast<double>(count));
+	}
+	return 0;
+}
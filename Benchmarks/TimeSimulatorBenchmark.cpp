@@ -0,0 +1,136 @@
+// TimeSimulatorBenchmark.cpp : Reader throughput of TimeSimulator against the previous mutex based version.
+//
+// N reader threads call getElapsedSeconds in a loop while one writer thread calls update about every millisecond, the
+// way the editor and simulation workers use it. Reported per thread count: nanoseconds per read and reads that went
+// backwards while time was running forward (must be 0).
+//
+// Pass a reader count to go past the hardware thread count.
+// Build next to the static library sources, e.g.
+//   g++ -O2 -std=c++20 -pthread -I.. TimeSimulatorBenchmark.cpp ../TimeSimulator.cpp -o TimeSimulatorBenchmark
+
+#include "pch.h"
+#include "TimeSimulator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The implementation TimeSimulator replaced, kept verbatim apart from the name
+class MutexTimeSimulator {
+public:
+    MutexTimeSimulator()
+        : isRunning(false), isReversed(false), accumulatedTime(std::chrono::milliseconds(0)) {}
+
+    void start() {
+        std::lock_guard<std::mutex> lock(timeMutex);
+        if (!isRunning) {
+            isRunning = true;
+            startTime = std::chrono::system_clock::now();
+        }
+    }
+
+    double getElapsedSeconds() const {
+        std::lock_guard<std::mutex> lock(timeMutex);
+        auto elapsed_ms = accumulatedTime;
+        if (isRunning) {
+            auto now = std::chrono::system_clock::now();
+            auto duration = (isReversed ? startTime - now : now - startTime);
+            elapsed_ms += std::chrono::duration_cast<std::chrono::milliseconds>(duration);
+        }
+        return std::chrono::duration<double>(elapsed_ms).count();
+    }
+
+    void update() {
+        std::lock_guard<std::mutex> lock(timeMutex);
+        if (isRunning) {
+            auto now = std::chrono::system_clock::now();
+            if (isReversed) {
+                accumulatedTime -= std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime);
+            }
+            else {
+                accumulatedTime += std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime);
+            }
+            startTime = now;
+        }
+    }
+
+private:
+    bool isRunning;
+    bool isReversed;
+    std::chrono::milliseconds accumulatedTime;
+    std::chrono::system_clock::time_point startTime;
+    mutable std::mutex timeMutex;
+};
+
+struct BenchmarkResult {
+    double nanosecondsPerRead;
+    uint64_t backwardsReads;
+};
+
+template <typename Simulator>
+static BenchmarkResult run(unsigned readerCount, std::chrono::milliseconds duration) {
+    Simulator simulator;
+    simulator.start();
+
+    std::atomic<bool> go{ false };
+    std::atomic<bool> done{ false };
+    std::atomic<uint64_t> totalReads{ 0 };
+    std::atomic<uint64_t> totalBackwards{ 0 };
+
+    std::vector<std::thread> threads;
+    for (unsigned r = 0; r < readerCount; ++r) {
+        threads.emplace_back([&]() {
+            while (!go.load(std::memory_order_acquire)) {}
+            uint64_t reads = 0;
+            uint64_t backwards = 0;
+            double last = simulator.getElapsedSeconds();
+            while (!done.load(std::memory_order_relaxed)) {
+                const double time = simulator.getElapsedSeconds();
+                backwards += time < last;
+                last = time;
+                ++reads;
+            }
+            totalReads += reads;
+            totalBackwards += backwards;
+        });
+    }
+    threads.emplace_back([&]() {
+        while (!go.load(std::memory_order_acquire)) {}
+        while (!done.load(std::memory_order_relaxed)) {
+            simulator.update();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    const auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(duration);
+    done.store(true, std::memory_order_relaxed);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const double elapsedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    // Wall time a reader spends per call, every reader runs for the whole duration
+    return { elapsedNs * readerCount / std::max<uint64_t>(totalReads.load(), 1), totalBackwards.load() };
+}
+
+int main(int argc, char** argv) {
+    // Reader counts double up to the hardware thread count, or up to the first argument
+    const unsigned maxThreads = argc > 1 ? static_cast<unsigned>(std::max(1, std::atoi(argv[1]))) : std::max(1u, std::thread::hardware_concurrency());
+    const std::chrono::milliseconds duration(500);
+
+    std::printf("%8s %18s %18s %14s %14s\n", "readers", "mutex ns/read", "seqlock ns/read", "mutex back", "seqlock back");
+    for (unsigned readers = 1; readers <= maxThreads; readers *= 2) {
+        const BenchmarkResult locked = run<MutexTimeSimulator>(readers, duration);
+        const BenchmarkResult lockFree = run<TimeSimulator>(readers, duration);
+        std::printf("%8u %18.1f %18.1f %14llu %14llu\n", readers, locked.nanosecondsPerRead, lockFree.nanosecondsPerRead,
+            static_cast<unsigned long long>(locked.backwardsReads), static_cast<unsigned long long>(lockFree.backwardsReads));
+    }
+    return 0;
+}
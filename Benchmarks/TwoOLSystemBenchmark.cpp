@@ -0,0 +1,315 @@
+// TwoOLSystemBenchmark.cpp : Headless timings of every TwoOLSystem hot path on synthetic trees.
+//
+// Trees of 1K to 10M nodes are generated deterministically, then each stage runs until it has taken at least the
+// minimum time: LSystemNode::serialize and deserialize, saveGenerationsToFile and loadGenerationsFromFile,
+// WickedRenderer::SaveTree and LoadTree, simulateGrowth, GenerateMesh and WeldVertices. Nothing initializes
+// WickedEngine graphics, a WickedRenderer without a scene is enough for SaveTree and LoadTree.
+//
+// Results go to stdout as JSON, one entry per stage and size with ns/node, MB/s and heap allocations per run, so runs
+// can be diffed or charted over time. Progress goes to stderr. MB/s counts the bytes a stage reads or writes: text or
+// binary file size, serialized text, node data for simulateGrowth and generated vertex and index data for meshing.
+//
+// Arguments, all optional: largest tree in nodes (10000000), largest tree that is meshed (1000000, meshes are about 20
+// vertices per node), minimum seconds per stage (0.25) and the directory for the temporary files.
+// Build next to the static library sources and link WickedEngine, e.g.
+//   g++ -O2 -std=c++20 -pthread -I.. TwoOLSystemBenchmark.cpp $(ls ../*.cpp | grep -v -e Example_ImGui -e FileManagerWin32) -lWickedEngine_Linux -o TwoOLSystemBenchmark
+
+#include "pch.h"
+#include "TwoOLSystem.h"
+#include "TreeMesh.h"
+#include "WickedRenderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <new>
+#include <string>
+#include <vector>
+
+// Every heap allocation in the process goes through here, so a stage's count includes the standard library's
+static std::atomic<uint64_t> allocationCount{ 0 };
+static std::atomic<uint64_t> allocationBytes{ 0 };
+
+// GCC inlines the replacements below into library code and then warns that free() gets memory from operator new
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	allocationBytes.fetch_add(size, std::memory_order_relaxed);
+	if (void* p = std::malloc(size == 0 ? 1 : size)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+	std::free(p);
+}
+
+struct StageResult {
+	const char* stage;
+	size_t nodes;
+	uint64_t iterations;
+	double nanosecondsPerNode;
+	double megabytesPerSecond;
+	uint64_t bytes;              // Per run
+	uint64_t allocations;        // Per run
+	uint64_t allocatedBytes;     // Per run
+};
+
+// Deterministic across platforms, unlike the std distributions
+static float randomAngle(uint32_t& state) {
+	state = state * 1664525u + 1013904223u;
+	return (static_cast<float>(state >> 8) / 16777216.0f - 0.5f) * 1.2f;
+}
+
+// Breadth-first tree of exactly nodeCount nodes: a Forward trunk, then chains of three nodes that end in a leaf and fork
+// in two. Each fork is one generation deeper, Branch nodes near the trunk and Twig nodes further out.
+static std::vector<LSystemGeneration> synthesizeTree(size_t nodeCount, uint32_t seed) {
+	using namespace DirectX;
+	struct Tip {
+		int id;
+		XMFLOAT3 end;
+		XMFLOAT4 rotation;
+		float radius;
+		uint32_t generation;
+	};
+	const uint32_t chainLength = 3;
+
+	std::vector<LSystemGeneration> generations;
+	std::deque<Tip> tips;
+	size_t count = 0;
+	auto addNode = [&](uint32_t generation, NodeType type, int parent, const XMFLOAT3& position, const XMFLOAT4& rotation, float length, float radius) {
+		if (generations.size() <= generation) {
+			generations.resize(generation + 1);
+		}
+		LSystemNode node{};
+		node.type = type;
+		node.parentid = parent;
+		node.nodeid = static_cast<int>(count++);
+		node.stage = static_cast<float>(generation);
+		node.length = length;
+		node.radius = radius;
+		node.position = position;
+		node.rotation = rotation;
+		generations[generation].push_back(node);
+		return node;
+	};
+	auto addChain = [&](uint32_t generation, int parent, XMFLOAT3 position, const XMFLOAT4& rotation, float radius) {
+		const NodeType type = generation == 0 ? NodeType::Forward : generation < 6 ? NodeType::Branch : NodeType::Twig;
+		for (uint32_t i = 0; i < chainLength && count < nodeCount; ++i) {
+			const LSystemNode node = addNode(generation, type, parent, position, rotation, radius * 8.0f, radius);
+			XMStoreFloat3(&position, NodeEnd(node));
+			parent = node.nodeid;
+		}
+		if (count < nodeCount) {
+			addNode(generation, NodeType::Leaf, parent, position, rotation, 0.2f, 0.05f);
+			tips.push_back({ parent, position, rotation, radius, generation });
+		}
+	};
+
+	uint32_t state = seed;
+	addChain(0, -1, XMFLOAT3(0, 0, 0), XMFLOAT4(0, 0, 0, 1), 0.5f);
+	while (count < nodeCount && !tips.empty()) {
+		const Tip tip = tips.front();
+		tips.pop_front();
+		for (int fork = 0; fork < 2; ++fork) {
+			const float pitch = randomAngle(state);
+			const float yaw = randomAngle(state);
+			const float roll = randomAngle(state);
+			XMFLOAT4 rotation;
+			XMStoreFloat4(&rotation, XMQuaternionNormalize(XMQuaternionMultiply(XMQuaternionRotationRollPitchYaw(pitch, yaw, roll), XMLoadFloat4(&tip.rotation))));
+			addChain(tip.generation + 1, tip.id, tip.end, rotation, std::max(tip.radius * 0.8f, 0.01f));
+		}
+	}
+	return generations;
+}
+
+static size_t countNodes(const std::vector<LSystemGeneration>& generations) {
+	size_t count = 0;
+	for (const auto& generation : generations) {
+		count += generation.size();
+	}
+	return count;
+}
+
+static uint64_t fileSize(const std::string& path) {
+	std::error_code error;
+	const uint64_t size = std::filesystem::file_size(path, error);
+	return error ? 0 : size;
+}
+
+static uint64_t meshBytes(const TreeMeshData& mesh) {
+	return mesh.vertex_positions.size() * sizeof(DirectX::XMFLOAT3) + mesh.vertex_normals.size() * sizeof(DirectX::XMFLOAT3) +
+		mesh.vertex_uvs.size() * sizeof(DirectX::XMFLOAT2) + mesh.indices.size() * sizeof(uint32_t);
+}
+
+// setup runs before every run and is neither timed nor counted, run returns the bytes it read or wrote
+template <typename Setup, typename Run>
+static StageResult measure(const char* stage, size_t nodes, double minimumSeconds, Setup&& setup, Run&& run) {
+	using Clock = std::chrono::steady_clock;
+	uint64_t iterations = 0;
+	uint64_t bytes = 0;
+	uint64_t allocations = 0;
+	uint64_t allocatedBytes = 0;
+	Clock::duration elapsed{};
+	do {
+		setup();
+		const uint64_t countBefore = allocationCount.load(std::memory_order_relaxed);
+		const uint64_t bytesBefore = allocationBytes.load(std::memory_order_relaxed);
+		const Clock::time_point start = Clock::now();
+		bytes = run();
+		elapsed += Clock::now() - start;
+		allocations += allocationCount.load(std::memory_order_relaxed) - countBefore;
+		allocatedBytes += allocationBytes.load(std::memory_order_relaxed) - bytesBefore;
+		iterations++;
+	} while (std::chrono::duration<double>(elapsed).count() < minimumSeconds);
+
+	const double seconds = std::chrono::duration<double>(elapsed).count() / static_cast<double>(iterations);
+	StageResult result;
+	result.stage = stage;
+	result.nodes = nodes;
+	result.iterations = iterations;
+	result.nanosecondsPerNode = seconds * 1e9 / static_cast<double>(nodes);
+	result.megabytesPerSecond = seconds > 0.0 ? static_cast<double>(bytes) / seconds / 1e6 : 0.0;
+	result.bytes = bytes;
+	result.allocations = allocations / iterations;
+	result.allocatedBytes = allocatedBytes / iterations;
+	std::fprintf(stderr, "%-24s %10zu nodes %10.1f ns/node %9.1f MB/s %12llu allocations\n", stage, nodes, result.nanosecondsPerNode,
+		result.megabytesPerSecond, static_cast<unsigned long long>(result.allocations));
+	return result;
+}
+
+static void noSetup() {}
+
+int main(int argc, char** argv) {
+	const size_t maxNodes = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+	const size_t maxMeshNodes = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000000;
+	const double minimumSeconds = argc > 3 ? std::atof(argv[3]) : 0.25;
+	const std::filesystem::path directory = argc > 4 ? std::filesystem::path(argv[4]) : std::filesystem::temp_directory_path();
+	const std::string textPath = (directory / "TwoOLSystemBenchmark.txt").string();
+	const std::string binaryPath = (directory / "TwoOLSystemBenchmark.bin").string();
+
+	std::vector<StageResult> results;
+	WickedRenderer renderer;
+	for (size_t nodes = 1000; nodes <= maxNodes; nodes *= 10) {
+		std::vector<LSystemGeneration> generations = synthesizeTree(nodes, 1);
+		const uint64_t nodeBytes = nodes * sizeof(LSystemNode);
+
+		// Node text round trip
+		{
+			std::vector<std::string> lines;
+			results.push_back(measure("LSystemNode::serialize", nodes, minimumSeconds,
+				[&] { lines.assign(nodes, std::string()); },
+				[&] {
+					uint64_t bytes = 0;
+					size_t i = 0;
+					for (const auto& generation : generations) {
+						for (const auto& node : generation) {
+							lines[i] = node.serialize();
+							bytes += lines[i++].size();
+						}
+					}
+					return bytes;
+				}));
+
+			int64_t checksum = 0;
+			results.push_back(measure("LSystemNode::deserialize", nodes, minimumSeconds, noSetup,
+				[&] {
+					uint64_t bytes = 0;
+					checksum = 0;
+					for (const auto& line : lines) {
+						checksum += LSystemNode::deserialize(line).nodeid;
+						bytes += line.size();
+					}
+					return bytes;
+				}));
+			if (checksum != static_cast<int64_t>(nodes) * static_cast<int64_t>(nodes - 1) / 2) {
+				std::fprintf(stderr, "deserialize returned the wrong nodes at %zu nodes\n", nodes);
+				return 1;
+			}
+		}
+
+		// Text and binary files, each load is checked against the tree it was saved from
+		{
+			std::vector<LSystemGeneration> loaded;
+			results.push_back(measure("saveGenerationsToFile", nodes, minimumSeconds, noSetup,
+				[&] { saveGenerationsToFile(generations, textPath); return fileSize(textPath); }));
+			results.push_back(measure("loadGenerationsFromFile", nodes, minimumSeconds,
+				[&] { loaded.clear(); },
+				[&] { loaded = loadGenerationsFromFile(textPath); return fileSize(textPath); }));
+			if (countNodes(loaded) != nodes) {
+				std::fprintf(stderr, "loadGenerationsFromFile returned %zu of %zu nodes\n", countNodes(loaded), nodes);
+				return 1;
+			}
+
+			results.push_back(measure("WickedRenderer::SaveTree", nodes, minimumSeconds, noSetup,
+				[&] { renderer.SaveTree(generations, binaryPath); return fileSize(binaryPath); }));
+			results.push_back(measure("WickedRenderer::LoadTree", nodes, minimumSeconds,
+				[&] { loaded.clear(); },
+				[&] { renderer.LoadTree(binaryPath, loaded); return fileSize(binaryPath); }));
+			if (countNodes(loaded) != nodes) {
+				std::fprintf(stderr, "LoadTree returned %zu of %zu nodes\n", countNodes(loaded), nodes);
+				return 1;
+			}
+
+			std::error_code error;
+			std::filesystem::remove(textPath, error);
+			std::filesystem::remove(binaryPath, error);
+		}
+
+		// One 60 Hz frame in microseconds, past the stage of every node, so every node grows
+		{
+			std::vector<LSystemGeneration> growing = generations;
+			results.push_back(measure("simulateGrowth", nodes, minimumSeconds, noSetup,
+				[&] { simulateGrowth(growing, 16667.0); return nodeBytes; }));
+		}
+
+		if (nodes <= maxMeshNodes) {
+			// Only one mesh is alive at a time, at a million nodes it is already over a gigabyte
+			const TreeMeshSettings settings;
+			TreeMeshData mesh;
+			results.push_back(measure("GenerateMesh", nodes, minimumSeconds,
+				[&] { mesh = TreeMeshData(); },
+				[&] { GenerateMesh(generations, settings, mesh); return meshBytes(mesh); }));
+			results.push_back(measure("WeldVertices", nodes, minimumSeconds,
+				[&] { mesh = TreeMeshData(); GenerateMesh(generations, settings, mesh); },
+				[&] { const uint64_t bytes = meshBytes(mesh); WeldVertices(mesh); return bytes; }));
+		}
+	}
+
+	std::printf("{\n  \"benchmark\": \"TwoOLSystem\",\n  \"node_bytes\": %zu,\n  \"max_mesh_nodes\": %zu,\n  \"results\": [\n",
+		sizeof(LSystemNode), maxMeshNodes);
+	for (size_t i = 0; i < results.size(); ++i) {
+		const StageResult& r = results[i];
+		std::printf("    { \"stage\": \"%s\", \"nodes\": %zu, \"iterations\": %llu, \"ns_per_node\": %.3f, \"mb_per_s\": %.3f, "
+			"\"bytes\": %llu, \"allocations\": %llu, \"allocated_bytes\": %llu }%s\n",
+			r.stage, r.nodes, static_cast<unsigned long long>(r.iterations), r.nanosecondsPerNode, r.megabytesPerSecond,
+			static_cast<unsigned long long>(r.bytes), static_cast<unsigned long long>(r.allocations),
+			static_cast<unsigned long long>(r.allocatedBytes), i + 1 < results.size() ? "," : "");
+	}
+	std::printf("  ]\n}\n");
+	return 0;
+}
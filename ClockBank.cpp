@@ -0,0 +1,91 @@
+#include "ClockBank.h"
+#include "TwoOLSystem.h"
+#include <algorithm>
+
+uint32_t ClockBank::Add(double time, double scale, bool running) {
+	const uint32_t index = GetCount();
+	times.push_back(time);
+	deltas.push_back(0.0);
+	rates.push_back(0.0);
+	scales.push_back(scale);
+	flags.push_back(running ? kRunning : 0);
+	UpdateRate(index);
+	return index;
+}
+
+uint32_t ClockBank::Remove(uint32_t index) {
+	if (index >= GetCount()) {
+		return UINT32_MAX;
+	}
+	const uint32_t last = GetCount() - 1;
+	times[index] = times[last];
+	deltas[index] = deltas[last];
+	rates[index] = rates[last];
+	scales[index] = scales[last];
+	flags[index] = flags[last];
+	times.pop_back();
+	deltas.pop_back();
+	rates.pop_back();
+	scales.pop_back();
+	flags.pop_back();
+	return last;
+}
+
+void ClockBank::Clear() {
+	*this = ClockBank();
+}
+
+void ClockBank::SetTime(uint32_t index, double time) {
+	times[index] = time;
+}
+
+void ClockBank::SetScale(uint32_t index, double scale) {
+	scales[index] = scale;
+	UpdateRate(index);
+}
+
+void ClockBank::SetRunning(uint32_t index, bool running) {
+	flags[index] = running ? (flags[index] | kRunning) : (flags[index] & ~kRunning);
+	UpdateRate(index);
+}
+
+void ClockBank::SetReversed(uint32_t index, bool reversed) {
+	flags[index] = reversed ? (flags[index] | kReversed) : (flags[index] & ~kReversed);
+	UpdateRate(index);
+}
+
+void ClockBank::UpdateRate(uint32_t index) {
+	const uint8_t state = flags[index];
+	rates[index] = (state & kRunning) == 0 ? 0.0 : (state & kReversed) != 0 ? -scales[index] : scales[index];
+}
+
+void ClockBank::Advance(double dt) {
+	// No branches or flags in the loop, the compiler vectorizes it
+	const size_t count = times.size();
+	double* __restrict timeData = times.data();
+	double* __restrict deltaData = deltas.data();
+	const double* __restrict rateData = rates.data();
+	for (size_t i = 0; i < count; ++i) {
+		const double delta = rateData[i] * dt;
+		deltaData[i] = delta;
+		timeData[i] += delta;
+	}
+}
+
+void StepForestGrowth(ClockBank& clocks, std::vector<std::vector<LSystemGeneration>>& forest, double dt) {
+	clocks.Advance(dt);
+	const double* times = clocks.GetTimes();
+	const double* deltas = clocks.GetDeltas();
+	const uint32_t treeCount = std::min(clocks.GetCount(), static_cast<uint32_t>(forest.size()));
+
+	// Exact over any delta, so a fast clock or a long frame grows the same as many small steps and reversing undoes it
+	wi::jobsystem::context context;
+	wi::jobsystem::Dispatch(context, treeCount, 1, [&](wi::jobsystem::JobArgs args) {
+		const uint32_t tree = args.jobIndex;
+		const double delta = deltas[tree];
+		if (delta != 0.0) {
+			fastForwardGrowth(forest[tree], times[tree] - delta, delta);
+		}
+	});
+	wi::jobsystem::Wait(context);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Forward declaration of LSystemNode
+class LSystemNode;
+
+using LSystemGeneration = std::vector<LSystemNode>;
+
+// Independent simulation clocks for many trees, one index per tree, each with its own time, speed, direction and
+// running state. State is kept as structure of arrays and every clock's signed rate is cached, so Advance is a single
+// multiply-add per clock over contiguous doubles.
+class ClockBank {
+public:
+	// Returns the index of the new clock
+	uint32_t Add(double time = 0.0, double scale = 1.0, bool running = true);
+	// Moves the last clock into index and returns its old index, so callers can keep parallel arrays in step.
+	// UINT32_MAX and nothing removed when index is out of range.
+	uint32_t Remove(uint32_t index);
+	void Clear();
+	uint32_t GetCount() const { return static_cast<uint32_t>(times.size()); }
+
+	void SetTime(uint32_t index, double time);
+	void SetScale(uint32_t index, double scale);
+	void SetRunning(uint32_t index, bool running);
+	void SetReversed(uint32_t index, bool reversed);
+	bool IsRunning(uint32_t index) const { return (flags[index] & kRunning) != 0; }
+	bool IsReversed(uint32_t index) const { return (flags[index] & kReversed) != 0; }
+
+	// Move every clock by dt seconds of its own speed. GetTimes holds the new times, GetDeltas how far each one moved.
+	void Advance(double dt);
+	const double* GetTimes() const { return times.data(); }
+	const double* GetDeltas() const { return deltas.data(); }
+
+private:
+	static constexpr uint8_t kRunning = 1;
+	static constexpr uint8_t kReversed = 2;
+
+	void UpdateRate(uint32_t index);
+
+	std::vector<double> times;
+	std::vector<double> deltas;
+	std::vector<double> rates;      // scale, negated when reversed, 0 when stopped
+	std::vector<double> scales;
+	std::vector<uint8_t> flags;
+};
+
+// Batched growth kernel: advance every clock by dt and grow tree i from its previous time by its own delta with
+// fastForwardGrowth. forest[i] belongs to clock i, trees are spread over the job system.
+void StepForestGrowth(ClockBank& clocks, std::vector<std::vector<LSystemGeneration>>& forest, double dt);
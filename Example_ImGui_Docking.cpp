@@ -24,12 +24,27 @@
 
 // L System Stuff Here
 #include "TwoOLSystem.h"
+#include "TreeBVH.h"
+#include "GrowthScheduler.h"
+#include "SimulationJournal.h"
+#include "StructuredLog.h"
 //#include <WickedRenderer.h>
 WickedRenderer treeRenderer = WickedRenderer();
 std::vector<LSystemGeneration> generations;
+TreeBVH treeBVH; // Node capsules of the loaded tree for picking
+bool bTreeBVHStale = false; // Brought up to date by the next pick, growth never pays for it
+bool bPickNodes = false;
+int pickedNode = -1;
 FileManager filemanager;
 double simDuration = 40.0; // Simulate for set number of seconds
 TimeSimulator timesim;
+GrowthScheduler growthScheduler; // Steps growth on its own thread, results are picked up in Update
+bool bAnimateGrowth = false;
+bool bInstancedSegments = false;
+SimulationJournal journal; // Clock, controls and scheduler ticks while recording, for offline replay
+bool bRecordJournal = false;
+std::vector<LSystemGeneration> journalStart; // The tree the recording started from
+std::unique_ptr<StructuredLogger> structuredLogger; // Binary diagnostics of the library, e.g. every node a load reads
 
 // Main Menu Stuff
 bool show_menu = true; // A flag to control the main menu visibility
@@ -401,6 +416,9 @@ void Example_ImGuiRenderer::Load()
 
 	this->ClearSprites();
 	this->ClearFonts();
+
+	// The growth worker rewrites the tracked tree's vertices itself, Update only uploads them
+	growthScheduler.SetPatcher(treeRenderer.GetTreePatcher());
 	if (wi::lua::GetLuaState() != nullptr)
 	{
 		wi::lua::KillProcesses();
@@ -455,6 +473,32 @@ bool bIsUsingWidget = false;
 int input_text_disable = 0;
 int input_text_flags = ImGuiInputTextFlags_ReadOnly;
 
+// Patches the loaded tree in place instead of creating a new tree, a changed node count is remeshed in the background.
+// patch comes with a scheduler snapshot, its vertices were already rewritten on the growth worker.
+static void RefreshTree(Scene& scene, const TreeMeshPatch* patch = nullptr)
+{
+	if (bInstancedSegments)
+	{
+		treeRenderer.UpdateTreeInstanced(scene, generations);
+	}
+	else
+	{
+		treeRenderer.UpdateTree(scene, generations, patch);
+	}
+	bTreeBVHStale = true;
+}
+
+// Stop the scheduler and take the last step it published, so generations is exactly where growth got to
+static void StopGrowthScheduler(Scene& scene)
+{
+	growthScheduler.Stop();
+	if (GrowthSnapshot* snapshot = growthScheduler.Acquire())
+	{
+		std::swap(generations, snapshot->generations);
+		RefreshTree(scene, &snapshot->patch);
+	}
+}
+
 void Example_ImGuiRenderer::Update(float dt)
 {
 	// Start the Dear ImGui frame
@@ -913,6 +957,22 @@ void Example_ImGuiRenderer::Update(float dt)
 			{
 				wi::renderer::SetWireRender(bIsWireRender);
 			}
+
+			static bool bGenerateLODs = false;
+			static bool bBuildSkeleton = false;
+			bool bMeshSettingsChanged = ImGui::Checkbox("Generate LODs", &bGenerateLODs);
+			bMeshSettingsChanged |= ImGui::Checkbox("Build Skeleton", &bBuildSkeleton);
+			if (bMeshSettingsChanged)
+			{
+				TreeMeshSettings settings = bGenerateLODs ? TreeMeshSettings::LODChain() : TreeMeshSettings();
+				settings.buildSkeleton = bBuildSkeleton;
+				treeRenderer.SetMeshSettings(settings);
+			}
+
+			ImGui::Checkbox("Instanced Segments", &bInstancedSegments);
+
+			static bool bMeshCache = true;
+			ImGui::Checkbox("Mesh Cache", &bMeshCache);
 			/*
 			static bool bcEyeAdaption = active_render->getEyeAdaptionEnabled();
 			if (ImGui::Checkbox("Eye Adaption", &bcEyeAdaption))
@@ -932,7 +992,23 @@ void Example_ImGuiRenderer::Update(float dt)
 					if (!generations.empty())
 					{
 						std::string treename = "Tree";
-						treeRenderer.CreateTree(scene, treename, generations);
+						if (bInstancedSegments)
+						{
+							treeRenderer.CreateTreeInstanced(scene, treename, generations);
+						}
+						else
+						{
+							// Meshed on a worker, the finished tree is published from Update
+							treeRenderer.SetMeshCacheDirectory(bMeshCache ? "TreeCache" : "");
+							treeRenderer.CreateTreeAsync(treename, generations);
+						}
+
+						bTreeBVHStale = true;
+						pickedNode = -1;
+						if (bAnimateGrowth)
+						{
+							growthScheduler.Start(generations, timesim);
+						}
 
 						wi::backlog::post("L-system loaded and rendered", wi::backlog::LogLevel::Default);
 					}
@@ -959,29 +1035,219 @@ void Example_ImGuiRenderer::Update(float dt)
 
 			if (ImGui::Button("Start")) {
 				timesim.start(); // Start the time simulation
+				journal.RecordControl(JournalControl::Start);
 			}
 			if (ImGui::Button("Stop")) {
 				timesim.stop();
+				journal.RecordControl(JournalControl::Stop);
 			}
 			if (ImGui::Button("Reset")) {
 				timesim.reset();
+				journal.RecordControl(JournalControl::Reset);
 			}
 			if (ImGui::Button("Reverse")) {
 				timesim.reverse();
+				journal.RecordControl(JournalControl::Reverse);
 			}
 			/*
 			if (ImGui::Button("Pause")) {
 			}
 					*/
-			timesim.update(); // Update the time simulation
+			if (treeRenderer.IsBuildPending())
+			{
+				ImGui::Text("Building tree...");
+			}
 
-			if (timesim.getIsReversed()) {
-				//std::cout << "Reversing time for the remaining half of the simulation" << std::endl;
-				//simulateNegativeGrowth(generations, timesim.getElapsedSeconds());
+			if (ImGui::Checkbox("Animate Growth", &bAnimateGrowth))
+			{
+				if (bAnimateGrowth && !generations.empty())
+				{
+					growthScheduler.Start(generations, timesim);
+				}
+				else
+				{
+					growthScheduler.Stop();
+				}
 			}
-			else
+			static float fastForwardSeconds = 60.0f;
+			ImGui::InputFloat("##FastForward", &fastForwardSeconds);
+			ImGui::SameLine();
+			if (ImGui::Button("Fast Forward (s)") && !generations.empty())
+			{
+				// The clock jumps along with the tree, so nodes born inside the jump are not grown again and tree age matches
+				// the clock. A running scheduler continues from the jumped tree and time.
+				const bool bRestart = growthScheduler.IsRunning();
+				StopGrowthScheduler(scene);
+				const double fastForwardFrom = timesim.getElapsedSeconds();
+				const int64_t jumpNanoseconds = std::llround(static_cast<double>(fastForwardSeconds) * 1e9);
+				fastForwardGrowth(generations, fastForwardFrom, static_cast<double>(jumpNanoseconds) * 1e-9);
+				timesim.advance(jumpNanoseconds);
+				journal.RecordFastForward(fastForwardFrom, static_cast<double>(jumpNanoseconds) * 1e-9, jumpNanoseconds);
+				RefreshTree(scene);
+				if (bRestart)
+				{
+					growthScheduler.Start(generations, timesim);
+				}
+			}
+			if (growthScheduler.IsRunning())
+			{
+				GrowthSchedulerStats growthStats = growthScheduler.GetStats();
+				ImGui::Text("Growth: %.2f s, %llu steps, %llu skipped, %.2f ms/tick", growthStats.simulationTime,
+					(unsigned long long)growthStats.steps, (unsigned long long)growthStats.skippedSteps, growthStats.tickMilliseconds);
+			}
+
+			if (ImGui::Checkbox("Record Session", &bRecordJournal))
+			{
+				// The clock source and the scheduler's journal only change while the scheduler is stopped
+				const bool bRestart = growthScheduler.IsRunning();
+				StopGrowthScheduler(scene);
+				if (bRecordJournal)
+				{
+					journalStart = generations;
+					journal.StartRecording();
+					timesim.setClockSource(SimulationJournal::RecordingClock);
+					growthScheduler.SetJournal(&journal);
+				}
+				else
+				{
+					journal.StopRecording();
+					timesim.setClockSource(nullptr);
+					growthScheduler.SetJournal(nullptr);
+					if (journal.Save("session.sjr"))
+					{
+						wi::backlog::post("Session saved to session.sjr, " + std::to_string(journal.GetEntries().size()) + " events", wi::backlog::LogLevel::Default);
+					}
+					else
+					{
+						wi::backlog::post("Failed to save session.sjr", wi::backlog::LogLevel::Error);
+					}
+				}
+				if (bRestart)
+				{
+					growthScheduler.Start(generations, timesim);
+				}
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Replay Session") && !bRecordJournal)
+			{
+				SimulationJournal replayJournal;
+				if (replayJournal.Load("session.sjr"))
+				{
+					// Replays on the tree the recording started from, a journal from an earlier run starts from the loaded tree
+					std::vector<LSystemGeneration> replayed = journalStart.empty() ? generations : journalStart;
+					SimulationReplayStats replayStats = ReplaySimulationJournal(replayJournal, replayed);
+					const bool bMatches = HashGenerations(replayed) == HashGenerations(generations);
+					wi::backlog::post("Replayed " + std::to_string(replayStats.ticks) + " ticks, " + std::to_string(replayStats.steps) + " steps to " +
+						std::to_string(replayStats.simulationTime) + " s in " + std::to_string(replayStats.milliseconds) + " ms, " +
+						std::to_string(replayStats.divergedStarts) + " diverged starts, " + (bMatches ? "matches" : "differs from") + " the current tree",
+						wi::backlog::LogLevel::Default);
+				}
+				else
+				{
+					wi::backlog::post("Failed to load session.sjr", wi::backlog::LogLevel::Error);
+				}
+			}
+
+			static bool bStructuredLog = false;
+			static int structuredLogLevel = static_cast<int>(Logger::LogLevel::Info);
+			if (ImGui::Checkbox("Structured Log", &bStructuredLog))
+			{
+				if (bStructuredLog)
+				{
+					try
+					{
+						structuredLogger = std::make_unique<StructuredLogger>("log.bin");
+						structuredLogger->SetLevel(static_cast<Logger::LogLevel>(structuredLogLevel));
+						SetStructuredLog(structuredLogger.get());
+					}
+					catch (const std::exception& e)
+					{
+						wi::backlog::post(std::string("Structured log: ") + e.what(), wi::backlog::LogLevel::Error);
+						bStructuredLog = false;
+					}
+				}
+				else
+				{
+					SetStructuredLog(nullptr);
+					structuredLogger.reset();
+					wi::backlog::post("Structured log written to log.bin, turn it into text with LogDecoder", wi::backlog::LogLevel::Default);
+				}
+			}
+			// Trace shows every node a load reads, in builds that keep Trace (see LOGGER_MIN_LEVEL)
+			const char* logLevels[] = { "Trace", "Debug", "Info", "Warning", "Error" };
+			if (ImGui::Combo("Log Level", &structuredLogLevel, logLevels, IM_ARRAYSIZE(logLevels)) && structuredLogger)
+			{
+				structuredLogger->SetLevel(static_cast<Logger::LogLevel>(structuredLogLevel));
+			}
+
+			static bool bWind = false;
+			static float windStrength = 1.0f;
+			static float windBudget = 2.0f;
+			ImGui::Checkbox("Wind", &bWind);
+			if (bWind && !bInstancedSegments && !generations.empty() && !treeRenderer.IsBuildPending())
 			{
-				//simulateGrowth(generations, timesim.getElapsedSeconds());
+				ImGui::SliderFloat("Wind Strength", &windStrength, 0.0f, 3.0f);
+				ImGui::SliderFloat("Wind Budget (ms)", &windBudget, 0.1f, 8.0f);
+				TreeWindSettings windSettings;
+				windSettings.strength = windStrength;
+				TreeWindStats windStats = treeRenderer.UpdateTreeWind(scene, generations, (float)ImGui::GetTime(), windSettings, windBudget);
+				ImGui::Text("Wind: %u vertices, %.2f ms, %.1f ns/vertex", windStats.vertexCount, windStats.milliseconds, windStats.nanosecondsPerVertex);
+			}
+
+			if (ImGui::Button("Instance Repeated Subtrees") && !generations.empty())
+			{
+				treeRenderer.CreateTreeSubtreeInstanced(scene, "Tree Subtrees", generations);
+			}
+
+			static std::vector<uint32_t> batchedTrees;
+			if (ImGui::Button("Batch Forest") && !generations.empty())
+			{
+				// An 8x8 grid of the current tree next to the loaded one, all in one mesh
+				std::vector<XMFLOAT4X4> transforms;
+				for (int x = 0; x < 8; ++x)
+				{
+					for (int z = 0; z < 8; ++z)
+					{
+						XMFLOAT4X4& transform = transforms.emplace_back();
+						XMStoreFloat4x4(&transform, XMMatrixRotationY(float(x * 8 + z)) * XMMatrixTranslation(20.0f + x * 10.0f, 0.0f, z * 10.0f));
+					}
+				}
+				treeRenderer.AddBatchedTrees(generations, transforms, batchedTrees);
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Clear Batch"))
+			{
+				for (uint32_t handle : batchedTrees)
+				{
+					treeRenderer.RemoveBatchedTree(handle);
+				}
+				batchedTrees.clear();
+			}
+			ImGui::Text("Batched trees: %u", treeRenderer.GetBatch().GetTreeCount());
+
+			static float growthTime = 0.0f;
+			if (ImGui::Button("Bake Growth") && !generations.empty())
+			{
+				treeRenderer.CreateTreeGrowth(scene, "Tree Growth", generations);
+				growthTime = treeRenderer.GetGrowthDuration();
+			}
+			if (treeRenderer.GetGrowthDuration() > 0.0f && ImGui::SliderFloat("Growth Time", &growthTime, 0.0f, treeRenderer.GetGrowthDuration()))
+			{
+				treeRenderer.PlayGrowth(scene, growthTime);
+			}
+
+			ImGui::Checkbox("Pick Nodes", &bPickNodes);
+			const std::vector<const LSystemNode*> pickNodes = bPickNodes && pickedNode >= 0 ? flattenGenerations(generations) : std::vector<const LSystemNode*>();
+			if (pickedNode >= 0 && pickedNode < (int)pickNodes.size())
+			{
+				const LSystemNode& node = *pickNodes[pickedNode];
+				ImGui::Text("Node %d  Parent %d  Type %d", node.nodeid, node.parentid, (int)node.type);
+				ImGui::Text("Length %.3f  Radius %.3f  Stage %.2f", node.length, node.radius, node.stage);
+
+				// Straight from the node, the BVH may be stale while the tree grows
+				XMFLOAT3 tip;
+				DirectX::XMStoreFloat3(&tip, NodeEnd(node));
+				wi::renderer::DrawCapsule(wi::primitive::Capsule(node.position, tip, std::max(node.radius, 0.0f)), XMFLOAT4(1, 0.8f, 0, 1), false);
 			}
 		}
 
@@ -1023,6 +1289,19 @@ void Example_ImGuiRenderer::Update(float dt)
 		}
 		*/
 
+		if (bPickNodes && wi::input::Press(wi::input::MOUSE_BUTTON_LEFT))
+		{
+			XMFLOAT4 pointer = wi::input::GetPointer();
+			wi::primitive::Ray ray = wi::renderer::GetPickRay((long)pointer.x, (long)pointer.y, *this, camera);
+			if (bTreeBVHStale)
+			{
+				treeBVH.Refit(generations);
+				bTreeBVHStale = false;
+			}
+			TreeBVHHit hit;
+			pickedNode = treeBVH.RayCast(ray.origin, ray.direction, camera.zFarP, hit) ? (int)hit.node : -1;
+		}
+
 		//PE: Wicked way to control camera.
 		static XMFLOAT4 originalMouse = XMFLOAT4(0, 0, 0, 0);
 		static bool camControlStart = true;
@@ -1106,6 +1385,17 @@ void Example_ImGuiRenderer::Update(float dt)
 
 	imgui_got_focus_last = imgui_got_focus;
 
+	// Growth steps on its own thread whether or not the editor panel is open, the newest finished step is taken here
+	if (GrowthSnapshot* snapshot = growthScheduler.Acquire())
+	{
+		std::swap(generations, snapshot->generations);
+		RefreshTree(scene, &snapshot->patch);
+	}
+
+	// Trees meshed in the background enter the scene here
+	treeRenderer.PublishPending(scene);
+	treeRenderer.PublishBatch(scene);
+
 	RenderPath3D::Update(dt);
 }
 
@@ -0,0 +1,132 @@
+#include "GrowthScheduler.h"
+#include "TwoOLSystem.h"
+#include "SimulationJournal.h"
+#include <chrono>
+#include <cmath>
+
+GrowthScheduler::~GrowthScheduler() {
+	Stop();
+}
+
+void GrowthScheduler::Start(const std::vector<LSystemGeneration>& generations, const TimeSimulator& simulationClock, const GrowthSchedulerSettings& schedulerSettings) {
+	Stop();
+	state = generations;
+	clock = &simulationClock;
+	settings = schedulerSettings;
+	snapshots.Reset();
+	steps = 0;
+	skippedSteps = 0;
+	const int64_t elapsed = clock->getElapsedNanoseconds();
+	simulationTime = static_cast<double>(elapsed) * 1e-9;
+	if (journal != nullptr) {
+		journal->RecordBegin(generations, elapsed, settings);
+	}
+	tickMilliseconds = 0.0;
+	running.store(true, std::memory_order_release);
+	worker = std::thread(&GrowthScheduler::Run, this);
+}
+
+void GrowthScheduler::Stop() {
+	running.store(false, std::memory_order_release);
+	if (worker.joinable()) {
+		worker.join();
+	}
+}
+
+bool GrowthScheduler::IsRunning() const {
+	return running.load(std::memory_order_acquire);
+}
+
+void GrowthScheduler::SetJournal(SimulationJournal* schedulerJournal) {
+	journal = schedulerJournal;
+}
+
+void GrowthScheduler::SetPatcher(TreeMeshPatcher* meshPatcher) {
+	patcher = meshPatcher;
+}
+
+GrowthSnapshot* GrowthScheduler::Acquire() {
+	return snapshots.Acquire();
+}
+
+GrowthSchedulerStats GrowthScheduler::GetStats() const {
+	GrowthSchedulerStats stats;
+	stats.steps = steps.load(std::memory_order_relaxed);
+	stats.skippedSteps = skippedSteps.load(std::memory_order_relaxed);
+	stats.simulationTime = simulationTime.load(std::memory_order_relaxed);
+	stats.tickMilliseconds = tickMilliseconds.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void GrowthScheduler::Run() {
+	using Clock = std::chrono::steady_clock;
+	const double timestep = settings.timestep;
+	const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timestep));
+	double time = simulationTime.load(std::memory_order_relaxed);
+	uint64_t step = 0;
+
+	Clock::time_point nextTick = Clock::now();
+	while (running.load(std::memory_order_acquire)) {
+		const Clock::time_point tickStart = Clock::now();
+		const int64_t elapsed = clock->getElapsedNanoseconds();
+		if (journal != nullptr) {
+			journal->RecordTick(elapsed);
+		}
+		uint64_t skipped = 0;
+		const uint32_t taken = AdvanceGrowth(state, time, static_cast<double>(elapsed) * 1e-9, settings, skipped);
+		if (skipped > 0) {
+			skippedSteps.fetch_add(skipped, std::memory_order_relaxed);
+		}
+
+		if (taken > 0) {
+			step += taken;
+			GrowthSnapshot& snapshot = snapshots.GetWriteBuffer();
+			snapshot.generations = state;
+			snapshot.time = time;
+			snapshot.step = step;
+			if (patcher != nullptr) {
+				patcher->MakePatch(state, snapshot.patch);
+			}
+			else {
+				snapshot.patch.Clear();
+			}
+			snapshots.Publish();
+		}
+		steps.store(step, std::memory_order_relaxed);
+		simulationTime.store(time, std::memory_order_relaxed);
+		tickMilliseconds.store(std::chrono::duration<double, std::milli>(Clock::now() - tickStart).count(), std::memory_order_relaxed);
+
+		// After a stall the schedule restarts from now rather than firing a burst of late ticks
+		nextTick += period;
+		const Clock::time_point now = Clock::now();
+		if (nextTick < now) {
+			nextTick = now;
+		}
+		std::this_thread::sleep_until(nextTick);
+	}
+}
+
+uint32_t AdvanceGrowth(std::vector<LSystemGeneration>& generations, double& time, double target, const GrowthSchedulerSettings& settings, uint64_t& skippedSteps) {
+	const double timestep = settings.timestep;
+	double accumulator = target - time;
+
+	// A backwards step is gated at its lower end, so it exactly undoes the forward step over the same interval
+	uint32_t taken = 0;
+	while (std::abs(accumulator) >= timestep && taken < settings.maxCatchUpSteps) {
+		const double dt = accumulator > 0.0 ? timestep : -timestep;
+		stepGrowth(generations, dt > 0.0 ? time : time + dt, dt);
+		time += dt;
+		accumulator -= dt;
+		taken++;
+	}
+	if (std::abs(accumulator) >= timestep) {
+		// Too far behind, the whole steps left are covered in one closed form jump and the fraction waits for the next call
+		const double skipped = std::floor(std::abs(accumulator) / timestep);
+		const double duration = std::copysign(skipped * timestep, accumulator);
+		fastForwardGrowth(generations, time, duration);
+		skippedSteps += static_cast<uint64_t>(skipped);
+		time += duration;
+		taken++;
+	}
+	return taken;
+}
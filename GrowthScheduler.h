@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "TripleBuffer.h"
+#include "TreeMeshPatch.h"
+
+// Forward declaration of LSystemNode
+class LSystemNode;
+class TimeSimulator;
+class SimulationJournal;
+class TreeMeshPatcher;
+
+using LSystemGeneration = std::vector<LSystemNode>;
+
+struct GrowthSchedulerSettings {
+	double timestep = 1.0 / 60.0;   // Simulated seconds per stepGrowth call, also how often the worker wakes up
+	uint32_t maxCatchUpSteps = 8;   // Steps per tick, time beyond that is covered by one fastForwardGrowth call
+};
+
+// A finished simulation step as handed to the render thread
+struct GrowthSnapshot {
+	std::vector<LSystemGeneration> generations;
+	double time = 0.0;              // Simulated time the generations are at
+	uint64_t step = 0;
+	TreeMeshPatch patch;            // Vertices of the patched tree for these generations, when a patcher is set
+};
+
+struct GrowthSchedulerStats {
+	uint64_t steps = 0;
+	uint64_t skippedSteps = 0;      // Steps replaced by fastForwardGrowth while catching up
+	double simulationTime = 0.0;
+	double tickMilliseconds = 0.0;  // Cost of the last tick, steps and publishing
+};
+
+// Runs growth on its own thread at a fixed timestep, following a TimeSimulator clock with an accumulator. The clock
+// running backwards steps growth backwards. Results go out through a triple buffer, so the render thread never waits
+// for a step, and a tick that falls behind jumps the rest of the way instead of taking longer.
+class GrowthScheduler {
+public:
+	~GrowthScheduler();
+
+	// Take a copy of generations and follow clock from its current time, a running scheduler is stopped first.
+	// clock must outlive the scheduler or the next Stop.
+	void Start(const std::vector<LSystemGeneration>& generations, const TimeSimulator& clock, const GrowthSchedulerSettings& settings = GrowthSchedulerSettings());
+	void Stop();
+	bool IsRunning() const;
+
+	// Render thread: the newest published step, or nullptr when there is nothing new. The snapshot stays untouched until
+	// the next Acquire, its generations may be swapped out.
+	GrowthSnapshot* Acquire();
+
+	GrowthSchedulerStats GetStats() const;
+
+	// Record where every Start began and the clock time of every tick, nullptr stops recording. Only while stopped.
+	void SetJournal(SimulationJournal* journal);
+
+	// Rewrite the tracked tree's vertices on the worker for every published step, so the render thread only uploads
+	// them. nullptr stops patching. Only while stopped.
+	void SetPatcher(TreeMeshPatcher* patcher);
+
+private:
+	void Run();
+
+	std::thread worker;
+	std::atomic<bool> running{ false };
+	const TimeSimulator* clock = nullptr;
+	SimulationJournal* journal = nullptr;
+	TreeMeshPatcher* patcher = nullptr;
+	GrowthSchedulerSettings settings;
+	std::vector<LSystemGeneration> state;     // Worker only while running
+	TripleBuffer<GrowthSnapshot> snapshots;
+
+	std::atomic<uint64_t> steps{ 0 };
+	std::atomic<uint64_t> skippedSteps{ 0 };
+	std::atomic<double> simulationTime{ 0.0 };
+	std::atomic<double> tickMilliseconds{ 0.0 };
+};
+
+// One scheduler tick without the thread: step generations from time towards target, at most settings.maxCatchUpSteps
+// stepGrowth calls and then one fastForwardGrowth jump over the whole steps left. The fraction of a step stays for the
+// next call. Returns the number of calls made and adds the steps the jump replaced to skippedSteps.
+uint32_t AdvanceGrowth(std::vector<LSystemGeneration>& generations, double& time, double target, const GrowthSchedulerSettings& settings, uint64_t& skippedSteps);
@@ -0,0 +1,217 @@
+#include "LogFile.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+LogFile::~LogFile() {
+	Close();
+}
+
+bool LogFile::Open(const std::string& filePath, const LogFileSettings& fileSettings, bool append) {
+	Close();
+	path = filePath;
+	settings = fileSettings;
+	if (settings.mapped) {
+		std::error_code error;
+		if (std::filesystem::exists(path, error) && std::filesystem::file_size(path, error) > 0) {
+			ShiftFiles();
+		}
+	}
+	return OpenFile(append);
+}
+
+void LogFile::Close() {
+	CloseFile();
+	path.clear();
+}
+
+bool LogFile::IsOpen() const {
+	return settings.mapped ? view != nullptr : stream.is_open();
+}
+
+void LogFile::SetRotateCallback(std::function<void(LogFile&)> callback) {
+	onRotate = std::move(callback);
+}
+
+bool LogFile::OpenFile(bool append) {
+	size = 0;
+	if (settings.mapped) {
+		return Map();
+	}
+	stream.open(path, std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+	if (!stream.is_open()) {
+		return false;
+	}
+	if (append) {
+		std::error_code error;
+		const uint64_t existing = std::filesystem::file_size(path, error);
+		size = error ? 0 : existing;
+	}
+	return true;
+}
+
+void LogFile::CloseFile() {
+	if (settings.mapped) {
+		Unmap();
+	}
+	else if (stream.is_open()) {
+		stream.close();
+	}
+}
+
+// <path>.<maxFiles> falls off the end, every other file moves up by one
+void LogFile::ShiftFiles() {
+	std::error_code error;
+	if (settings.maxFiles == 0) {
+		std::filesystem::remove(path, error);
+	}
+	else {
+		std::filesystem::remove(path + "." + std::to_string(settings.maxFiles), error);
+		for (uint32_t i = settings.maxFiles; i > 1; --i) {
+			std::filesystem::rename(path + "." + std::to_string(i - 1), path + "." + std::to_string(i), error);
+		}
+		std::filesystem::rename(path, path + ".1", error);
+	}
+}
+
+void LogFile::Rotate() {
+	CloseFile();
+	ShiftFiles();
+	if (OpenFile(false) && onRotate) {
+		rotating = true;
+		onRotate(*this);
+		rotating = false;
+	}
+}
+
+void LogFile::Write(const char* data, size_t bytes) {
+	if (!settings.mapped) {
+		if (!rotating && settings.maxBytes > 0 && size > 0 && size + bytes > settings.maxBytes) {
+			Rotate();
+		}
+		if (stream.is_open()) {
+			stream.write(data, static_cast<std::streamsize>(bytes));
+			size += bytes;
+		}
+		return;
+	}
+
+	// Rotate once to keep the write in one file, after that only a full region rotates and the write is split
+	bool rotated = false;
+	while (bytes > 0) {
+		if (!rotating && size > 0 && size + bytes > settings.mappedBytes && (!rotated || size == settings.mappedBytes)) {
+			Rotate();
+			rotated = true;
+		}
+		if (view == nullptr) {
+			return;
+		}
+		const size_t chunk = static_cast<size_t>(std::min<uint64_t>(bytes, settings.mappedBytes - size));
+		if (chunk == 0) {
+			return;
+		}
+		std::memcpy(view + size, data, chunk);
+		size += chunk;
+		data += chunk;
+		bytes -= chunk;
+	}
+}
+
+void LogFile::Flush() {
+	if (!settings.mapped && stream.is_open()) {
+		stream.flush();
+	}
+}
+
+#ifdef _WIN32
+
+bool LogFile::Map() {
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	// Creating the mapping grows the file to its full size
+	LARGE_INTEGER mappedSize;
+	mappedSize.QuadPart = static_cast<LONGLONG>(settings.mappedBytes);
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(mappedSize.HighPart), mappedSize.LowPart, nullptr);
+	void* mapped = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, static_cast<SIZE_T>(settings.mappedBytes)) : nullptr;
+	if (mapped == nullptr) {
+		if (mapping != nullptr) {
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		return false;
+	}
+	fileHandle = file;
+	mappingHandle = mapping;
+	view = static_cast<char*>(mapped);
+	return true;
+}
+
+void LogFile::Unmap() {
+	if (view == nullptr) {
+		return;
+	}
+	UnmapViewOfFile(view);
+	CloseHandle(mappingHandle);
+	// Cut the unused tail, so a cleanly closed file holds exactly what was written
+	LARGE_INTEGER end;
+	end.QuadPart = static_cast<LONGLONG>(size);
+	SetFilePointerEx(fileHandle, end, nullptr, FILE_BEGIN);
+	SetEndOfFile(fileHandle);
+	CloseHandle(fileHandle);
+	view = nullptr;
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+}
+
+#else
+
+bool LogFile::Map() {
+	const int file = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file < 0) {
+		return false;
+	}
+	if (ftruncate(file, static_cast<off_t>(settings.mappedBytes)) != 0) {
+		close(file);
+		return false;
+	}
+	void* mapped = mmap(nullptr, static_cast<size_t>(settings.mappedBytes), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	if (mapped == MAP_FAILED) {
+		close(file);
+		return false;
+	}
+	descriptor = file;
+	view = static_cast<char*>(mapped);
+	return true;
+}
+
+void LogFile::Unmap() {
+	if (view == nullptr) {
+		return;
+	}
+	munmap(view, static_cast<size_t>(settings.mappedBytes));
+	// Cut the unused tail, so a cleanly closed file holds exactly what was written
+	if (ftruncate(descriptor, static_cast<off_t>(size)) != 0) {
+		// The file keeps its zero tail, readers stop at the first empty record or line
+	}
+	close(descriptor);
+	view = nullptr;
+	descriptor = -1;
+}
+
+#endif
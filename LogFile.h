@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+
+struct LogFileSettings {
+	uint64_t maxBytes = 0;                    // Rotate before a write would grow the file past this, 0 never rotates
+	uint32_t maxFiles = 5;                    // Rotated files kept as <path>.1 (newest) to <path>.<maxFiles>
+	bool mapped = false;                      // Append into a preallocated memory-mapped region instead of write calls
+	uint64_t mappedBytes = 16 * 1024 * 1024;  // Size of the mapped region, a mapped file rotates when it is full
+};
+
+// A log file that rotates by size and count. Mapped files are grown to their full size up front and written with a
+// memcpy, so a write is never a syscall. The OS writes the pages back even if the process crashes, which keeps the last
+// maxFiles mapped regions. Mapped files always start empty, an existing file is rotated out first.
+class LogFile {
+public:
+	~LogFile();
+
+	// append keeps the content of an existing file when not mapped
+	bool Open(const std::string& path, const LogFileSettings& settings, bool append);
+	void Close();
+	bool IsOpen() const;
+
+	// Called after rotation opened a fresh file and before the write that caused it, e.g. to repeat a file header
+	void SetRotateCallback(std::function<void(LogFile&)> callback);
+
+	// Writes never split across files unless a single write is larger than a whole mapped region
+	void Write(const char* data, size_t size);
+	// Hands buffered data to the OS, mapped files need nothing
+	void Flush();
+	uint64_t GetSize() const { return size; }
+
+private:
+	bool OpenFile(bool append);
+	void CloseFile();
+	void ShiftFiles();
+	void Rotate();
+	bool Map();
+	void Unmap();
+
+	std::string path;
+	LogFileSettings settings;
+	std::function<void(LogFile&)> onRotate;
+	bool rotating = false;
+	uint64_t size = 0;
+
+	std::ofstream stream;                 // Not mapped
+
+	char* view = nullptr;                 // Mapped
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int descriptor = -1;
+#endif
+};
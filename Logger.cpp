@@ -1,48 +1,195 @@
 #include "Logger.h"
 
 Logger::Logger(OutputMode mode, const std::string& filename)
+    : Logger(mode, filename, LogFileSettings()) {}
+
+Logger::Logger(OutputMode mode, const std::string& filename, const LogFileSettings& fileSettings)
     : mode_(mode) {
     if (mode_ == OutputMode::File) {
-        file_.open(filename, std::ios::app);
-        if (!file_.is_open()) {
+        if (!file_.Open(filename, fileSettings, true)) {
             throw std::runtime_error("Failed to open log file.");
         }
     }
 }
 
+Logger::Logger(OutputMode mode, const std::string& filename, const AsyncSettings& async, const LogFileSettings& fileSettings)
+    : Logger(mode, filename, fileSettings) {
+    async_ = true;
+    settings_ = async;
+    size_t capacity = 2;
+    while (capacity < settings_.capacity) {
+        capacity <<= 1;
+    }
+    slots_.reset(new Slot[capacity]);
+    for (size_t i = 0; i < capacity; ++i) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mask_ = capacity - 1;
+    writer_ = std::thread(&Logger::RunWriter, this);
+}
+
 Logger::~Logger() {
-    if (mode_ == OutputMode::File && file_.is_open()) {
-        file_.close();
+    if (writer_.joinable()) {
+        stopping_.store(true, std::memory_order_release);
+        writer_.join();
+    }
+    if (mode_ == OutputMode::File && file_.IsOpen()) {
+        file_.Close();
     }
 }
 
 void Logger::Log(LogLevel level, const std::string& message) {
+    if (!IsEnabled(level)) {
+        return;
+    }
+    const std::time_t time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+
+    if (async_) {
+        if (TryPush(level, time, message)) {
+            return;
+        }
+        switch (settings_.overflow) {
+        case OverflowPolicy::Block:
+            do {
+                std::this_thread::yield();
+            } while (!TryPush(level, time, message));
+            break;
+        case OverflowPolicy::Drop:
+            break;
+        case OverflowPolicy::CountDrops:
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+        return;
+    }
+
     std::lock_guard<std::mutex> lock(mutex_);
 
-    std::string logMessage = GetCurrentTime() + " [" + LogLevelToString(level) + "] " + message;
+    std::string logMessage;
+    AppendLine(logMessage, time, level, message);
+    Write(logMessage);
+}
 
-    if (mode_ == OutputMode::Console) {
-        std::cout << logMessage << std::endl;
+// Claim the slot at the enqueue position once the writer has freed it, fill it, then hand it over
+bool Logger::TryPush(LogLevel level, std::time_t time, const std::string& message) {
+    size_t position = enqueuePos_.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &slots_[position & mask_];
+        const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+        if (difference == 0) {
+            if (enqueuePos_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (difference < 0) {
+            return false;
+        }
+        else {
+            position = enqueuePos_.load(std::memory_order_relaxed);
+        }
     }
-    else if (mode_ == OutputMode::File && file_.is_open()) {
-        file_ << logMessage << std::endl;
+    slot->level = level;
+    slot->time = time;
+    slot->message.assign(message);
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+void Logger::RunWriter() {
+    std::string batch;
+    uint64_t reportedDrops = 0;
+    for (;;) {
+        // Read the flag first, so everything pushed before the destructor set it is drained below
+        const bool stopping = stopping_.load(std::memory_order_acquire);
+
+        size_t count = 0;
+        batch.clear();
+        for (;;) {
+            Slot& slot = slots_[dequeuePos_ & mask_];
+            if (slot.sequence.load(std::memory_order_acquire) != dequeuePos_ + 1) {
+                break;
+            }
+            AppendLine(batch, slot.time, slot.level, slot.message);
+            slot.sequence.store(dequeuePos_ + mask_ + 1, std::memory_order_release);
+            dequeuePos_++;
+            count++;
+        }
+
+        const uint64_t drops = dropped_.load(std::memory_order_relaxed);
+        if (drops != reportedDrops) {
+            AppendLine(batch, std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()), LogLevel::Warning,
+                std::to_string(drops - reportedDrops) + " log messages dropped, the queue was full");
+            reportedDrops = drops;
+        }
+
+        if (!batch.empty()) {
+            // One write and one flush per batch instead of per message
+            Write(batch);
+            written_.fetch_add(count, std::memory_order_release);
+        }
+        else if (stopping) {
+            return;
+        }
+        else {
+            std::this_thread::sleep_for(settings_.idleWait);
+        }
     }
 }
 
-std::string Logger::GetCurrentTime() const {
-    auto now = std::chrono::system_clock::now();
-    auto time = std::chrono::system_clock::to_time_t(now);
+void Logger::SetLevel(LogLevel level) {
+    level_.store(level, std::memory_order_relaxed);
+}
 
-    struct tm timeinfo;
-    localtime_s(&timeinfo, &time);
+void Logger::Flush() {
+    if (!async_) {
+        return;
+    }
+    const size_t target = enqueuePos_.load(std::memory_order_acquire);
+    while (written_.load(std::memory_order_acquire) < target) {
+        std::this_thread::yield();
+    }
+}
+
+uint64_t Logger::GetDroppedCount() const {
+    return dropped_.load(std::memory_order_relaxed);
+}
 
-    std::stringstream ss;
-    ss << std::put_time(&timeinfo, "%Y-%m-%d %H:%M:%S");
-    return ss.str();
+void Logger::Write(const std::string& text) {
+    if (mode_ == OutputMode::Console) {
+        std::cout.write(text.data(), static_cast<std::streamsize>(text.size()));
+        std::cout.flush();
+    }
+    else if (mode_ == OutputMode::File && file_.IsOpen()) {
+        file_.Write(text.data(), text.size());
+        file_.Flush();
+    }
+}
+
+void Logger::AppendLine(std::string& out, std::time_t time, LogLevel level, const std::string& message) {
+    if (time != cachedSecond_) {
+        struct tm timeinfo;
+#ifdef _WIN32
+        localtime_s(&timeinfo, &time);
+#else
+        localtime_r(&time, &timeinfo);
+#endif
+        std::strftime(cachedTimestamp_, sizeof(cachedTimestamp_), "%Y-%m-%d %H:%M:%S", &timeinfo);
+        cachedSecond_ = time;
+    }
+    out += cachedTimestamp_;
+    out += " [";
+    out += LogLevelToString(level);
+    out += "] ";
+    out += message;
+    out += '\n';
 }
 
 std::string Logger::LogLevelToString(LogLevel level) const {
     switch (level) {
+    case LogLevel::Trace: return "TRACE";
+    case LogLevel::Debug: return "DEBUG";
     case LogLevel::Info: return "INFO";
     case LogLevel::Warning: return "WARNING";
     case LogLevel::Error: return "ERROR";
@@ -7,14 +7,31 @@
 #include <chrono>
 #include <iomanip>
 #include <sstream>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <thread>
+#include "LogFile.h"
+
+// Messages below this level are compiled out of LOGGER_LOG and LOG_STRUCTURED:
+// 0 Trace, 1 Debug, 2 Info, 3 Warning, 4 Error. Release builds keep Info and up unless the build defines it.
+#ifndef LOGGER_MIN_LEVEL
+#ifdef NDEBUG
+#define LOGGER_MIN_LEVEL 2
+#else
+#define LOGGER_MIN_LEVEL 0
+#endif
+#endif
 
 class Logger {
 public:
 	enum class LogLevel {
+		Trace,
+		Debug,
 		Info,
 		Warning,
 		Error
-		// You can add more levels like Debug, Trace here
 	};
 
 	enum class OutputMode {
@@ -22,21 +39,90 @@ public:
 		File
 	};
 
+	// What Log does when the async queue is full
+	enum class OverflowPolicy {
+		Block,       // Wait for the writer to make room, nothing is lost
+		Drop,        // Discard the message
+		CountDrops   // Discard the message, the writer logs how many were lost
+	};
+
+	struct AsyncSettings {
+		size_t capacity = 8192;                              // Queued messages, rounded up to a power of two
+		OverflowPolicy overflow = OverflowPolicy::Block;
+		std::chrono::milliseconds idleWait{ 2 };             // How long the writer sleeps when the queue is empty
+	};
+
 	// Constructor to initialize the logger with output mode and filename
 	Logger(OutputMode mode, const std::string& filename = "log.txt");
+	// File output rotated by size and count, optionally through a memory-mapped region
+	Logger(OutputMode mode, const std::string& filename, const LogFileSettings& fileSettings);
+	// Asynchronous logger: Log only queues the message, a background thread formats and writes them in batches
+	Logger(OutputMode mode, const std::string& filename, const AsyncSettings& async, const LogFileSettings& fileSettings = LogFileSettings());
 	~Logger();
 
 	// Log a message with a specific log level
 	void Log(LogLevel level, const std::string& message);
 
+	// Messages below the runtime level are ignored, Info by default. Safe to change while other threads log.
+	void SetLevel(LogLevel level);
+	bool IsEnabled(LogLevel level) const { return level >= level_.load(std::memory_order_relaxed); }
+
+	// Wait until every message logged so far is written out
+	void Flush();
+
+	// Messages discarded under OverflowPolicy::CountDrops
+	uint64_t GetDroppedCount() const;
+
 private:
-	// Get current time in string format
-	std::string GetCurrentTime() const;
+	// A queued message. sequence tells producers and the writer whose turn the slot is.
+	struct Slot {
+		std::atomic<size_t> sequence{ 0 };
+		LogLevel level = LogLevel::Info;
+		std::time_t time = 0;
+		std::string message;  // Keeps its capacity, so a reused slot does not allocate
+	};
+
+	// Write a formatted line into out, the timestamp is formatted once per second
+	void AppendLine(std::string& out, std::time_t time, LogLevel level, const std::string& message);
 
 	// Convert log level enum to string
 	std::string LogLevelToString(LogLevel level) const;
 
+	void Write(const std::string& text);
+	bool TryPush(LogLevel level, std::time_t time, const std::string& message);
+	void RunWriter();
+
 	OutputMode mode_;  // Output mode (Console or File)
-	std::ofstream file_;  // File stream for logging to a file
+	std::atomic<LogLevel> level_{ LogLevel::Info };
+	LogFile file_;  // File for logging to a file
 	std::mutex mutex_;  // Mutex for thread safety
+
+	std::time_t cachedSecond_ = -1;  // Second the cached timestamp text is for
+	char cachedTimestamp_[32] = {};
+
+	// Async mode, a bounded multi-producer single-consumer ring
+	bool async_ = false;
+	AsyncSettings settings_;
+	std::unique_ptr<Slot[]> slots_;
+	size_t mask_ = 0;
+	alignas(64) std::atomic<size_t> enqueuePos_{ 0 };
+	alignas(64) size_t dequeuePos_ = 0;  // Writer only
+	std::atomic<size_t> written_{ 0 };
+	std::atomic<uint64_t> dropped_{ 0 };
+	std::atomic<bool> stopping_{ false };
+	std::thread writer_;
 };
+
+// True when level survives LOGGER_MIN_LEVEL, level has to be a constant
+#define LOGGER_COMPILED_LEVEL(level) (static_cast<int>(level) >= LOGGER_MIN_LEVEL)
+
+// Checks the compile-time and the runtime level before message is evaluated:
+// LOGGER_LOG(logger, Logger::LogLevel::Debug, "Built " + std::to_string(count) + " nodes");
+#define LOGGER_LOG(logger, level, message) \
+	do { \
+		if constexpr (LOGGER_COMPILED_LEVEL(level)) { \
+			if ((logger).IsEnabled(level)) { \
+				(logger).Log(level, message); \
+			} \
+		} \
+	} while (0)
@@ -0,0 +1,171 @@
+#include "MeshOptimizer.h"
+#include "TreeMesh.h"
+#include <algorithm>
+#include <chrono>
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize) {
+	VertexCacheStats stats;
+	if (indexCount < 3 || vertexCount == 0) {
+		return stats;
+	}
+
+	// A vertex is in the FIFO while fewer than cacheSize misses happened since it was loaded
+	std::vector<uint64_t> loadedAt(vertexCount, 0);
+	std::vector<uint8_t> referenced(vertexCount, 0);
+	uint64_t misses = 0;
+	size_t uniqueVertices = 0;
+	for (size_t i = 0; i < indexCount; ++i) {
+		const uint32_t v = indices[i];
+		if (!referenced[v]) {
+			referenced[v] = 1;
+			uniqueVertices++;
+		}
+		if (loadedAt[v] == 0 || misses + 1 - loadedAt[v] > cacheSize) {
+			misses++;
+			loadedAt[v] = misses;
+		}
+	}
+
+	stats.acmr = static_cast<float>(misses) / static_cast<float>(indexCount / 3);
+	stats.atvr = static_cast<float>(misses) / static_cast<float>(uniqueVertices);
+	return stats;
+}
+
+void OptimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize) {
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Triangles using each vertex
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i) {
+		adjacencyOffsets[indices[i] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; ++v) {
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	}
+	std::vector<uint32_t> adjacency(adjacencyOffsets[vertexCount]);
+	std::vector<uint32_t> liveTriangles(vertexCount);
+	{
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; ++i) {
+			adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+		for (size_t v = 0; v < vertexCount; ++v) {
+			liveTriangles[v] = adjacencyOffsets[v + 1] - adjacencyOffsets[v];
+		}
+	}
+
+	std::vector<uint32_t> output(triangleCount * 3);
+	size_t outputCount = 0;
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidates;
+	deadEnd.reserve(triangleCount * 3);
+	uint32_t timestamp = cacheSize + 1;
+	size_t cursor = 0;
+
+	auto nextFanningVertex = [&]() -> int64_t {
+		// Prefer the candidate that will still be in cache after its remaining triangles are emitted
+		int64_t best = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t v : candidates) {
+			if (liveTriangles[v] == 0) {
+				continue;
+			}
+			int64_t priority = 0;
+			if (timestamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+				priority = timestamp - cacheTime[v];
+			}
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				best = v;
+			}
+		}
+		if (best >= 0) {
+			return best;
+		}
+
+		// Dead end, back up through recently used vertices and then scan forward
+		while (!deadEnd.empty()) {
+			uint32_t v = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[v] > 0) {
+				return v;
+			}
+		}
+		while (cursor < vertexCount) {
+			if (liveTriangles[cursor] > 0) {
+				return static_cast<int64_t>(cursor);
+			}
+			cursor++;
+		}
+		return -1;
+	};
+
+	int64_t fanning = indices[0];
+	while (fanning >= 0) {
+		candidates.clear();
+		const uint32_t f = static_cast<uint32_t>(fanning);
+		for (uint32_t a = adjacencyOffsets[f]; a < adjacencyOffsets[f + 1]; ++a) {
+			const uint32_t triangle = adjacency[a];
+			if (emitted[triangle]) {
+				continue;
+			}
+			emitted[triangle] = 1;
+			for (uint32_t k = 0; k < 3; ++k) {
+				const uint32_t v = indices[triangle * 3 + k];
+				output[outputCount++] = v;
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (timestamp - cacheTime[v] > cacheSize) {
+					cacheTime[v] = timestamp++;
+				}
+			}
+		}
+		fanning = nextFanningVertex();
+	}
+
+	std::copy(output.begin(), output.end(), destination);
+}
+
+std::vector<uint32_t> VertexFetchRemap(const uint32_t* indices, size_t indexCount, size_t vertexCount) {
+	std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+	uint32_t next = 0;
+	for (size_t i = 0; i < indexCount; ++i) {
+		if (remap[indices[i]] == UINT32_MAX) {
+			remap[indices[i]] = next++;
+		}
+	}
+	for (auto& target : remap) {
+		if (target == UINT32_MAX) {
+			target = next++;
+		}
+	}
+	return remap;
+}
+
+void OptimizeTreeMesh(TreeMeshData& mesh, MeshOptimizeReport* report, uint32_t cacheSize) {
+	auto start = std::chrono::high_resolution_clock::now();
+	const size_t vertexCount = mesh.vertex_positions.size();
+	if (report != nullptr) {
+		report->before = AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), vertexCount, cacheSize);
+	}
+
+	// Subsets are drawn separately, so each one is ordered on its own
+	for (const auto& subset : mesh.subsets) {
+		uint32_t* subsetIndices = mesh.indices.data() + subset.indexOffset;
+		OptimizeVertexCache(subsetIndices, subsetIndices, subset.indexCount, vertexCount, cacheSize);
+	}
+
+	std::vector<uint32_t> remap = VertexFetchRemap(mesh.indices.data(), mesh.indices.size(), vertexCount);
+	ApplyVertexRemap(mesh, remap, static_cast<uint32_t>(vertexCount));
+
+	if (report != nullptr) {
+		report->after = AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), vertexCount, cacheSize);
+		report->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
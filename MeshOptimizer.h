@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct TreeMeshData;
+
+// Post-transform cache efficiency of an index buffer, measured with a FIFO cache
+struct VertexCacheStats {
+	float acmr = 0.0f;  // Average cache miss ratio, vertices transformed per triangle (0.5 is ideal for large grids, 3 is worst)
+	float atvr = 0.0f;  // Average transform to vertex ratio, vertices transformed per vertex referenced (1 is ideal)
+};
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = 16);
+
+// Reorder triangles for the post-transform vertex cache (Tipsify), runs in linear time. destination may equal indices.
+void OptimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = 16);
+
+// Remap that renumbers vertices in the order the index buffer first uses them, unused vertices go last
+std::vector<uint32_t> VertexFetchRemap(const uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+struct MeshOptimizeReport {
+	VertexCacheStats before;
+	VertexCacheStats after;
+	double milliseconds = 0.0;
+};
+
+// Cache-optimize every subset of a welded tree mesh, then reorder vertices to first-use order
+void OptimizeTreeMesh(TreeMeshData& mesh, MeshOptimizeReport* report = nullptr, uint32_t cacheSize = 16);
@@ -0,0 +1,384 @@
+#include "SimulationJournal.h"
+#include "GrowthScheduler.h"
+#include "TimeSimulator.h"
+#include "TreeMeshCache.h"
+#include "TwoOLSystem.h"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+static constexpr uint32_t kSimulationJournalMagic = 0x31524A53; // "SJR1"
+static constexpr uint32_t kSimulationJournalVersion = 2;
+
+struct SimulationJournalHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t entryCount;
+	uint64_t payloadSize;
+	uint64_t checksum;      // HashBytes of the payload
+};
+
+// Raw clock sample of the last RecordingClock call on this thread
+static thread_local int64_t lastClockSample = 0;
+
+void SimulationJournal::StartRecording() {
+	std::lock_guard<std::mutex> guard(lock);
+	entries.clear();
+	lastTick = 0;
+	recording = true;
+}
+
+void SimulationJournal::StopRecording() {
+	std::lock_guard<std::mutex> guard(lock);
+	recording = false;
+}
+
+bool SimulationJournal::IsRecording() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return recording;
+}
+
+int64_t SimulationJournal::RecordingClock(void*) {
+	lastClockSample = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	return lastClockSample;
+}
+
+void SimulationJournal::Append(const JournalEntry& entry) {
+	std::lock_guard<std::mutex> guard(lock);
+	if (!recording) {
+		return;
+	}
+	if (entry.type == JournalEvent::Tick) {
+		// A tick to the time the last one reached steps nothing, a stopped clock costs no space
+		if (entry.nanoseconds == lastTick) {
+			return;
+		}
+		lastTick = entry.nanoseconds;
+	}
+	else if (entry.type == JournalEvent::Begin) {
+		lastTick = entry.nanoseconds;
+	}
+	entries.push_back(entry);
+}
+
+void SimulationJournal::RecordBegin(const std::vector<LSystemGeneration>& generations, int64_t elapsedNanoseconds, const GrowthSchedulerSettings& settings) {
+	JournalEntry entry;
+	entry.type = JournalEvent::Begin;
+	entry.nanoseconds = elapsedNanoseconds;
+	entry.value = HashGenerations(generations);
+	entry.time = settings.timestep;
+	entry.count = settings.maxCatchUpSteps;
+	Append(entry);
+}
+
+void SimulationJournal::RecordTick(int64_t elapsedNanoseconds) {
+	JournalEntry entry;
+	entry.type = JournalEvent::Tick;
+	entry.nanoseconds = elapsedNanoseconds;
+	Append(entry);
+}
+
+void SimulationJournal::RecordControl(JournalControl control) {
+	JournalEntry entry;
+	entry.type = JournalEvent::Control;
+	entry.control = control;
+	entry.nanoseconds = lastClockSample;
+	Append(entry);
+}
+
+void SimulationJournal::RecordSeed(uint64_t seed) {
+	JournalEntry entry;
+	entry.type = JournalEvent::Seed;
+	entry.value = seed;
+	Append(entry);
+}
+
+void SimulationJournal::RecordFastForward(double time, double duration, int64_t clockNanoseconds) {
+	JournalEntry entry;
+	entry.type = JournalEvent::FastForward;
+	entry.nanoseconds = clockNanoseconds;
+	entry.time = time;
+	entry.duration = duration;
+	Append(entry);
+}
+
+static void WriteVarint(std::vector<uint8_t>& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back(static_cast<uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<uint8_t>(value));
+}
+
+// Small deltas of either sign take few bytes
+static void WriteDelta(std::vector<uint8_t>& out, int64_t delta) {
+	const uint64_t bits = static_cast<uint64_t>(delta);
+	WriteVarint(out, (bits << 1) ^ (delta < 0 ? ~uint64_t(0) : 0));
+}
+
+template <typename T>
+static void WriteRaw(std::vector<uint8_t>& out, const T& value) {
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+	out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+static bool ReadVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (p == end) {
+			return false;
+		}
+		const uint8_t byte = *p++;
+		value |= uint64_t(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool ReadDelta(const uint8_t*& p, const uint8_t* end, int64_t& delta) {
+	uint64_t bits;
+	if (!ReadVarint(p, end, bits)) {
+		return false;
+	}
+	delta = static_cast<int64_t>((bits >> 1) ^ (~(bits & 1) + 1));
+	return true;
+}
+
+template <typename T>
+static bool ReadRaw(const uint8_t*& p, const uint8_t* end, T& value) {
+	if (static_cast<size_t>(end - p) < sizeof(T)) {
+		return false;
+	}
+	std::memcpy(&value, p, sizeof(T));
+	p += sizeof(T);
+	return true;
+}
+
+bool SimulationJournal::Save(const std::string& path) const {
+	std::vector<uint8_t> payload;
+	SimulationJournalHeader header = {};
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		payload.reserve(entries.size() * 3);
+		int64_t tick = 0;
+		int64_t sample = 0;
+		for (const JournalEntry& entry : entries) {
+			payload.push_back(static_cast<uint8_t>(entry.type));
+			switch (entry.type) {
+			case JournalEvent::Begin:
+				WriteDelta(payload, entry.nanoseconds - tick);
+				tick = entry.nanoseconds;
+				WriteRaw(payload, entry.value);
+				WriteRaw(payload, entry.time);
+				WriteVarint(payload, entry.count);
+				break;
+			case JournalEvent::Tick:
+				WriteDelta(payload, entry.nanoseconds - tick);
+				tick = entry.nanoseconds;
+				break;
+			case JournalEvent::Control:
+				payload.push_back(static_cast<uint8_t>(entry.control));
+				WriteDelta(payload, entry.nanoseconds - sample);
+				sample = entry.nanoseconds;
+				break;
+			case JournalEvent::Seed:
+				WriteVarint(payload, entry.value);
+				break;
+			case JournalEvent::FastForward:
+				WriteRaw(payload, entry.time);
+				WriteRaw(payload, entry.duration);
+				WriteDelta(payload, entry.nanoseconds);
+				break;
+			}
+		}
+		header.entryCount = entries.size();
+	}
+	header.magic = kSimulationJournalMagic;
+	header.version = kSimulationJournalVersion;
+	header.payloadSize = payload.size();
+	header.checksum = HashBytes(payload.data(), payload.size());
+
+	std::error_code error;
+	std::filesystem::path target(path);
+	if (target.has_parent_path()) {
+		std::filesystem::create_directories(target.parent_path(), error);
+	}
+	std::filesystem::path temporary = target;
+	temporary += ".tmp";
+
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(payload.data()), static_cast<std::streamsize>(payload.size()));
+		if (!file) {
+			file.close();
+			std::filesystem::remove(temporary, error);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(temporary, target, error);
+	if (error) {
+		std::filesystem::remove(temporary, error);
+		return false;
+	}
+	return true;
+}
+
+bool SimulationJournal::Load(const std::string& path) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	SimulationJournalHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		header.magic != kSimulationJournalMagic || header.version != kSimulationJournalVersion) {
+		return false;
+	}
+
+	// Every entry takes at least its type byte, which bounds both counts by the file size before allocating
+	std::error_code error;
+	const uint64_t fileSize = std::filesystem::file_size(path, error);
+	if (error || header.payloadSize != fileSize - sizeof(header) || header.entryCount > header.payloadSize) {
+		return false;
+	}
+	std::vector<uint8_t> payload(static_cast<size_t>(header.payloadSize));
+	if (!file.read(reinterpret_cast<char*>(payload.data()), static_cast<std::streamsize>(payload.size())) ||
+		HashBytes(payload.data(), payload.size()) != header.checksum) {
+		return false;
+	}
+
+	std::vector<JournalEntry> loaded;
+	loaded.reserve(static_cast<size_t>(header.entryCount));
+	const uint8_t* p = payload.data();
+	const uint8_t* end = p + payload.size();
+	int64_t tick = 0;
+	int64_t sample = 0;
+	for (uint64_t i = 0; i < header.entryCount; ++i) {
+		JournalEntry entry;
+		if (p == end || *p > static_cast<uint8_t>(JournalEvent::FastForward)) {
+			return false;
+		}
+		entry.type = static_cast<JournalEvent>(*p++);
+		int64_t delta = 0;
+		uint64_t count = 0;
+		bool valid = true;
+		switch (entry.type) {
+		case JournalEvent::Begin:
+			valid = ReadDelta(p, end, delta) && ReadRaw(p, end, entry.value) && ReadRaw(p, end, entry.time) && ReadVarint(p, end, count);
+			tick += delta;
+			entry.nanoseconds = tick;
+			entry.count = static_cast<uint32_t>(count);
+			break;
+		case JournalEvent::Tick:
+			valid = ReadDelta(p, end, delta);
+			tick += delta;
+			entry.nanoseconds = tick;
+			break;
+		case JournalEvent::Control:
+			valid = p != end && *p <= static_cast<uint8_t>(JournalControl::Reset);
+			if (valid) {
+				entry.control = static_cast<JournalControl>(*p++);
+				valid = ReadDelta(p, end, delta);
+			}
+			sample += delta;
+			entry.nanoseconds = sample;
+			break;
+		case JournalEvent::Seed:
+			valid = ReadVarint(p, end, entry.value);
+			break;
+		case JournalEvent::FastForward:
+			valid = ReadRaw(p, end, entry.time) && ReadRaw(p, end, entry.duration) && ReadDelta(p, end, entry.nanoseconds);
+			break;
+		}
+		if (!valid) {
+			return false;
+		}
+		loaded.push_back(entry);
+	}
+	if (p != end) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	entries = std::move(loaded);
+	recording = false;
+	return true;
+}
+
+uint64_t HashGenerations(const std::vector<LSystemGeneration>& generations) {
+	uint64_t hash = generations.size();
+	for (const LSystemGeneration& generation : generations) {
+		hash = HashBytes(generation.data(), generation.size() * sizeof(LSystemNode), hash);
+	}
+	return hash;
+}
+
+// Replay clock source, context points at the sample the next read returns
+static int64_t ReplayClock(void* context) {
+	return *static_cast<const int64_t*>(context);
+}
+
+SimulationReplayStats ReplaySimulationJournal(const SimulationJournal& journal, std::vector<LSystemGeneration>& generations) {
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point replayStart = Clock::now();
+	SimulationReplayStats stats;
+
+	int64_t sample = 0;
+	TimeSimulator clock;
+	clock.setClockSource(ReplayClock, &sample);
+
+	GrowthSchedulerSettings settings;
+	double time = 0.0;
+	bool started = false;
+	for (const JournalEntry& entry : journal.GetEntries()) {
+		switch (entry.type) {
+		case JournalEvent::Begin:
+			// The scheduler took over the tree and the clock time as they were at Start
+			if (entry.value != HashGenerations(generations)) {
+				stats.divergedStarts++;
+			}
+			settings.timestep = entry.time;
+			settings.maxCatchUpSteps = entry.count;
+			time = static_cast<double>(entry.nanoseconds) * 1e-9;
+			started = true;
+			break;
+		case JournalEvent::Tick:
+			if (started) {
+				stats.steps += AdvanceGrowth(generations, time, static_cast<double>(entry.nanoseconds) * 1e-9, settings, stats.skippedSteps);
+				stats.ticks++;
+			}
+			break;
+		case JournalEvent::Control:
+			sample = entry.nanoseconds;
+			switch (entry.control) {
+			case JournalControl::Start: clock.start(); break;
+			case JournalControl::Stop: clock.stop(); break;
+			case JournalControl::Reverse: clock.reverse(); break;
+			case JournalControl::Reset: clock.reset(); break;
+			}
+			stats.controls++;
+			break;
+		case JournalEvent::Seed:
+			stats.seeds.push_back(entry.value);
+			break;
+		case JournalEvent::FastForward:
+			fastForwardGrowth(generations, entry.time, entry.duration);
+			clock.advance(entry.nanoseconds);
+			stats.fastForwards++;
+			break;
+		}
+	}
+
+	stats.simulationTime = time;
+	stats.clockNanoseconds = clock.getElapsedNanoseconds();
+	stats.clockReversed = clock.getIsReversed();
+	stats.milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - replayStart).count();
+	return stats;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Forward declaration of LSystemNode
+class LSystemNode;
+struct GrowthSchedulerSettings;
+
+using LSystemGeneration = std::vector<LSystemNode>;
+
+enum class JournalEvent : uint8_t {
+	Begin,          // A GrowthScheduler started from the given generations
+	Tick,           // A scheduler tick followed the clock to a new elapsed time
+	Control,        // start, stop, reverse or reset on the TimeSimulator
+	Seed,           // A seed handed to a random generator
+	FastForward,    // fastForwardGrowth applied to the tree outside the scheduler, and the clock advanced to match
+};
+
+enum class JournalControl : uint8_t {
+	Start,
+	Stop,
+	Reverse,
+	Reset,
+};
+
+// Which fields are used depends on type
+struct JournalEntry {
+	JournalEvent type = JournalEvent::Tick;
+	JournalControl control = JournalControl::Start;
+	int64_t nanoseconds = 0;    // Begin and Tick: simulator elapsed time, Control: the raw clock sample the action read,
+	                            // FastForward: what TimeSimulator::advance moved the clock by
+	uint64_t value = 0;         // Begin: HashGenerations of the starting tree, Seed: the seed
+	double time = 0.0;          // Begin: timestep, FastForward: simulated time the jump started at
+	double duration = 0.0;      // FastForward: length of the jump
+	uint32_t count = 0;         // Begin: maxCatchUpSteps
+};
+
+// Everything growth depends on during a session, in the order it happened: the clock times scheduler ticks stepped to,
+// the control actions with the clock samples they used, fast forwards and seeds. Replaying it offline reproduces the
+// session's growth exactly, at full speed and without the UI. Recording may happen from any thread.
+class SimulationJournal {
+public:
+	// Clear the journal and record from now on
+	void StartRecording();
+	void StopRecording();
+	bool IsRecording() const;
+
+	// TimeSimulator clock source, context is unused. Reads steady_clock and remembers the sample for the calling thread,
+	// so the next RecordControl from that thread stores exactly the time the simulator saw.
+	static int64_t RecordingClock(void* context);
+
+	void RecordBegin(const std::vector<LSystemGeneration>& generations, int64_t elapsedNanoseconds, const GrowthSchedulerSettings& settings);
+	void RecordTick(int64_t elapsedNanoseconds);
+	// Call right after the action, on the thread that performed it
+	void RecordControl(JournalControl control);
+	void RecordSeed(uint64_t seed);
+	void RecordFastForward(double time, double duration, int64_t clockNanoseconds);
+
+	// Not synchronized with recording
+	const std::vector<JournalEntry>& GetEntries() const { return entries; }
+
+	// Compact binary file: a type byte per event, clock times as zigzag varint deltas. Written through a temporary file.
+	bool Save(const std::string& path) const;
+	// False when the file is missing, from another version or damaged
+	bool Load(const std::string& path);
+
+private:
+	void Append(const JournalEntry& entry);
+
+	mutable std::mutex lock;
+	bool recording = false;
+	int64_t lastTick = 0;
+	std::vector<JournalEntry> entries;
+};
+
+struct SimulationReplayStats {
+	uint64_t ticks = 0;
+	uint64_t steps = 0;             // stepGrowth and fastForwardGrowth calls, as GrowthSchedulerStats counts them
+	uint64_t skippedSteps = 0;
+	uint64_t fastForwards = 0;
+	uint64_t controls = 0;
+	uint64_t divergedStarts = 0;    // Begins whose tree differs from the replayed one, e.g. a tree loaded mid-session
+	double simulationTime = 0.0;
+	int64_t clockNanoseconds = 0;   // Elapsed time of the replayed TimeSimulator after the last control
+	bool clockReversed = false;
+	double milliseconds = 0.0;      // Wall time the replay took
+	std::vector<uint64_t> seeds;    // Recorded seeds in order, to seed generators the same way
+};
+
+// Hash of the raw node data of every generation
+uint64_t HashGenerations(const std::vector<LSystemGeneration>& generations);
+
+// Run a recorded session on generations, the tree the session started with, as fast as possible. Ticks go through the
+// same AdvanceGrowth the scheduler runs and controls drive a TimeSimulator from the recorded clock samples.
+SimulationReplayStats ReplaySimulationJournal(const SimulationJournal& journal, std::vector<LSystemGeneration>& generations);
@@ -0,0 +1,367 @@
+#include "StructuredLog.h"
+#include <cstdio>
+#include <ctime>
+#include <stdexcept>
+#include <unordered_map>
+
+static constexpr const char* kDroppedFormat = "{} structured log messages dropped, a thread buffer was full";
+
+static std::mutex formatsLock;
+static std::unordered_map<uint64_t, const char*>& GetFormats() {
+	static std::unordered_map<uint64_t, const char*> formats;
+	return formats;
+}
+
+static std::atomic<uint64_t> nextLoggerId{ 1 };
+static std::atomic<StructuredLogger*> structuredLog{ nullptr };
+
+bool RegisterLogFormat(uint64_t id, const char* format) {
+	std::lock_guard<std::mutex> guard(formatsLock);
+	GetFormats().emplace(id, format);
+	return true;
+}
+
+const char* FindLogFormat(uint64_t id) {
+	std::lock_guard<std::mutex> guard(formatsLock);
+	auto it = GetFormats().find(id);
+	return it == GetFormats().end() ? nullptr : it->second;
+}
+
+void SetStructuredLog(StructuredLogger* logger) {
+	structuredLog.store(logger, std::memory_order_release);
+}
+
+StructuredLogger* GetStructuredLog() {
+	return structuredLog.load(std::memory_order_acquire);
+}
+
+static const char* LevelName(uint8_t level) {
+	switch (static_cast<Logger::LogLevel>(level)) {
+	case Logger::LogLevel::Trace: return "TRACE";
+	case Logger::LogLevel::Debug: return "DEBUG";
+	case Logger::LogLevel::Info: return "INFO";
+	case Logger::LogLevel::Warning: return "WARNING";
+	case Logger::LogLevel::Error: return "ERROR";
+	default: return "UNKNOWN";
+	}
+}
+
+bool FormatLogLine(std::string& out, int64_t timeNs, uint8_t level, const char* format, const uint8_t* arguments, size_t argumentBytes, uint32_t argumentCount) {
+	// The date part only changes once per second
+	static thread_local std::time_t cachedSecond = -1;
+	static thread_local char cachedTimestamp[32];
+	const int64_t milliseconds = timeNs / 1000000;
+	const std::time_t second = static_cast<std::time_t>(milliseconds / 1000);
+	if (second != cachedSecond) {
+		struct tm timeinfo;
+#ifdef _WIN32
+		localtime_s(&timeinfo, &second);
+#else
+		localtime_r(&second, &timeinfo);
+#endif
+		std::strftime(cachedTimestamp, sizeof(cachedTimestamp), "%Y-%m-%d %H:%M:%S", &timeinfo);
+		cachedSecond = second;
+	}
+	char fraction[8];
+	std::snprintf(fraction, sizeof(fraction), ".%03d", static_cast<int>(milliseconds % 1000));
+	out += cachedTimestamp;
+	out += fraction;
+	out += " [";
+	out += LevelName(level);
+	out += "] ";
+
+	const uint8_t* p = arguments;
+	const uint8_t* end = arguments + argumentBytes;
+	uint32_t used = 0;
+	bool valid = true;
+	for (const char* c = format; *c != '\0'; ++c) {
+		if (c[0] != '{' || c[1] != '}' || used == argumentCount) {
+			out += *c;
+			continue;
+		}
+		++c;
+		used++;
+		if (p == end) {
+			valid = false;
+			break;
+		}
+		const StructuredArgument tag = static_cast<StructuredArgument>(*p++);
+		if (tag == StructuredArgument::String) {
+			uint32_t length;
+			if (end - p < 4) {
+				valid = false;
+				break;
+			}
+			std::memcpy(&length, p, 4);
+			p += 4;
+			if (static_cast<size_t>(end - p) < length) {
+				valid = false;
+				break;
+			}
+			out.append(reinterpret_cast<const char*>(p), length);
+			p += length;
+			continue;
+		}
+		if (end - p < 8) {
+			valid = false;
+			break;
+		}
+		char number[32];
+		if (tag == StructuredArgument::Signed) {
+			int64_t value;
+			std::memcpy(&value, p, 8);
+			std::snprintf(number, sizeof(number), "%lld", static_cast<long long>(value));
+		}
+		else if (tag == StructuredArgument::Unsigned) {
+			uint64_t value;
+			std::memcpy(&value, p, 8);
+			std::snprintf(number, sizeof(number), "%llu", static_cast<unsigned long long>(value));
+		}
+		else if (tag == StructuredArgument::Float) {
+			double value;
+			std::memcpy(&value, p, 8);
+			std::snprintf(number, sizeof(number), "%.9g", value);
+		}
+		else {
+			valid = false;
+			break;
+		}
+		p += 8;
+		out += number;
+	}
+	out += '\n';
+	return valid;
+}
+
+StructuredLogger::StructuredLogger(const std::string& filename, const StructuredLoggerSettings& loggerSettings)
+	: settings(loggerSettings), loggerId(nextLoggerId.fetch_add(1, std::memory_order_relaxed)) {
+	if (!file.Open(filename, settings.file, settings.text)) {
+		throw std::runtime_error("Failed to open log file.");
+	}
+	if (!settings.text) {
+		WriteFileHeader(file);
+		// Only called from the writer thread, inside its own writes
+		file.SetRotateCallback([this](LogFile& rotated) { WriteFileHeader(rotated); });
+	}
+	RegisterLogFormat(LogFormatId(kDroppedFormat), kDroppedFormat);
+	writer = std::thread(&StructuredLogger::RunWriter, this);
+}
+
+StructuredLogger::~StructuredLogger() {
+	stopping.store(true, std::memory_order_release);
+	writer.join();
+}
+
+StructuredLogger::ThreadBuffer& StructuredLogger::GetThreadBuffer() {
+	// One lookup per thread and logger, later messages hit the cache
+	struct CachedBuffer {
+		uint64_t loggerId = 0;
+		ThreadBuffer* buffer = nullptr;
+	};
+	static thread_local CachedBuffer cached;
+	if (cached.loggerId == loggerId) {
+		return *cached.buffer;
+	}
+
+	std::lock_guard<std::mutex> guard(buffersLock);
+	ThreadBuffer*& owned = threadBuffers[std::this_thread::get_id()];
+	if (owned == nullptr) {
+		size_t capacity = 64;
+		while (capacity < settings.threadBufferBytes) {
+			capacity <<= 1;
+		}
+		auto buffer = std::make_unique<ThreadBuffer>();
+		buffer->data.reset(new uint8_t[capacity]);
+		buffer->mask = capacity - 1;
+		owned = buffer.get();
+		buffers.push_back(std::move(buffer));
+	}
+	cached.loggerId = loggerId;
+	cached.buffer = owned;
+	return *owned;
+}
+
+uint8_t* StructuredLogger::Reserve(ThreadBuffer& buffer, size_t size) {
+	const size_t capacity = buffer.mask + 1;
+	size_t head = buffer.head.load(std::memory_order_relaxed);
+	const size_t offset = head & buffer.mask;
+	// A record never wraps, the rest of the buffer is skipped with a padding record instead
+	const size_t padding = offset + size > capacity ? capacity - offset : 0;
+
+	while (size > capacity || head + padding + size - buffer.tail.load(std::memory_order_acquire) > capacity) {
+		if (settings.overflow != Logger::OverflowPolicy::Block || size > capacity) {
+			if (settings.overflow == Logger::OverflowPolicy::CountDrops) {
+				dropped.fetch_add(1, std::memory_order_relaxed);
+			}
+			return nullptr;
+		}
+		std::this_thread::yield();
+	}
+
+	if (padding > 0) {
+		uint8_t* record = buffer.data.get() + offset;
+		const uint32_t paddingSize = static_cast<uint32_t>(padding);
+		std::memcpy(record, &paddingSize, 4);
+		record[4] = static_cast<uint8_t>(StructuredRecord::Padding);
+		head += padding;
+		buffer.head.store(head, std::memory_order_release);
+	}
+	return buffer.data.get() + (head & buffer.mask);
+}
+
+void StructuredLogger::AppendRecord(std::string& batch, const uint8_t* record, uint32_t size) {
+	uint64_t formatId;
+	std::memcpy(&formatId, record + 8, 8);
+	auto known = knownFormats.find(formatId);
+	const bool firstUse = known == knownFormats.end();
+	if (firstUse) {
+		known = knownFormats.emplace(formatId, FindLogFormat(formatId)).first;
+	}
+	const char* format = known->second;
+
+	if (settings.text) {
+		int64_t time;
+		std::memcpy(&time, record + 16, 8);
+		FormatLogLine(batch, time, record[5], format != nullptr ? format : "<unknown format>", record + kStructuredLogHeaderBytes, size - kStructuredLogHeaderBytes, record[6]);
+		return;
+	}
+
+	// The decoder learns each format from the file itself, right before its first use
+	if (firstUse && format != nullptr) {
+		AppendDefine(batch, formatId, format);
+	}
+	batch.append(reinterpret_cast<const char*>(record), size);
+}
+
+void StructuredLogger::AppendDefine(std::string& batch, uint64_t formatId, const char* format) {
+	const uint32_t length = static_cast<uint32_t>(std::strlen(format));
+	const uint32_t defineSize = (20 + length + 7) & ~uint32_t(7);
+	uint8_t define[20] = {};
+	std::memcpy(define, &defineSize, 4);
+	define[4] = static_cast<uint8_t>(StructuredRecord::Define);
+	std::memcpy(define + 8, &formatId, 8);
+	std::memcpy(define + 16, &length, 4);
+	batch.append(reinterpret_cast<const char*>(define), sizeof(define));
+	batch.append(format, length);
+	batch.append(defineSize - 20 - length, '\0');
+}
+
+// A fresh file starts with the header and every format seen so far, so each rotated file decodes on its own
+void StructuredLogger::WriteFileHeader(LogFile& target) {
+	std::string header;
+	const uint32_t magic[2] = { kStructuredLogMagic, kStructuredLogVersion };
+	header.append(reinterpret_cast<const char*>(magic), sizeof(magic));
+	for (const auto& known : knownFormats) {
+		if (known.second != nullptr) {
+			AppendDefine(header, known.first, known.second);
+		}
+	}
+	target.Write(header.data(), header.size());
+}
+
+void StructuredLogger::RunWriter() {
+	// Rotation happens between writes, so a batch is kept well below the file size to never split a record
+	const uint64_t fileLimit = settings.file.mapped ? settings.file.mappedBytes : settings.file.maxBytes;
+	const size_t batchLimit = fileLimit > 0 ? static_cast<size_t>(fileLimit / 2) : SIZE_MAX;
+	std::string batch;
+	bool wrote = false;
+	std::vector<ThreadBuffer*> active;
+	std::vector<size_t> tails;
+	uint64_t reportedDrops = 0;
+	for (;;) {
+		// Read the flag first, so everything logged before the destructor set it is drained below
+		const bool stop = stopping.load(std::memory_order_acquire);
+		{
+			std::lock_guard<std::mutex> guard(buffersLock);
+			active.clear();
+			for (const std::unique_ptr<ThreadBuffer>& buffer : buffers) {
+				active.push_back(buffer.get());
+			}
+		}
+
+		batch.clear();
+		wrote = false;
+		tails.resize(active.size());
+		bool progressed = false;
+		for (size_t i = 0; i < active.size(); ++i) {
+			ThreadBuffer& buffer = *active[i];
+			const size_t head = buffer.head.load(std::memory_order_acquire);
+			size_t tail = buffer.tail.load(std::memory_order_relaxed);
+			progressed |= tail != head;
+			while (tail != head) {
+				const uint8_t* record = buffer.data.get() + (tail & buffer.mask);
+				uint32_t size;
+				std::memcpy(&size, record, 4);
+				if (record[4] == static_cast<uint8_t>(StructuredRecord::Message)) {
+					AppendRecord(batch, record, size);
+					if (batch.size() >= batchLimit) {
+						file.Write(batch.data(), batch.size());
+						batch.clear();
+						wrote = true;
+					}
+				}
+				tail += size;
+			}
+			tails[i] = tail;
+		}
+
+		const uint64_t drops = dropped.load(std::memory_order_relaxed);
+		if (drops != reportedDrops) {
+			alignas(8) uint8_t record[kStructuredLogHeaderBytes + 16] = {};
+			const uint32_t size = sizeof(record);
+			const uint64_t formatId = LogFormatId(kDroppedFormat);
+			const int64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+			const uint64_t count = drops - reportedDrops;
+			std::memcpy(record, &size, 4);
+			record[4] = static_cast<uint8_t>(StructuredRecord::Message);
+			record[5] = static_cast<uint8_t>(Logger::LogLevel::Warning);
+			record[6] = 1;
+			std::memcpy(record + 8, &formatId, 8);
+			std::memcpy(record + 16, &time, 8);
+			record[kStructuredLogHeaderBytes] = static_cast<uint8_t>(StructuredArgument::Unsigned);
+			std::memcpy(record + kStructuredLogHeaderBytes + 1, &count, 8);
+			AppendRecord(batch, record, size);
+			reportedDrops = drops;
+		}
+
+		if (!batch.empty() || wrote) {
+			// One write and one flush for everything the threads logged since the last pass
+			file.Write(batch.data(), batch.size());
+			file.Flush();
+		}
+		// Space is handed back only once its messages are written, Flush relies on that
+		for (size_t i = 0; i < active.size(); ++i) {
+			active[i]->tail.store(tails[i], std::memory_order_release);
+		}
+
+		if (!progressed && batch.empty() && !wrote) {
+			if (stop) {
+				return;
+			}
+			std::this_thread::sleep_for(settings.idleWait);
+		}
+	}
+}
+
+void StructuredLogger::Flush() {
+	std::vector<std::pair<ThreadBuffer*, size_t>> targets;
+	{
+		std::lock_guard<std::mutex> guard(buffersLock);
+		for (const std::unique_ptr<ThreadBuffer>& buffer : buffers) {
+			targets.emplace_back(buffer.get(), buffer->head.load(std::memory_order_acquire));
+		}
+	}
+	for (const auto& target : targets) {
+		while (target.first->tail.load(std::memory_order_acquire) < target.second) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void StructuredLogger::SetLevel(Logger::LogLevel minimum) {
+	level.store(minimum, std::memory_order_relaxed);
+}
+
+uint64_t StructuredLogger::GetDroppedCount() const {
+	return dropped.load(std::memory_order_relaxed);
+}
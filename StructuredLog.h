@@ -0,0 +1,214 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "LogFile.h"
+#include "Logger.h"
+
+// Binary log layout. Every record starts with its size and kind and is padded to 8 bytes.
+//   File:    "SLG1" magic, version, then records
+//   Message: size u32, kind u8, level u8, argument count u8, pad u8, format id u64, system_clock ns i64, arguments
+//   Define:  size u32, kind u8, pad[3], format id u64, text length u32, text
+//   Argument: tag u8, then 8 bytes for numbers or a u32 length and the bytes for strings
+static constexpr uint32_t kStructuredLogMagic = 0x31474C53; // "SLG1"
+static constexpr uint32_t kStructuredLogVersion = 2;    // 2: Trace and Debug levels, Info moved to 2
+static constexpr size_t kStructuredLogHeaderBytes = 24;
+
+enum class StructuredRecord : uint8_t {
+	Message,
+	Define,     // Format text for an id, written before the first message that uses it
+	Padding,    // Fills the end of a thread buffer, never written out
+};
+
+enum class StructuredArgument : uint8_t {
+	Signed,
+	Unsigned,
+	Float,
+	String,
+};
+
+// 64-bit FNV-1a, evaluated at compile time for format literals
+constexpr uint64_t LogFormatId(const char* format) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (; *format != '\0'; ++format) {
+		hash = (hash ^ static_cast<uint8_t>(*format)) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Make format known to writers and returns true. Called once per call site through LOG_STRUCTURED.
+bool RegisterLogFormat(uint64_t id, const char* format);
+// nullptr for an id nobody registered
+const char* FindLogFormat(uint64_t id);
+
+// Append "<date time.ms> [LEVEL] <format with each {} replaced by the next argument>". False when the arguments are
+// damaged, the line is then only partly appended.
+bool FormatLogLine(std::string& out, int64_t timeNs, uint8_t level, const char* format, const uint8_t* arguments, size_t argumentBytes, uint32_t argumentCount);
+
+struct StructuredLoggerSettings {
+	size_t threadBufferBytes = 64 * 1024;                          // Per logging thread, rounded up to a power of two
+	Logger::OverflowPolicy overflow = Logger::OverflowPolicy::Block;
+	bool text = false;                                             // Format in the writer thread and write text lines
+	std::chrono::milliseconds idleWait{ 2 };                       // How long the writer sleeps when there is nothing to write
+	LogFileSettings file;                                          // Rotation and memory mapping, a rotated binary file repeats the header and formats
+};
+
+// Deferred formatting: a message is its format id and raw arguments, copied into a buffer owned by the calling thread.
+// A writer thread collects the buffers and writes them out as a binary stream for LogDecoder, or as text when asked to.
+// Nothing is formatted and nothing is shared between logging threads on the calling side.
+class StructuredLogger {
+public:
+	// Throws when the file cannot be opened, like Logger
+	StructuredLogger(const std::string& filename, const StructuredLoggerSettings& settings = StructuredLoggerSettings());
+	~StructuredLogger();
+
+	// Use LOG_STRUCTURED, which registers the format of the call site
+	template <typename... Args>
+	void Write(Logger::LogLevel level, uint64_t formatId, const Args&... args);
+
+	// Wait until every message logged so far is written out
+	void Flush();
+	uint64_t GetDroppedCount() const;
+
+	// Messages below the runtime level are skipped before their arguments are evaluated, Info by default
+	void SetLevel(Logger::LogLevel level);
+	bool IsEnabled(Logger::LogLevel minimum) const { return minimum >= level.load(std::memory_order_relaxed); }
+
+private:
+	struct ThreadBuffer {
+		std::unique_ptr<uint8_t[]> data;
+		size_t mask = 0;
+		alignas(64) std::atomic<size_t> head{ 0 };     // Producer
+		alignas(64) std::atomic<size_t> tail{ 0 };     // Writer
+	};
+
+	template <typename T>
+	static size_t ArgumentSize(const T& value);
+	template <typename T>
+	static uint8_t* EncodeArgument(uint8_t* p, const T& value);
+
+	ThreadBuffer& GetThreadBuffer();
+	// Contiguous space for a record of size bytes, nullptr when it was dropped
+	uint8_t* Reserve(ThreadBuffer& buffer, size_t size);
+	void RunWriter();
+	void AppendRecord(std::string& batch, const uint8_t* record, uint32_t size);
+	static void AppendDefine(std::string& batch, uint64_t formatId, const char* format);
+	void WriteFileHeader(LogFile& target);
+
+	StructuredLoggerSettings settings;
+	std::atomic<Logger::LogLevel> level{ Logger::LogLevel::Info };
+	uint64_t loggerId;
+	LogFile file;
+	std::mutex buffersLock;
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+	std::unordered_map<std::thread::id, ThreadBuffer*> threadBuffers;
+	std::unordered_map<uint64_t, const char*> knownFormats;   // Writer only, ids seen so far
+	std::atomic<uint64_t> dropped{ 0 };
+	std::atomic<bool> stopping{ false };
+	std::thread writer;
+};
+
+// Process wide logger for library code such as TwoOLSystem, nullptr turns its messages off. Install it before and
+// remove it after the threads that log through it.
+void SetStructuredLog(StructuredLogger* logger);
+StructuredLogger* GetStructuredLog();
+
+// LOG_STRUCTURED(GetStructuredLog(), Logger::LogLevel::Info, "Loaded {} nodes in {} ms", count, ms);
+// Arguments are integers, enums, floating point numbers and strings. level has to be a constant: below
+// LOGGER_MIN_LEVEL the call compiles to nothing, otherwise nothing is evaluated when logger is nullptr or filters it.
+#define LOG_STRUCTURED(logger, level, format, ...) \
+	do { \
+		if constexpr (LOGGER_COMPILED_LEVEL(level)) { \
+			StructuredLogger* structuredLogger_ = (logger); \
+			if (structuredLogger_ != nullptr && structuredLogger_->IsEnabled(level)) { \
+				static constexpr uint64_t kFormatId_ = LogFormatId(format); \
+				static const bool kFormatRegistered_ = RegisterLogFormat(kFormatId_, format); \
+				(void)kFormatRegistered_; \
+				structuredLogger_->Write(level, kFormatId_, ##__VA_ARGS__); \
+			} \
+		} \
+	} while (0)
+
+// Library diagnostics through the process wide logger
+#define LOG_TRACE(format, ...) LOG_STRUCTURED(GetStructuredLog(), Logger::LogLevel::Trace, format, ##__VA_ARGS__)
+#define LOG_DEBUG(format, ...) LOG_STRUCTURED(GetStructuredLog(), Logger::LogLevel::Debug, format, ##__VA_ARGS__)
+
+template <typename T>
+size_t StructuredLogger::ArgumentSize(const T& value) {
+	if constexpr (std::is_convertible_v<const T&, std::string_view> && !std::is_arithmetic_v<T>) {
+		return 1 + 4 + std::string_view(value).size();
+	}
+	else {
+		return 1 + 8;
+	}
+}
+
+template <typename T>
+uint8_t* StructuredLogger::EncodeArgument(uint8_t* p, const T& value) {
+	if constexpr (std::is_convertible_v<const T&, std::string_view> && !std::is_arithmetic_v<T>) {
+		const std::string_view text(value);
+		const uint32_t length = static_cast<uint32_t>(text.size());
+		*p++ = static_cast<uint8_t>(StructuredArgument::String);
+		std::memcpy(p, &length, 4);
+		std::memcpy(p + 4, text.data(), length);
+		return p + 4 + length;
+	}
+	else if constexpr (std::is_floating_point_v<T>) {
+		const double number = static_cast<double>(value);
+		*p++ = static_cast<uint8_t>(StructuredArgument::Float);
+		std::memcpy(p, &number, 8);
+		return p + 8;
+	}
+	else if constexpr (std::is_enum_v<T>) {
+		return EncodeArgument(p, static_cast<std::underlying_type_t<T>>(value));
+	}
+	else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+		const int64_t number = value;
+		*p++ = static_cast<uint8_t>(StructuredArgument::Signed);
+		std::memcpy(p, &number, 8);
+		return p + 8;
+	}
+	else {
+		static_assert(std::is_integral_v<T>, "LOG_STRUCTURED takes integers, enums, floating point numbers and strings");
+		const uint64_t number = value;
+		*p++ = static_cast<uint8_t>(StructuredArgument::Unsigned);
+		std::memcpy(p, &number, 8);
+		return p + 8;
+	}
+}
+
+template <typename... Args>
+void StructuredLogger::Write(Logger::LogLevel level, uint64_t formatId, const Args&... args) {
+	static_assert(sizeof...(Args) < 256, "Too many arguments");
+	const int64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	const size_t size = (kStructuredLogHeaderBytes + (ArgumentSize(args) + ... + size_t(0)) + 7) & ~size_t(7);
+
+	ThreadBuffer& buffer = GetThreadBuffer();
+	uint8_t* record = Reserve(buffer, size);
+	if (record == nullptr) {
+		return;
+	}
+	const uint32_t recordSize = static_cast<uint32_t>(size);
+	std::memcpy(record, &recordSize, 4);
+	record[4] = static_cast<uint8_t>(StructuredRecord::Message);
+	record[5] = static_cast<uint8_t>(level);
+	record[6] = static_cast<uint8_t>(sizeof...(Args));
+	record[7] = 0;
+	std::memcpy(record + 8, &formatId, 8);
+	std::memcpy(record + 16, &time, 8);
+	uint8_t* p = record + kStructuredLogHeaderBytes;
+	((p = EncodeArgument(p, args)), ...);
+	(void)p;
+	buffer.head.store(buffer.head.load(std::memory_order_relaxed) + size, std::memory_order_release);
+}
@@ -0,0 +1,174 @@
+// ClockBankTest.cpp : Headless checks of ClockBank and StepForestGrowth.
+//
+// - Add returns consecutive indices, Remove moves the last clock into the hole and refuses an index out of range
+// - Advance moves every clock by its own scale, backwards when reversed and not at all when stopped
+// - StepForestGrowth grows every tree as far as fastForwardGrowth over its own clock's interval, whatever dt is used,
+//   and reversing a clock for as long as it ran forward returns its tree to the start
+//
+// Prints every failed check and exits with 1 if there was one.
+// Build next to the static library sources and link WickedEngine, e.g.
+//   g++ -O2 -std=c++20 -pthread -I.. ClockBankTest.cpp $(ls ../*.cpp | grep -v -e Example_ImGui -e FileManagerWin32) -lWickedEngine_Linux -o ClockBankTest
+
+#include "pch.h"
+#include "ClockBank.h"
+#include "TwoOLSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static int checkCount = 0;
+static int failureCount = 0;
+
+static void check(bool passed, const std::string& what) {
+	checkCount++;
+	if (!passed) {
+		failureCount++;
+		std::printf("FAILED: %s\n", what.c_str());
+	}
+}
+
+static const double timeTolerance = 1e-9;
+static const float sizeTolerance = 1e-5f;   // Float rounding of a handful of closed form jumps
+
+// Nodes of every growing type in two generations, stages spread over 0-20 s
+static std::vector<LSystemGeneration> makeTree() {
+	const NodeType types[] = { NodeType::Forward, NodeType::Branch, NodeType::Twig, NodeType::Leaf, NodeType::Decal };
+	std::vector<LSystemGeneration> generations(2);
+	uint32_t state = 777;
+	auto next = [&]() {
+		state = state * 1664525u + 1013904223u;
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+	int nextId = 0;
+	for (size_t generation = 0; generation < generations.size(); ++generation) {
+		for (int i = 0; i < 50; ++i) {
+			LSystemNode node{};
+			node.type = types[(nextId + generation) % 5];
+			node.parentid = nextId - 1;
+			node.nodeid = nextId++;
+			node.stage = 10.0f * (static_cast<float>(generation) + next());
+			node.length = 0.05f + 0.95f * next();
+			node.radius = 0.05f + 0.95f * next();
+			generations[generation].push_back(node);
+		}
+	}
+	return generations;
+}
+
+static float largestDifference(const std::vector<LSystemGeneration>& a, const std::vector<LSystemGeneration>& b) {
+	const std::vector<const LSystemNode*> nodesA = flattenGenerations(a);
+	const std::vector<const LSystemNode*> nodesB = flattenGenerations(b);
+	float largest = 0.0f;
+	for (size_t i = 0; i < nodesA.size(); ++i) {
+		largest = std::max(largest, std::abs(nodesA[i]->length - nodesB[i]->length));
+		largest = std::max(largest, std::abs(nodesA[i]->radius - nodesB[i]->radius));
+	}
+	return largest;
+}
+
+static void checkAddRemove() {
+	ClockBank clocks;
+	check(clocks.Remove(0) == UINT32_MAX && clocks.GetCount() == 0, "removing from an empty bank is refused");
+	for (uint32_t i = 0; i < 4; ++i) {
+		check(clocks.Add(static_cast<double>(i)) == i, "clock " + std::to_string(i) + " gets the next index");
+	}
+	check(clocks.Remove(4) == UINT32_MAX && clocks.GetCount() == 4, "removing past the end is refused");
+
+	check(clocks.Remove(1) == 3 && clocks.GetCount() == 3, "removing reports the index of the moved clock");
+	check(clocks.GetTimes()[1] == 3.0, "the last clock moves into the removed one's place");
+	check(clocks.Remove(2) == 2 && clocks.GetCount() == 2, "removing the last clock moves nothing");
+
+	clocks.Clear();
+	check(clocks.GetCount() == 0, "Clear removes every clock");
+}
+
+static void checkAdvance() {
+	ClockBank clocks;
+	const uint32_t forward = clocks.Add(1.0, 2.0);
+	const uint32_t reversed = clocks.Add(1.0, 0.5);
+	const uint32_t stopped = clocks.Add(1.0, 3.0, false);
+	clocks.SetReversed(reversed, true);
+	check(clocks.IsReversed(reversed) && !clocks.IsRunning(stopped) && clocks.IsRunning(forward), "flags read back");
+
+	clocks.Advance(0.25);
+	check(std::abs(clocks.GetTimes()[forward] - 1.5) <= timeTolerance && std::abs(clocks.GetDeltas()[forward] - 0.5) <= timeTolerance, "a running clock moves by its scale");
+	check(std::abs(clocks.GetTimes()[reversed] - 0.875) <= timeTolerance && std::abs(clocks.GetDeltas()[reversed] + 0.125) <= timeTolerance, "a reversed clock moves backwards");
+	check(clocks.GetTimes()[stopped] == 1.0 && clocks.GetDeltas()[stopped] == 0.0, "a stopped clock stays");
+
+	// Speed and state changes take effect on the next Advance
+	clocks.SetRunning(stopped, true);
+	clocks.SetScale(forward, 1.0);
+	clocks.SetReversed(reversed, false);
+	clocks.SetTime(reversed, 0.0);
+	clocks.Advance(1.0);
+	check(std::abs(clocks.GetTimes()[stopped] - 4.0) <= timeTolerance, "a restarted clock runs at its scale");
+	check(std::abs(clocks.GetTimes()[forward] - 2.5) <= timeTolerance, "a new scale applies");
+	check(std::abs(clocks.GetTimes()[reversed] - 0.5) <= timeTolerance, "a clock runs forward again from the time it was set to");
+}
+
+static void checkForest() {
+	const std::vector<LSystemGeneration> tree = makeTree();
+	const double scales[] = { 0.5, 1.0, 2.0, 7.5 };
+	const size_t treeCount = std::size(scales);
+	const double duration = 4.0;
+
+	// The same bank stepped with a frame time and with a single jump
+	ClockBank stepped;
+	ClockBank jumped;
+	std::vector<std::vector<LSystemGeneration>> steppedForest(treeCount, tree);
+	std::vector<std::vector<LSystemGeneration>> jumpedForest(treeCount, tree);
+	for (double scale : scales) {
+		stepped.Add(0.0, scale);
+		jumped.Add(0.0, scale);
+	}
+	const int frames = 240;
+	for (int frame = 0; frame < frames; ++frame) {
+		StepForestGrowth(stepped, steppedForest, duration / frames);
+	}
+	StepForestGrowth(jumped, jumpedForest, duration);
+
+	for (size_t i = 0; i < treeCount; ++i) {
+		const std::string which = "tree at scale " + std::to_string(scales[i]);
+		std::vector<LSystemGeneration> expected = tree;
+		fastForwardGrowth(expected, 0.0, scales[i] * duration);
+		check(std::abs(stepped.GetTimes()[i] - scales[i] * duration) <= timeTolerance, which + " clock reaches scale * time");
+		check(largestDifference(steppedForest[i], expected) <= sizeTolerance, which + " grows as far as one jump over its interval");
+		check(largestDifference(jumpedForest[i], expected) <= sizeTolerance, which + " grows the same in one long frame");
+		check(largestDifference(steppedForest[i], tree) > 0.0f, which + " grew");
+	}
+
+	// Reversed for as long as they ran forward, every tree returns to the start
+	for (uint32_t i = 0; i < treeCount; ++i) {
+		stepped.SetReversed(i, true);
+	}
+	for (int frame = 0; frame < frames; ++frame) {
+		StepForestGrowth(stepped, steppedForest, duration / frames);
+	}
+	for (size_t i = 0; i < treeCount; ++i) {
+		check(std::abs(stepped.GetTimes()[i]) <= timeTolerance, "reversed clock " + std::to_string(i) + " returns to 0 s");
+		check(largestDifference(steppedForest[i], tree) <= sizeTolerance, "reversed tree " + std::to_string(i) + " returns to its start");
+	}
+
+	// Stopped clocks leave their trees alone, a forest shorter than the bank is only stepped as far as it goes
+	ClockBank partial;
+	partial.Add(0.0, 1.0, false);
+	partial.Add(0.0, 1.0);
+	partial.Add(0.0, 1.0);
+	std::vector<std::vector<LSystemGeneration>> shortForest(2, tree);
+	StepForestGrowth(partial, shortForest, duration);
+	check(largestDifference(shortForest[0], tree) == 0.0f, "a stopped clock's tree does not grow");
+	check(largestDifference(shortForest[1], tree) > 0.0f, "a running clock's tree grows next to a stopped one");
+}
+
+int main() {
+	checkAddRemove();
+	checkAdvance();
+	checkForest();
+
+	std::printf("%d checks, %d failed\n", checkCount, failureCount);
+	return failureCount > 0 ? 1 : 0;
+}
@@ -0,0 +1,155 @@
+// GrowthFastForwardTest.cpp : Headless checks of fastForwardGrowth against many small stepGrowth steps.
+//
+// A tree of every node type with stages spread over the checked intervals is grown both ways:
+// - forward, backward and from the middle of the stage range, small steps and the closed form agree to within one step
+//   of the fastest growth rate plus the float rounding of the steps, shrinking clamps at zero the same way
+// - one jump equals two jumps over the same interval, and jumping back undoes a jump that did not clamp
+// - nodes born after the interval keep their size, a zero duration changes nothing
+//
+// Prints every failed check and the largest error per interval, exits with 1 if a check failed.
+// Build next to the static library sources and link WickedEngine, e.g.
+//   g++ -O2 -std=c++20 -pthread -I.. GrowthFastForwardTest.cpp $(ls ../*.cpp | grep -v -e Example_ImGui -e FileManagerWin32) -lWickedEngine_Linux -o GrowthFastForwardTest
+
+#include "pch.h"
+#include "TwoOLSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static int checkCount = 0;
+static int failureCount = 0;
+
+static void check(bool passed, const std::string& what) {
+	checkCount++;
+	if (!passed) {
+		failureCount++;
+		std::printf("FAILED: %s\n", what.c_str());
+	}
+}
+
+static const double fineStep = 0.001;      // Reference step, seconds
+static const double fastestRate = 0.1;     // Forward nodes, the most a node can be off by per reference step
+static const float exactTolerance = 1e-5f; // Float rounding of a handful of additions
+
+// Nodes of every growing type in a few generations, stages spread over 0-40 s, sizes 0.05-1
+static std::vector<LSystemGeneration> makeTree() {
+	const NodeType types[] = { NodeType::Forward, NodeType::Branch, NodeType::Twig, NodeType::Leaf, NodeType::Decal };
+	std::vector<LSystemGeneration> generations(4);
+	uint32_t state = 12345;
+	auto next = [&]() {
+		state = state * 1664525u + 1013904223u;
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+	int nextId = 0;
+	for (size_t generation = 0; generation < generations.size(); ++generation) {
+		for (int i = 0; i < 500; ++i) {
+			LSystemNode node{};
+			node.type = types[(nextId + generation) % 5];
+			node.parentid = nextId - 1;
+			node.nodeid = nextId++;
+			node.stage = 10.0f * (static_cast<float>(generation) + next());
+			node.length = 0.05f + 0.95f * next();
+			node.radius = 0.05f + 0.95f * next();
+			generations[generation].push_back(node);
+		}
+	}
+	return generations;
+}
+
+// The way GrowthScheduler steps: a step's time is its lower end in either direction
+static void stepThrough(std::vector<LSystemGeneration>& generations, double time, double duration) {
+	const double dt = duration < 0.0 ? -fineStep : fineStep;
+	const int64_t steps = static_cast<int64_t>(std::llround(std::abs(duration) / fineStep));
+	for (int64_t i = 0; i < steps; ++i) {
+		stepGrowth(generations, dt > 0.0 ? time : time + dt, dt);
+		time += dt;
+	}
+}
+
+static float largestDifference(const std::vector<LSystemGeneration>& a, const std::vector<LSystemGeneration>& b) {
+	const std::vector<const LSystemNode*> nodesA = flattenGenerations(a);
+	const std::vector<const LSystemNode*> nodesB = flattenGenerations(b);
+	float largest = 0.0f;
+	for (size_t i = 0; i < nodesA.size(); ++i) {
+		largest = std::max(largest, std::abs(nodesA[i]->length - nodesB[i]->length));
+		largest = std::max(largest, std::abs(nodesA[i]->radius - nodesB[i]->radius));
+	}
+	return largest;
+}
+
+static std::string interval(double time, double duration) {
+	return std::to_string(time) + " s by " + std::to_string(duration) + " s";
+}
+
+// Closed form against the small steps it stands in for
+static void checkAgainstSteps(const std::vector<LSystemGeneration>& start, double time, double duration) {
+	std::vector<LSystemGeneration> stepped = start;
+	stepThrough(stepped, time, duration);
+	std::vector<LSystemGeneration> jumped = start;
+	fastForwardGrowth(jumped, time, duration);
+
+	// A stage falls somewhere inside one reference step, and every step rounds the sum to float once
+	float largest = 0.0f;
+	for (const LSystemNode* node : flattenGenerations(stepped)) {
+		largest = std::max({ largest, node->length, node->radius });
+	}
+	const double steps = std::round(std::abs(duration) / fineStep);
+	const float error = largestDifference(stepped, jumped);
+	const float tolerance = static_cast<float>(fastestRate * fineStep + steps * 0.5 * (std::nextafter(largest, 2.0f * largest + 1.0f) - largest));
+	std::printf("%-40s largest error %.2e (tolerance %.2e)\n", interval(time, duration).c_str(), error, tolerance);
+	check(error <= tolerance, "closed form matches small steps from " + interval(time, duration));
+}
+
+int main() {
+	const std::vector<LSystemGeneration> tree = makeTree();
+
+	// Every stage inside the interval, then both ends inside the stage range
+	checkAgainstSteps(tree, 0.0, 50.0);
+	checkAgainstSteps(tree, 15.0, 10.0);
+
+	// Shrinking a grown tree part of the way, then the initial tree from 50 s so most nodes clamp at zero
+	std::vector<LSystemGeneration> grown = tree;
+	fastForwardGrowth(grown, 0.0, 50.0);
+	checkAgainstSteps(grown, 50.0, -30.0);
+	checkAgainstSteps(tree, 50.0, -50.0);
+	std::vector<LSystemGeneration> shrunk = tree;
+	fastForwardGrowth(shrunk, 50.0, -50.0);
+	bool clamped = false;
+	bool negative = false;
+	for (const LSystemNode* node : flattenGenerations(shrunk)) {
+		clamped = clamped || node->length == 0.0f || node->radius == 0.0f;
+		negative = negative || node->length < 0.0f || node->radius < 0.0f;
+	}
+	check(clamped, "shrinking from 50 s to 0 s clamps some nodes");
+	check(!negative, "shrinking never goes below zero");
+
+	// One jump equals two, and a jump that did not clamp is undone by jumping back
+	std::vector<LSystemGeneration> split = tree;
+	fastForwardGrowth(split, 0.0, 20.0);
+	fastForwardGrowth(split, 20.0, 30.0);
+	check(largestDifference(split, grown) <= exactTolerance, "jumping 0-20 s and 20-50 s equals jumping 0-50 s");
+	std::vector<LSystemGeneration> roundTrip = tree;
+	fastForwardGrowth(roundTrip, 10.0, 25.0);
+	fastForwardGrowth(roundTrip, 35.0, -25.0);
+	check(largestDifference(roundTrip, tree) <= exactTolerance, "jumping 10-35 s and back restores the tree");
+
+	// Outside the stage range the closed form is a single step, before it nothing grows
+	std::vector<LSystemGeneration> late = tree;
+	fastForwardGrowth(late, 40.0, 15.0);
+	std::vector<LSystemGeneration> single = tree;
+	stepGrowth(single, 40.0, 15.0);
+	check(largestDifference(late, single) <= exactTolerance, "after every stage one jump equals one step");
+	std::vector<LSystemGeneration> early = tree;
+	fastForwardGrowth(early, -20.0, 20.0);
+	check(largestDifference(early, tree) == 0.0f, "nodes born after the interval keep their size");
+	std::vector<LSystemGeneration> still = tree;
+	fastForwardGrowth(still, 25.0, 0.0);
+	check(largestDifference(still, tree) == 0.0f, "a zero duration changes nothing");
+
+	std::printf("%d checks, %d failed\n", checkCount, failureCount);
+	return failureCount > 0 ? 1 : 0;
+}
@@ -0,0 +1,218 @@
+// TreeBatchTest.cpp : Headless checks of RangeAllocator and TreeBatch.
+//
+// - RangeAllocator hands out ranges first fit, merges released ranges with free neighbours on either side and grows
+//   into a free block that ends at the old capacity
+// - GetHighWater drops when the last range is released and stays when a range below it is
+// - inserts report their vertex and index ranges as changed, removals only their index ranges, now degenerate
+// - a removed tree's ranges are reused by the next insert that fits, HasCapacityChanged only reports actual growth
+//
+// Prints every failed check and exits with 1 if there was one.
+// Build next to the static library sources and link WickedEngine, e.g.
+//   g++ -O2 -std=c++20 -pthread -I.. TreeBatchTest.cpp $(ls ../*.cpp | grep -v -e Example_ImGui -e FileManagerWin32) -lWickedEngine_Linux -o TreeBatchTest
+
+#include "pch.h"
+#include "TwoOLSystem.h"
+#include "TreeMesh.h"
+#include "TreeBatch.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+static int checkCount = 0;
+static int failureCount = 0;
+
+static void check(bool passed, const std::string& what) {
+	checkCount++;
+	if (!passed) {
+		failureCount++;
+		std::printf("FAILED: %s\n", what.c_str());
+	}
+}
+
+// Trunk of two nodes, one branch and a leaf, enough for a bark and a foliage subset
+static std::vector<LSystemGeneration> makeTree() {
+	std::vector<LSystemGeneration> generations(3);
+	int nextId = 0;
+	auto add = [&](size_t generation, int parent, XMFLOAT3 position, XMVECTOR rotation, float length, float radius, NodeType type) {
+		LSystemNode node{};
+		node.type = type;
+		node.parentid = parent;
+		node.nodeid = nextId++;
+		node.stage = static_cast<float>(generation);
+		node.length = length;
+		node.radius = radius;
+		node.position = position;
+		XMStoreFloat4(&node.rotation, rotation);
+		generations[generation].push_back(node);
+		XMFLOAT3 end;
+		XMStoreFloat3(&end, NodeEnd(node));
+		return std::make_pair(node.nodeid, end);
+	};
+
+	auto trunk = add(0, -1, XMFLOAT3(0, 0, 0), XMQuaternionIdentity(), 2.0f, 0.3f, NodeType::Forward);
+	trunk = add(0, trunk.first, trunk.second, XMQuaternionIdentity(), 2.0f, 0.25f, NodeType::Forward);
+	const XMVECTOR rotation = XMQuaternionRotationRollPitchYaw(0.8f, 0.0f, 0.3f);
+	auto branch = add(1, trunk.first, trunk.second, rotation, 1.2f, 0.12f, NodeType::Branch);
+	add(2, branch.first, branch.second, rotation, 0.3f, 0.05f, NodeType::Leaf);
+	return generations;
+}
+
+static bool sameRange(const TreeBatchRange& a, const TreeBatchRange& b) {
+	return a.offset == b.offset && a.count == b.count;
+}
+
+static bool onlyRange(const std::vector<TreeBatchRange>& ranges, const TreeBatchRange& range) {
+	return ranges.size() == 1 && sameRange(ranges[0], range);
+}
+
+static void checkAllocator() {
+	RangeAllocator allocator;
+	allocator.Reset(100);
+	uint32_t a = 0, b = 0, c = 0, d = 0;
+	check(allocator.Allocate(10, a) && allocator.Allocate(10, b) && allocator.Allocate(10, c) && allocator.Allocate(10, d), "four ranges fit");
+	check(a == 0 && b == 10 && c == 20 && d == 30, "ranges are handed out back to back");
+	check(allocator.GetUsed() == 40 && allocator.GetHighWater() == 40 && allocator.GetFreeBlockCount() == 1, "used, high water and free blocks follow allocation");
+
+	// Holes on both sides of b, then b joins them into one
+	allocator.Release(a, 10);
+	allocator.Release(c, 10);
+	check(allocator.GetFreeBlockCount() == 3, "two separate holes and the tail are three free blocks");
+	allocator.Release(b, 10);
+	check(allocator.GetFreeBlockCount() == 2, "a range between two holes merges with both");
+	allocator.Release(d, 10);
+	check(allocator.GetFreeBlockCount() == 1 && allocator.GetUsed() == 0, "a range between a hole and the tail merges everything");
+
+	// Merging with only the previous or only the next block
+	check(allocator.Allocate(10, a) && allocator.Allocate(10, b) && allocator.Allocate(10, c) && allocator.Allocate(10, d), "the merged block is reused");
+	allocator.Release(a, 10);
+	allocator.Release(b, 10);
+	check(allocator.GetFreeBlockCount() == 2, "a range after a hole merges with it");
+	allocator.Release(d, 10);
+	allocator.Release(c, 10);
+	check(allocator.GetFreeBlockCount() == 1, "a range before the merged tail merges with it");
+
+	// First fit: a hole too small is skipped, the next allocation that fits takes it
+	allocator.Reset(100);
+	check(allocator.Allocate(10, a) && allocator.Allocate(20, b) && allocator.Allocate(30, c), "three ranges fit");
+	allocator.Release(b, 20);
+	uint32_t large = 0, small = 0, rest = 0;
+	check(allocator.Allocate(25, large) && large == 60, "a range larger than the hole goes after the last range");
+	check(allocator.Allocate(15, small) && small == 10, "the first hole large enough is used");
+	check(allocator.Allocate(5, rest) && rest == 25, "the rest of the hole is used next");
+	check(allocator.GetFreeBlockCount() == 1, "a hole filled exactly disappears");
+
+	// Growing extends a free tail instead of adding a block
+	allocator.Reset(10);
+	check(!allocator.Allocate(11, a), "a range larger than the capacity does not fit");
+	allocator.Grow(20);
+	check(allocator.GetFreeBlockCount() == 1 && allocator.Allocate(11, a) && a == 0, "growing extends the free tail");
+	allocator.Grow(30);
+	check(allocator.GetFreeBlockCount() == 1 && allocator.GetCapacity() == 30, "growing after an allocation extends the remaining tail");
+
+	// High water follows removal of the last range only
+	allocator.Reset(100);
+	check(allocator.Allocate(10, a) && allocator.Allocate(10, b) && allocator.Allocate(10, c), "three ranges fit again");
+	allocator.Release(b, 10);
+	check(allocator.GetHighWater() == 30, "releasing a middle range keeps the high water mark");
+	allocator.Release(c, 10);
+	check(allocator.GetHighWater() == 10, "releasing the last range drops the high water mark past the hole below it");
+	allocator.Release(a, 10);
+	check(allocator.GetHighWater() == 0, "an empty allocator has no high water mark");
+}
+
+static void checkBatch() {
+	TreeMeshData mesh;
+	GenerateMesh(makeTree(), TreeMeshSettings(), mesh);
+	WeldVertices(mesh);
+
+	TreeBatch batch;
+	std::vector<uint32_t> handles;
+	for (int i = 0; i < 3; ++i) {
+		handles.push_back(batch.Insert(mesh, XMMatrixTranslation(10.0f * static_cast<float>(i), 0.0f, 0.0f)));
+	}
+	check(batch.GetTreeCount() == 3 && batch.IsDirty() && batch.HasCapacityChanged(), "the first inserts size the arrays");
+
+	bool insertsReported = batch.GetChangedVertices().size() == 3 && batch.GetChangedBarkIndices().size() == 3 && batch.GetChangedFoliageIndices().size() == 3;
+	bool indicesInside = true;
+	for (size_t i = 0; insertsReported && i < handles.size(); ++i) {
+		const TreeBatchSlot* slot = batch.GetTree(handles[i]);
+		if (slot == nullptr) {
+			insertsReported = false;
+			break;
+		}
+		insertsReported = sameRange(batch.GetChangedVertices()[i], slot->vertices)
+			&& sameRange(batch.GetChangedBarkIndices()[i], slot->barkIndices) && sameRange(batch.GetChangedFoliageIndices()[i], slot->foliageIndices);
+		for (uint32_t k = slot->barkIndices.offset; k < slot->barkIndices.offset + slot->barkIndices.count; ++k) {
+			indicesInside = indicesInside && batch.barkIndices[k] >= slot->vertices.offset && batch.barkIndices[k] < slot->vertices.offset + slot->vertices.count;
+		}
+	}
+	check(insertsReported, "each insert reports its vertex, bark and foliage ranges");
+	check(indicesInside, "each tree's indices point into its own vertices");
+	const TreeBatchSlot* first = batch.GetTree(handles[0]);
+	check(first->foliageIndices.count > 0 && first->barkIndices.count > 0, "the test tree has bark and foliage");
+
+	batch.ClearChanges();
+	check(!batch.IsDirty() && !batch.HasCapacityChanged() && batch.GetChangedVertices().empty() && batch.GetChangedBarkIndices().empty() && batch.GetChangedFoliageIndices().empty(), "ClearChanges forgets every change");
+
+	// Removing the middle tree rewrites its index ranges only, and leaves the high water marks where they are
+	const TreeBatchSlot removed = *batch.GetTree(handles[1]);
+	const uint32_t barkCount = batch.GetBarkIndexCount();
+	const uint32_t foliageCount = batch.GetFoliageIndexCount();
+	check(batch.Remove(handles[1]) && !batch.Remove(handles[1]) && batch.GetTree(handles[1]) == nullptr, "a tree is removed once");
+	check(batch.GetChangedVertices().empty(), "a removal changes no vertices");
+	check(onlyRange(batch.GetChangedBarkIndices(), removed.barkIndices) && onlyRange(batch.GetChangedFoliageIndices(), removed.foliageIndices), "a removal reports its index ranges");
+	bool degenerate = true;
+	for (uint32_t k = removed.barkIndices.offset; k < removed.barkIndices.offset + removed.barkIndices.count; ++k) {
+		degenerate = degenerate && batch.barkIndices[k] == 0;
+	}
+	check(degenerate, "removed indices are degenerate");
+	check(batch.GetBarkIndexCount() == barkCount && batch.GetFoliageIndexCount() == foliageCount, "removing a middle tree keeps the high water marks");
+	check(!batch.HasCapacityChanged(), "a removal does not change capacity");
+
+	// The same mesh fits the hole exactly
+	batch.ClearChanges();
+	handles[1] = batch.Insert(mesh, XMMatrixTranslation(0.0f, 0.0f, 10.0f));
+	const TreeBatchSlot* reused = batch.GetTree(handles[1]);
+	check(reused->vertices.offset == removed.vertices.offset && reused->barkIndices.offset == removed.barkIndices.offset && reused->foliageIndices.offset == removed.foliageIndices.offset, "an insert reuses the hole first fit");
+	check(onlyRange(batch.GetChangedVertices(), reused->vertices) && onlyRange(batch.GetChangedBarkIndices(), reused->barkIndices) && onlyRange(batch.GetChangedFoliageIndices(), reused->foliageIndices), "a reusing insert reports its ranges");
+	check(!batch.HasCapacityChanged(), "an insert into a hole does not change capacity");
+
+	// Removing the last tree drops the high water marks to the end of the tree before it
+	batch.ClearChanges();
+	check(batch.Remove(handles[2]), "the last tree is removed");
+	check(batch.GetBarkIndexCount() == reused->barkIndices.offset + reused->barkIndices.count, "removing the last tree drops the bark high water mark");
+	check(batch.GetFoliageIndexCount() == reused->foliageIndices.offset + reused->foliageIndices.count, "removing the last tree drops the foliage high water mark");
+	check(batch.GetVertexAllocator().GetHighWater() == reused->vertices.offset + reused->vertices.count, "removing the last tree drops the vertex high water mark");
+
+	// Past the first capacity of any pool the arrays grow and say so
+	batch.ClearChanges();
+	const uint32_t vertexCapacity = batch.GetVertexAllocator().GetCapacity();
+	const size_t barkCapacity = batch.barkIndices.size();
+	const size_t foliageCapacity = batch.foliageIndices.size();
+	uint32_t inserts = 0;
+	bool unchangedWhileFitting = true;
+	while (batch.GetVertexAllocator().GetCapacity() == vertexCapacity && batch.barkIndices.size() == barkCapacity && batch.foliageIndices.size() == foliageCapacity) {
+		unchangedWhileFitting = unchangedWhileFitting && !batch.HasCapacityChanged();
+		batch.Insert(mesh, XMMatrixIdentity());
+		inserts++;
+	}
+	check(unchangedWhileFitting, "capacity is unchanged while inserts fit");
+	check(batch.HasCapacityChanged(), "growing an array is reported");
+	check(batch.vertex_positions.size() == batch.GetVertexAllocator().GetCapacity() && batch.vertex_normals.size() == batch.vertex_positions.size(), "vertex arrays follow the capacity");
+	check(batch.barkIndices.size() >= batch.GetBarkIndexCount() && batch.foliageIndices.size() >= batch.GetFoliageIndexCount(), "index arrays hold every index");
+	check(batch.GetTreeCount() == 2 + inserts, "every insert is counted");
+	batch.ClearChanges();
+	check(!batch.HasCapacityChanged(), "ClearChanges forgets the growth");
+}
+
+int main() {
+	checkAllocator();
+	checkBatch();
+
+	std::printf("%d checks, %d failed\n", checkCount, failureCount);
+	return failureCount > 0 ? 1 : 0;
+}
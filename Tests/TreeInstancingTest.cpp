@@ -0,0 +1,170 @@
+// TreeInstancingTest.cpp : Headless checks of PackQuaternion, BuildSegmentInstances and UpdateSegmentInstances.
+//
+// - packed quaternions come back within the angle the 10 bit components allow, q and -q pack the same
+// - every node becomes one instance in flat order with its own position, size, stage and type, a zero rotation is identity
+// - SegmentInstanceMatrix puts the unit cylinder's tip on the node's end
+// - growth reports exactly the instances whose length or radius changed, a changed node count rebuilds and lists them all
+//
+// Prints every failed check and exits with 1 if there was one.
+// Build next to the static library sources and link WickedEngine, e.g.
+//   g++ -O2 -std=c++20 -pthread -I.. TreeInstancingTest.cpp $(ls ../*.cpp | grep -v -e Example_ImGui -e FileManagerWin32) -lWickedEngine_Linux -o TreeInstancingTest
+
+#include "pch.h"
+#include "TwoOLSystem.h"
+#include "TreeMesh.h"
+#include "TreeInstancing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+static int checkCount = 0;
+static int failureCount = 0;
+
+static void check(bool passed, const std::string& what) {
+	checkCount++;
+	if (!passed) {
+		failureCount++;
+		std::printf("FAILED: %s\n", what.c_str());
+	}
+}
+
+// Three components of up to 0.7071 in 10 bits each, half a step of error on each, the largest one follows from them
+static const float maxPackedAngle = 0.005f;
+
+static float RotationAngle(FXMVECTOR a, FXMVECTOR b) {
+	const float dot = std::min(std::abs(XMVectorGetX(XMVector4Dot(a, b))), 1.0f);
+	return 2.0f * acosf(dot);
+}
+
+// Trunk chain with two forks of two nodes and a leaf on each, the first node has no rotation set at all
+static std::vector<LSystemGeneration> makeTree() {
+	std::vector<LSystemGeneration> generations(3);
+	int nextId = 0;
+	auto add = [&](size_t generation, int parent, XMFLOAT3 position, XMVECTOR rotation, float length, float radius, NodeType type) {
+		LSystemNode node{};
+		node.type = type;
+		node.parentid = parent;
+		node.nodeid = nextId++;
+		node.stage = static_cast<float>(generation) + 0.25f * static_cast<float>(node.nodeid);
+		node.length = length;
+		node.radius = radius;
+		node.position = position;
+		XMStoreFloat4(&node.rotation, rotation);
+		generations[generation].push_back(node);
+		XMFLOAT3 end;
+		XMStoreFloat3(&end, NodeEnd(node));
+		return std::make_pair(node.nodeid, end);
+	};
+
+	auto trunk = add(0, -1, XMFLOAT3(0, 0, 0), XMVectorZero(), 2.0f, 0.3f, NodeType::Forward);
+	trunk = add(0, trunk.first, trunk.second, XMQuaternionIdentity(), 2.0f, 0.25f, NodeType::Forward);
+	for (int fork = 0; fork < 2; ++fork) {
+		const XMVECTOR rotation = XMQuaternionRotationRollPitchYaw(0.3f, fork == 0 ? 0.8f : -0.8f, fork == 0 ? 0.5f : -0.5f);
+		auto branch = add(1, trunk.first, trunk.second, rotation, 1.2f, 0.12f, NodeType::Branch);
+		branch = add(1, branch.first, branch.second, rotation, 1.0f, 0.1f, NodeType::Branch);
+		add(2, branch.first, branch.second, rotation, 0.3f, 0.05f, NodeType::Leaf);
+	}
+	return generations;
+}
+
+static void checkPacking() {
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> component(-1.0f, 1.0f);
+	float worst = 0.0f;
+	bool signsAgree = true;
+	for (int i = 0; i < 10000; ++i) {
+		XMVECTOR q = XMQuaternionNormalize(XMVectorSet(component(random), component(random), component(random), component(random)));
+		worst = std::max(worst, RotationAngle(q, UnpackQuaternion(PackQuaternion(q))));
+		signsAgree = signsAgree && PackQuaternion(q) == PackQuaternion(XMVectorNegate(q));
+	}
+	std::printf("Largest packed quaternion error %.5f rad\n", worst);
+	check(worst <= maxPackedAngle, "packed quaternions round trip within " + std::to_string(maxPackedAngle) + " rad");
+	check(signsAgree, "q and -q pack to the same bits");
+
+	// Each component in turn being the dropped one, and the two way tie of a 90 degree turn
+	const XMVECTOR special[] = {
+		XMQuaternionIdentity(), XMVectorSet(1, 0, 0, 0), XMVectorSet(0, 1, 0, 0), XMVectorSet(0, 0, 1, 0),
+		XMQuaternionRotationAxis(XMVectorSet(0, 1, 0, 0), XM_PIDIV2), XMVectorSet(0.5f, -0.5f, 0.5f, -0.5f),
+	};
+	for (size_t i = 0; i < std::size(special); ++i) {
+		check(RotationAngle(special[i], UnpackQuaternion(PackQuaternion(special[i]))) <= maxPackedAngle, "special quaternion " + std::to_string(i) + " round trips");
+	}
+}
+
+static void checkBuild(const std::vector<LSystemGeneration>& generations) {
+	const std::vector<const LSystemNode*> nodes = flattenGenerations(generations);
+	std::vector<SegmentInstance> instances;
+	BuildSegmentInstances(generations, instances);
+	check(instances.size() == nodes.size(), "one instance per node");
+	if (instances.size() != nodes.size()) {
+		return;
+	}
+
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		const LSystemNode& node = *nodes[i];
+		const SegmentInstance& instance = instances[i];
+		const std::string which = "instance " + std::to_string(i);
+		check(instance.position.x == node.position.x && instance.position.y == node.position.y && instance.position.z == node.position.z, which + " sits at its node");
+		check(instance.length == node.length && instance.radius == node.radius, which + " has its node's length and radius");
+		check(instance.stage == node.stage && instance.type == static_cast<uint32_t>(node.type), which + " keeps stage and type");
+
+		// The unit cylinder's tip lands on the node's end, its rim one radius off the axis
+		const XMMATRIX world = SegmentInstanceMatrix(instance);
+		const float tipError = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMVector3TransformCoord(XMVectorSet(0, 1, 0, 1), world), NodeEnd(node))));
+		check(tipError <= maxPackedAngle * node.length + 1e-5f, which + " reaches its node's end");
+		const XMVECTOR base = XMVector3TransformCoord(XMVectorZero(), world);
+		const float rim = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMVector3TransformCoord(XMVectorSet(1, 0, 0, 1), world), base)));
+		check(std::abs(rim - node.radius) <= 1e-4f, which + " is as thick as its node");
+	}
+	check(RotationAngle(UnpackQuaternion(instances[0].rotation), XMQuaternionIdentity()) <= maxPackedAngle, "a node without a rotation stands upright");
+}
+
+static void checkUpdate(const std::vector<LSystemGeneration>& generations) {
+	std::vector<SegmentInstance> instances;
+	BuildSegmentInstances(generations, instances);
+	std::vector<uint32_t> changed;
+	check(UpdateSegmentInstances(generations, instances, &changed) == 0 && changed.empty(), "nothing changes without growth");
+
+	// Grow two nodes and shrink one, nothing else may be reported
+	std::vector<LSystemGeneration> grown = generations;
+	grown[0][1].length += 0.5f;
+	grown[1][2].radius += 0.01f;
+	grown[2][1].length = 0.0f;
+	const std::vector<uint32_t> expected = { 1, 4, 7 };
+	changed.clear();
+	const size_t changedCount = UpdateSegmentInstances(grown, instances, &changed);
+	std::sort(changed.begin(), changed.end());
+	check(changedCount == expected.size() && changed == expected, "growth lists exactly the changed instances");
+	std::vector<SegmentInstance> rebuilt;
+	BuildSegmentInstances(grown, rebuilt);
+	bool matches = instances.size() == rebuilt.size();
+	for (size_t i = 0; matches && i < rebuilt.size(); ++i) {
+		matches = instances[i].length == rebuilt[i].length && instances[i].radius == rebuilt[i].radius && instances[i].rotation == rebuilt[i].rotation;
+	}
+	check(matches, "updated instances equal a rebuild");
+	check(UpdateSegmentInstances(grown, instances) == 0, "a second update finds nothing left to change");
+
+	// A new node rebuilds everything and lists every instance
+	LSystemNode extra = grown[2][0];
+	extra.nodeid = 100;
+	grown[2].push_back(extra);
+	changed.clear();
+	check(UpdateSegmentInstances(grown, instances, &changed) == instances.size() && instances.size() == flattenGenerations(grown).size(), "a new node rebuilds all instances");
+	check(changed.size() == instances.size(), "a rebuild lists every instance as changed");
+}
+
+int main() {
+	const std::vector<LSystemGeneration> generations = makeTree();
+	checkPacking();
+	checkBuild(generations);
+	checkUpdate(generations);
+
+	std::printf("%d checks, %d failed\n", checkCount, failureCount);
+	return failureCount > 0 ? 1 : 0;
+}
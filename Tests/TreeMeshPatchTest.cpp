@@ -0,0 +1,228 @@
+// TreeMeshPatchTest.cpp : Headless checks of TreeMeshPatcher, the growth worker's side of incremental tree uploads.
+//
+// - applying patches to a copy of the meshed vertices ends at the same positions and normals as meshing the grown tree
+// - patches are cumulative, applying only some of them ends at the same vertices as applying all of them
+// - ranges are sorted and disjoint, carry one position and normal per vertex and their bounds hold every position
+// - stale patches, patches of an earlier layout and a changed node count are refused
+//
+// Prints every failed check and exits with 1 if there was one.
+// Build next to the static library sources and link WickedEngine, e.g.
+//   g++ -O2 -std=c++20 -pthread -I.. TreeMeshPatchTest.cpp $(ls ../*.cpp | grep -v -e Example_ImGui -e FileManagerWin32) -lWickedEngine_Linux -o TreeMeshPatchTest
+
+#include "pch.h"
+#include "TwoOLSystem.h"
+#include "TreeMesh.h"
+#include "TreeMeshPatch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+static int checkCount = 0;
+static int failureCount = 0;
+
+static void check(bool passed, const std::string& what) {
+	checkCount++;
+	if (!passed) {
+		failureCount++;
+		std::printf("FAILED: %s\n", what.c_str());
+	}
+}
+
+static const float positionTolerance = 1e-4f;
+static const int growthSteps = 6;
+
+// Trunk chain with three forks of three nodes and a leaf on each
+static std::vector<LSystemGeneration> makeTree() {
+	std::vector<LSystemGeneration> generations(3);
+	int nextId = 0;
+	auto add = [&](size_t generation, int parent, XMFLOAT3 position, XMVECTOR rotation, float length, float radius, NodeType type) {
+		LSystemNode node{};
+		node.type = type;
+		node.parentid = parent;
+		node.nodeid = nextId++;
+		node.stage = static_cast<float>(generation);
+		node.length = length;
+		node.radius = radius;
+		node.position = position;
+		XMStoreFloat4(&node.rotation, rotation);
+		generations[generation].push_back(node);
+		XMFLOAT3 end;
+		XMStoreFloat3(&end, NodeEnd(node));
+		return std::make_pair(node.nodeid, end);
+	};
+
+	auto trunk = add(0, -1, XMFLOAT3(0, 0, 0), XMQuaternionIdentity(), 2.0f, 0.3f, NodeType::Forward);
+	trunk = add(0, trunk.first, trunk.second, XMQuaternionRotationRollPitchYaw(0.1f, 0.0f, 0.05f), 2.0f, 0.25f, NodeType::Forward);
+	for (int fork = 0; fork < 3; ++fork) {
+		const XMVECTOR rotation = XMQuaternionRotationRollPitchYaw(0.7f, 2.1f * static_cast<float>(fork), 0.2f);
+		auto branch = add(1, trunk.first, trunk.second, rotation, 1.2f, 0.12f, NodeType::Branch);
+		branch = add(1, branch.first, branch.second, XMQuaternionMultiply(rotation, XMQuaternionRotationRollPitchYaw(0.3f, 0.0f, 0.0f)), 1.0f, 0.1f, NodeType::Branch);
+		branch = add(1, branch.first, branch.second, XMQuaternionMultiply(rotation, XMQuaternionRotationRollPitchYaw(0.5f, 0.0f, 0.0f)), 0.8f, 0.08f, NodeType::Branch);
+		add(2, branch.first, branch.second, rotation, 0.3f, 0.05f, NodeType::Leaf);
+	}
+	return generations;
+}
+
+// Sizes between start and full at step of growthSteps, positions are left where start had them like stepGrowth does
+static std::vector<LSystemGeneration> grownTo(const std::vector<LSystemGeneration>& start, const std::vector<LSystemGeneration>& full, int step) {
+	std::vector<LSystemGeneration> grown = start;
+	const float t = static_cast<float>(step) / static_cast<float>(growthSteps);
+	for (size_t g = 0; g < grown.size(); ++g) {
+		for (size_t i = 0; i < grown[g].size(); ++i) {
+			// The trunk stops growing halfway, so later patches leave its spans alone
+			const float nodeT = g == 0 ? std::min(t, 0.5f) : t;
+			grown[g][i].length = start[g][i].length + nodeT * (full[g][i].length - start[g][i].length);
+			grown[g][i].radius = start[g][i].radius + nodeT * (full[g][i].radius - start[g][i].radius);
+		}
+	}
+	return grown;
+}
+
+// What the render thread does with an accepted patch
+static void apply(const TreeMeshPatch& patch, std::vector<XMFLOAT3>& positions, std::vector<XMFLOAT3>& normals) {
+	size_t offset = 0;
+	for (const XMUINT2& range : patch.ranges) {
+		std::copy(patch.positions.begin() + offset, patch.positions.begin() + offset + range.y, positions.begin() + range.x);
+		std::copy(patch.normals.begin() + offset, patch.normals.begin() + offset + range.y, normals.begin() + range.x);
+		offset += range.y;
+	}
+}
+
+static float largestDifference(const std::vector<XMFLOAT3>& a, const std::vector<XMFLOAT3>& b) {
+	float largest = a.size() == b.size() ? 0.0f : INFINITY;
+	for (size_t i = 0; i < std::min(a.size(), b.size()); ++i) {
+		largest = std::max(largest, XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&a[i]), XMLoadFloat3(&b[i])))));
+	}
+	return largest;
+}
+
+static void checkPatchShape(const TreeMeshPatch& patch, size_t vertexCount, const std::string& which) {
+	bool ordered = true;
+	uint32_t covered = 0;
+	for (size_t r = 0; r < patch.ranges.size(); ++r) {
+		const XMUINT2& range = patch.ranges[r];
+		ordered = ordered && range.y > 0 && range.x + range.y <= vertexCount && (r == 0 || patch.ranges[r - 1].x + patch.ranges[r - 1].y < range.x);
+		covered += range.y;
+	}
+	check(ordered, which + " has sorted, disjoint ranges inside the mesh");
+	check(patch.positions.size() == covered && patch.normals.size() == covered, which + " carries one position and normal per vertex");
+
+	bool bounded = true;
+	for (const XMFLOAT3& p : patch.positions) {
+		bounded = bounded && p.x >= patch.boundsMin.x && p.y >= patch.boundsMin.y && p.z >= patch.boundsMin.z;
+		bounded = bounded && p.x <= patch.boundsMax.x && p.y <= patch.boundsMax.y && p.z <= patch.boundsMax.z;
+	}
+	check(bounded, which + " bounds hold its positions");
+}
+
+// Grows start to full in growthSteps patches, applying the steps keep says to and always the last one
+template <typename Keep>
+static void checkGrowth(const std::vector<LSystemGeneration>& start, const std::vector<LSystemGeneration>& full, bool weld, Keep keep, const std::string& which,
+	std::vector<XMFLOAT3>& positions, std::vector<XMFLOAT3>& normals) {
+	TreeMeshData mesh;
+	GenerateMesh(start, TreeMeshSettings(), mesh);
+	if (weld) {
+		WeldVertices(mesh);
+	}
+	positions = mesh.vertex_positions;
+	normals = mesh.vertex_normals;
+
+	TreeMeshPatcher patcher;
+	patcher.SetLayout(start, mesh);
+	size_t lastRanges = 0;
+	for (int step = 1; step <= growthSteps; ++step) {
+		TreeMeshPatch patch;
+		const bool made = patcher.MakePatch(grownTo(start, full, step), patch);
+		check(made && patch.sequence == static_cast<uint64_t>(step), which + " step " + std::to_string(step) + " makes a patch");
+		checkPatchShape(patch, positions.size(), which + " step " + std::to_string(step));
+		if (keep(step) || step == growthSteps) {
+			check(patcher.Accept(patch), which + " step " + std::to_string(step) + " is accepted");
+			apply(patch, positions, normals);
+		}
+		lastRanges = patch.ranges.size();
+	}
+	check(lastRanges > 0, which + " the last step has something to upload");
+
+	TreeMeshPatch idle;
+	check(patcher.MakePatch(grownTo(start, full, growthSteps), idle) && idle.ranges.empty(), which + " without growth after accepting everything the patch is empty");
+}
+
+static void checkGrowthMatchesMeshing() {
+	const std::vector<LSystemGeneration> full = makeTree();
+	std::vector<LSystemGeneration> start = full;
+	for (LSystemGeneration& generation : start) {
+		for (LSystemNode& node : generation) {
+			node.length *= 0.25f;
+			node.radius *= 0.5f;
+		}
+	}
+
+	TreeMeshData fresh;
+	GenerateMesh(grownTo(start, full, growthSteps), TreeMeshSettings(), fresh);
+	std::vector<XMFLOAT3> every, everyNormals;
+	checkGrowth(start, full, false, [](int) { return true; }, "unwelded", every, everyNormals);
+	const float positionError = largestDifference(every, fresh.vertex_positions);
+	const float normalError = largestDifference(everyNormals, fresh.vertex_normals);
+	std::printf("Patched against freshly meshed: position error %.2e, normal error %.2e\n", positionError, normalError);
+	check(positionError <= positionTolerance, "patched positions equal meshing the grown tree");
+	check(normalError <= positionTolerance, "patched normals equal meshing the grown tree");
+
+	std::vector<XMFLOAT3> some, someNormals;
+	checkGrowth(start, full, false, [](int step) { return step == 2; }, "unwelded, skipping", some, someNormals);
+	check(largestDifference(some, every) == 0.0f && largestDifference(someNormals, everyNormals) == 0.0f, "skipping patches ends at the same vertices");
+
+	// Welded vertices are written through the remap, skipping still loses nothing
+	std::vector<XMFLOAT3> weldedEvery, weldedEveryNormals, weldedSome, weldedSomeNormals;
+	checkGrowth(start, full, true, [](int) { return true; }, "welded", weldedEvery, weldedEveryNormals);
+	checkGrowth(start, full, true, [](int step) { return step % 4 == 1; }, "welded, skipping", weldedSome, weldedSomeNormals);
+	check(largestDifference(weldedSome, weldedEvery) == 0.0f && largestDifference(weldedSomeNormals, weldedEveryNormals) == 0.0f, "skipping welded patches ends at the same vertices");
+}
+
+static void checkRefusals() {
+	const std::vector<LSystemGeneration> full = makeTree();
+	std::vector<LSystemGeneration> start = full;
+	start[1][0].length *= 0.5f;
+	TreeMeshData mesh;
+	GenerateMesh(start, TreeMeshSettings(), mesh);
+
+	TreeMeshPatcher patcher;
+	TreeMeshPatch patch;
+	check(!patcher.MakePatch(full, patch) && patch.ranges.empty(), "no patch before a layout is set");
+
+	patcher.SetLayout(start, mesh);
+	TreeMeshPatch first, second;
+	check(patcher.MakePatch(full, first) && patcher.MakePatch(full, second), "patches are made once a layout is set");
+	check(!first.ranges.empty() && first.positions.size() == second.positions.size() && first.ranges.size() == second.ranges.size(), "an unaccepted change is in every later patch");
+	check(patcher.Accept(second), "the newest patch is accepted");
+	check(!patcher.Accept(second), "the same patch is not accepted twice");
+	check(!patcher.Accept(first), "an older patch is refused after a newer one");
+
+	TreeMeshPatch stale;
+	start[1][0].length *= 0.5f;
+	check(patcher.MakePatch(start, stale), "a patch is made before the tree is meshed again");
+	const uint64_t oldLayout = patcher.GetLayout();
+	patcher.SetLayout(start, mesh);
+	check(patcher.GetLayout() != oldLayout, "meshing again starts a new layout");
+	check(!patcher.Accept(stale), "a patch of an earlier layout is refused");
+
+	std::vector<LSystemGeneration> bigger = start;
+	bigger[2].push_back(bigger[2][0]);
+	check(!patcher.MakePatch(bigger, patch) && patch.ranges.empty(), "a changed node count makes no patch");
+	check(patcher.GetNodeCount() == flattenGenerations(start).size(), "the node count is the meshed tree's");
+
+	patcher.Reset();
+	check(!patcher.MakePatch(start, patch), "no patch after a reset");
+}
+
+int main() {
+	checkGrowthMatchesMeshing();
+	checkRefusals();
+
+	std::printf("%d checks, %d failed\n", checkCount, failureCount);
+	return failureCount > 0 ? 1 : 0;
+}
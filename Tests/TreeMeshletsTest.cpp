@@ -0,0 +1,300 @@
+// TreeMeshletsTest.cpp : Headless checks of BuildMeshlets, IsMeshletVisible and CullMeshlets.
+//
+// A small fixed tree is meshed and welded the way WickedRenderer does it, then partitioned with several limits:
+// - every input triangle comes out exactly once, in its own subset and with its winding
+// - no meshlet has more than maxVertices vertices or maxTriangles triangles
+// - a camera inside a normal cone sees only back faces of that meshlet, and the cone test culls it
+// - meshlets of subsets passed as noConeSubsets (foliage) never get a cone
+// A box mesh is then moved outside each plane of a frustum in turn and must be rejected by that plane alone.
+//
+// Prints every failed check and exits with 1 if there was one.
+// Build next to the static library sources and link WickedEngine, e.g.
+//   g++ -O2 -std=c++20 -pthread -I.. TreeMeshletsTest.cpp $(ls ../*.cpp | grep -v -e Example_ImGui -e FileManagerWin32) -lWickedEngine_Linux -o TreeMeshletsTest
+
+#include "pch.h"
+#include "TwoOLSystem.h"
+#include "TreeMesh.h"
+#include "TreeMeshlets.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+static int checkCount = 0;
+static int failureCount = 0;
+
+static void check(bool passed, const std::string& what) {
+	checkCount++;
+	if (!passed) {
+		failureCount++;
+		std::printf("FAILED: %s\n", what.c_str());
+	}
+}
+
+// Trunk of three nodes, then two levels of three-node branches forking in two, a leaf at every branch tip
+static std::vector<LSystemGeneration> makeTree() {
+	std::vector<LSystemGeneration> generations(4);
+	int nextId = 0;
+	auto addChain = [&](size_t generation, int parent, XMFLOAT3 position, XMVECTOR rotation, float radius, NodeType type) {
+		for (int i = 0; i < 3; ++i) {
+			LSystemNode node{};
+			node.type = type;
+			node.parentid = parent;
+			node.nodeid = nextId++;
+			node.stage = static_cast<float>(generation);
+			node.length = radius * 6.0f;
+			node.radius = radius;
+			node.position = position;
+			XMStoreFloat4(&node.rotation, rotation);
+			generations[generation].push_back(node);
+			XMStoreFloat3(&position, NodeEnd(node));
+			parent = node.nodeid;
+		}
+		return std::make_pair(parent, position);
+	};
+
+	struct Tip {
+		int id;
+		XMFLOAT3 end;
+		XMVECTOR rotation;
+		float radius;
+	};
+	const auto trunk = addChain(0, -1, XMFLOAT3(0, 0, 0), XMQuaternionIdentity(), 0.5f, NodeType::Forward);
+	std::vector<Tip> tips = { { trunk.first, trunk.second, XMQuaternionIdentity(), 0.5f } };
+	for (size_t generation = 1; generation <= 2; ++generation) {
+		std::vector<Tip> next;
+		for (const Tip& tip : tips) {
+			for (int fork = 0; fork < 2; ++fork) {
+				const float side = fork == 0 ? 0.6f : -0.6f;
+				const XMVECTOR rotation = XMQuaternionNormalize(XMQuaternionMultiply(XMQuaternionRotationRollPitchYaw(side, 0.4f * static_cast<float>(generation), side * 0.5f), tip.rotation));
+				const auto chain = addChain(generation, tip.id, tip.end, rotation, tip.radius * 0.6f, NodeType::Branch);
+				next.push_back({ chain.first, chain.second, rotation, tip.radius * 0.6f });
+			}
+		}
+		tips = next;
+	}
+	for (const Tip& tip : tips) {
+		LSystemNode leaf{};
+		leaf.type = NodeType::Leaf;
+		leaf.parentid = tip.id;
+		leaf.nodeid = nextId++;
+		leaf.stage = 3.0f;
+		leaf.length = 0.3f;
+		leaf.radius = 0.05f;
+		leaf.position = tip.end;
+		XMStoreFloat4(&leaf.rotation, tip.rotation);
+		generations[3].push_back(leaf);
+	}
+	return generations;
+}
+
+static XMVECTOR meshletCorner(const TreeMeshData& mesh, const TreeMeshletData& data, const TreeMeshlet& meshlet, uint32_t triangle, uint32_t corner) {
+	const uint8_t local = data.triangles[meshlet.triangleOffset + triangle * 3 + corner];
+	return XMLoadFloat3(&mesh.vertex_positions[data.vertices[meshlet.vertexOffset + local]]);
+}
+
+// Subset and corners of a triangle, rotated to start at its smallest index so the same winding compares equal
+static std::array<uint32_t, 4> triangleKey(uint32_t subset, uint32_t a, uint32_t b, uint32_t c) {
+	if (b < a && b <= c) {
+		return { subset, b, c, a };
+	}
+	if (c < a && c < b) {
+		return { subset, c, a, b };
+	}
+	return { subset, a, b, c };
+}
+
+static void checkPartition(const TreeMeshData& mesh, const TreeMeshletData& data, uint32_t maxVertices, uint32_t maxTriangles) {
+	const std::string limits = " (" + std::to_string(maxVertices) + " vertices, " + std::to_string(maxTriangles) + " triangles)";
+
+	std::map<std::array<uint32_t, 4>, int> expected;
+	for (uint32_t s = 0; s < mesh.subsets.size(); ++s) {
+		const TreeMeshSubset& subset = mesh.subsets[s];
+		for (uint32_t i = subset.indexOffset; i < subset.indexOffset + subset.indexCount; i += 3) {
+			expected[triangleKey(s, mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2])]++;
+		}
+	}
+
+	bool withinLimits = true;
+	bool localIndicesValid = true;
+	std::map<std::array<uint32_t, 4>, int> found;
+	for (const TreeMeshlet& meshlet : data.meshlets) {
+		withinLimits = withinLimits && meshlet.vertexCount <= maxVertices && meshlet.triangleCount <= maxTriangles && meshlet.triangleCount > 0;
+		uint32_t corners[3];
+		for (uint32_t t = 0; t < meshlet.triangleCount; ++t) {
+			for (uint32_t k = 0; k < 3; ++k) {
+				const uint8_t local = data.triangles[meshlet.triangleOffset + t * 3 + k];
+				localIndicesValid = localIndicesValid && local < meshlet.vertexCount;
+				corners[k] = data.vertices[meshlet.vertexOffset + std::min<uint32_t>(local, meshlet.vertexCount - 1)];
+			}
+			found[triangleKey(meshlet.subset, corners[0], corners[1], corners[2])]++;
+		}
+	}
+	check(withinLimits, "meshlets respect their limits" + limits);
+	check(localIndicesValid, "local indices address the meshlet's own vertices" + limits);
+	check(found == expected, "every triangle appears exactly once in its subset" + limits);
+}
+
+// Cameras on the axis and halfway to the edge of every cone, at several distances behind the apex
+static void checkCones(const TreeMeshData& mesh, const TreeMeshletData& data, const XMFLOAT4 planes[6], bool expectCones) {
+	uint32_t coneCount = 0;
+	bool culled = true;
+	bool backFacing = true;
+	for (const TreeMeshlet& meshlet : data.meshlets) {
+		if (meshlet.coneCutoff >= 1.0f) {
+			continue;
+		}
+		coneCount++;
+		const XMVECTOR axis = XMLoadFloat3(&meshlet.coneAxis);
+		const XMVECTOR apex = XMLoadFloat3(&meshlet.coneApex);
+		XMVECTOR perpendicular = XMVector3Cross(axis, XMVectorSet(1, 0, 0, 0));
+		if (XMVectorGetX(XMVector3LengthSq(perpendicular)) < 1e-4f) {
+			perpendicular = XMVector3Cross(axis, XMVectorSet(0, 1, 0, 0));
+		}
+		perpendicular = XMVector3Normalize(perpendicular);
+		const float cosine = meshlet.coneCutoff + (1.0f - meshlet.coneCutoff) * 0.5f;
+		const XMVECTOR directions[2] = { axis, XMVectorAdd(XMVectorScale(axis, cosine), XMVectorScale(perpendicular, std::sqrt(1.0f - cosine * cosine))) };
+
+		for (const XMVECTOR& direction : directions) {
+			for (float distance : { 0.01f, 1.0f, 100.0f }) {
+				XMFLOAT3 camera;
+				XMStoreFloat3(&camera, XMVectorSubtract(apex, XMVectorScale(direction, distance)));
+				culled = culled && !IsMeshletVisible(meshlet, planes, camera);
+				for (uint32_t t = 0; t < meshlet.triangleCount; ++t) {
+					const XMVECTOR a = meshletCorner(mesh, data, meshlet, t, 0);
+					const XMVECTOR b = meshletCorner(mesh, data, meshlet, t, 1);
+					const XMVECTOR c = meshletCorner(mesh, data, meshlet, t, 2);
+					const XMVECTOR normal = XMVector3Cross(XMVectorSubtract(b, a), XMVectorSubtract(c, a));
+					const float facing = XMVectorGetX(XMVector3Dot(normal, XMVectorSubtract(XMLoadFloat3(&camera), a)));
+					backFacing = backFacing && facing <= 1e-5f * (1.0f + XMVectorGetX(XMVector3Length(normal)) * distance);
+				}
+			}
+		}
+	}
+	if (expectCones) {
+		check(coneCount > 0, "single triangle meshlets get a normal cone");
+	}
+	check(culled, "a camera inside the cone culls the meshlet");
+	check(backFacing, "a camera inside the cone sees no front faces");
+}
+
+static TreeMeshData makeBox(const XMFLOAT3& center, float halfSize) {
+	TreeMeshData box;
+	for (int corner = 0; corner < 8; ++corner) {
+		box.vertex_positions.push_back(XMFLOAT3(center.x + ((corner & 1) ? halfSize : -halfSize), center.y + ((corner & 2) ? halfSize : -halfSize),
+			center.z + ((corner & 4) ? halfSize : -halfSize)));
+		box.vertex_normals.push_back(XMFLOAT3(0, 1, 0));
+		box.vertex_uvs.push_back(XMFLOAT2(0, 0));
+	}
+	box.indices = { 0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4, 2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5 };
+	box.subsets.push_back({ 0, static_cast<uint32_t>(box.indices.size()), 0, TreeMeshPart::Bark });
+	return box;
+}
+
+// 90 degree frustum looking down +Z from the origin, near 0.1 and far 100, planes in IsMeshletVisible's convention
+static void makeFrustum(XMFLOAT4 planes[6]) {
+	const float s = 0.70710678f;
+	planes[0] = XMFLOAT4(s, 0, s, 0);        // Left
+	planes[1] = XMFLOAT4(-s, 0, s, 0);       // Right
+	planes[2] = XMFLOAT4(0, s, s, 0);        // Bottom
+	planes[3] = XMFLOAT4(0, -s, s, 0);       // Top
+	planes[4] = XMFLOAT4(0, 0, 1, -0.1f);    // Near
+	planes[5] = XMFLOAT4(0, 0, -1, 100.0f);  // Far
+}
+
+static void checkFrustum() {
+	XMFLOAT4 planes[6];
+	makeFrustum(planes);
+	const XMFLOAT3 camera(0, 0, 0);
+	const char* names[6] = { "left", "right", "bottom", "top", "near", "far" };
+	const XMFLOAT3 outside[6] = { XMFLOAT3(-30, 0, 10), XMFLOAT3(30, 0, 10), XMFLOAT3(0, -30, 10), XMFLOAT3(0, 30, 10), XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 150) };
+
+	std::vector<uint32_t> visible;
+	TreeMeshletData data;
+	BuildMeshlets(makeBox(XMFLOAT3(0, 0, 10), 0.5f), data);
+	check(CullMeshlets(data, planes, camera, visible) == data.meshlets.size() && !data.meshlets.empty(), "a box inside the frustum is kept");
+
+	for (int p = 0; p < 6; ++p) {
+		BuildMeshlets(makeBox(outside[p], p == 4 ? 0.01f : 0.5f), data);
+		visible.clear();
+		check(CullMeshlets(data, planes, camera, visible) == 0, std::string("a box outside the ") + names[p] + " plane is rejected");
+
+		// Opening that one plane must bring the box back, so it was rejected by that plane and no other
+		XMFLOAT4 opened[6];
+		std::copy(planes, planes + 6, opened);
+		opened[p] = XMFLOAT4(0, 0, 0, 1);
+		visible.clear();
+		check(CullMeshlets(data, opened, camera, visible) == data.meshlets.size(), std::string("only the ") + names[p] + " plane rejects the box");
+	}
+
+	// Straddling a plane is not outside it
+	BuildMeshlets(makeBox(XMFLOAT3(-10, 0, 10), 1.0f), data);
+	visible.clear();
+	check(CullMeshlets(data, planes, camera, visible) == data.meshlets.size(), "a box straddling the left plane is kept");
+}
+
+int main() {
+	// Meshed and welded like WickedRenderer's BuildTreeMesh, so triangles share vertices
+	TreeMeshData mesh;
+	GenerateMesh(makeTree(), TreeMeshSettings(), mesh);
+	WeldVertices(mesh);
+	std::vector<uint32_t> foliageSubsets;
+	for (uint32_t s = 0; s < mesh.subsets.size(); ++s) {
+		if (mesh.subsets[s].part == TreeMeshPart::Foliage) {
+			foliageSubsets.push_back(s);
+		}
+	}
+	check(!foliageSubsets.empty() && foliageSubsets.size() < mesh.subsets.size(), "the test tree has bark and foliage subsets");
+
+	const std::pair<uint32_t, uint32_t> limits[] = { { 64, 124 }, { 32, 16 }, { 3, 1 }, { 256, 255 } };
+	for (const auto& limit : limits) {
+		TreeMeshletData data;
+		BuildMeshlets(mesh, data, limit.first, limit.second, foliageSubsets);
+		checkPartition(mesh, data, limit.first, limit.second);
+	}
+
+	// Planes that keep everything, so only the cone decides
+	XMFLOAT4 everything[6];
+	std::fill(everything, everything + 6, XMFLOAT4(0, 0, 0, 1));
+
+	TreeMeshletData single;
+	BuildMeshlets(mesh, single, 3, 1);
+	checkCones(mesh, single, everything, true);
+	BuildMeshlets(mesh, single, 64, 124);
+	checkCones(mesh, single, everything, false);
+
+	// Foliage is double-sided: without the exemption its single card triangles would get cones, with it none may cull
+	BuildMeshlets(mesh, single, 3, 1);
+	const bool foliageCones = std::any_of(single.meshlets.begin(), single.meshlets.end(), [&](const TreeMeshlet& meshlet) {
+		return std::find(foliageSubsets.begin(), foliageSubsets.end(), meshlet.subset) != foliageSubsets.end() && meshlet.coneCutoff < 1.0f;
+	});
+	check(foliageCones, "foliage triangles get cones unless exempted");
+	for (const auto& limit : limits) {
+		TreeMeshletData data;
+		BuildMeshlets(mesh, data, limit.first, limit.second, foliageSubsets);
+		bool neverCulled = true;
+		for (const TreeMeshlet& meshlet : data.meshlets) {
+			if (std::find(foliageSubsets.begin(), foliageSubsets.end(), meshlet.subset) == foliageSubsets.end()) {
+				continue;
+			}
+			neverCulled = neverCulled && meshlet.coneCutoff >= 1.0f;
+			for (int direction = 0; direction < 6; ++direction) {
+				XMFLOAT3 camera = meshlet.center;
+				(&camera.x)[direction / 2] += direction % 2 == 0 ? 10.0f : -10.0f;
+				neverCulled = neverCulled && IsMeshletVisible(meshlet, everything, camera);
+			}
+		}
+		check(neverCulled, "foliage meshlets are never cone culled (" + std::to_string(limit.first) + " vertices, " + std::to_string(limit.second) + " triangles)");
+	}
+
+	checkFrustum();
+
+	std::printf("%d checks, %d failed\n", checkCount, failureCount);
+	return failureCount == 0 ? 0 : 1;
+}
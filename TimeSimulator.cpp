@@ -3,64 +3,133 @@
 #include "pch.h"
 #include "TimeSimulator.h"
 
-TimeSimulator::TimeSimulator()
-    : isRunning(false), isReversed(false), accumulatedTime(std::chrono::milliseconds(0)) {}
+#include <thread>
+
+TimeSimulator::TimeSimulator() {}
+
+void TimeSimulator::setClockSource(ClockSource source, void* context) {
+    clockSource = source;
+    clockContext = context;
+}
+
+int64_t TimeSimulator::now() const {
+    if (clockSource != nullptr) {
+        return clockSource(clockContext);
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+TimeSimulator::State TimeSimulator::read() const {
+    State state;
+    for (;;) {
+        const uint64_t before = sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        state.isRunning = isRunning.load(std::memory_order_relaxed);
+        state.isReversed = isReversed.load(std::memory_order_relaxed);
+        state.accumulatedNs = accumulatedNs.load(std::memory_order_relaxed);
+        state.startNs = startNs.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before) {
+            return state;
+        }
+    }
+}
+
+void TimeSimulator::beginWrite() {
+    uint64_t current = sequence.load(std::memory_order_relaxed);
+    for (;;) {
+        if (current & 1) {
+            std::this_thread::yield();
+            current = sequence.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (sequence.compare_exchange_weak(current, current + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void TimeSimulator::endWrite() {
+    sequence.fetch_add(1, std::memory_order_release);
+}
+
+// Only called between beginWrite and endWrite while running
+void TimeSimulator::foldRunningSegment(int64_t time) {
+    const int64_t segment = time - startNs.load(std::memory_order_relaxed);
+    const int64_t accumulated = accumulatedNs.load(std::memory_order_relaxed);
+    accumulatedNs.store(isReversed.load(std::memory_order_relaxed) ? accumulated - segment : accumulated + segment, std::memory_order_relaxed);
+    startNs.store(time, std::memory_order_relaxed);
+}
 
 void TimeSimulator::start() {
-    std::lock_guard<std::mutex> lock(timeMutex);
-    if (!isRunning) {
-        isRunning = true;
-        startTime = std::chrono::system_clock::now();
+    beginWrite();
+    if (!isRunning.load(std::memory_order_relaxed)) {
+        isRunning.store(true, std::memory_order_relaxed);
+        startNs.store(now(), std::memory_order_relaxed);
     }
+    endWrite();
 }
 
 void TimeSimulator::stop() {
-    std::lock_guard<std::mutex> lock(timeMutex);
-    if (isRunning) {
-        isRunning = false;
-        auto now = std::chrono::system_clock::now();
-        accumulatedTime += std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime);
+    beginWrite();
+    if (isRunning.load(std::memory_order_relaxed)) {
+        foldRunningSegment(now());
+        isRunning.store(false, std::memory_order_relaxed);
     }
+    endWrite();
 }
 
 void TimeSimulator::reset() {
-    std::lock_guard<std::mutex> lock(timeMutex);
-    isRunning = false;
-    isReversed = false;
-    accumulatedTime = std::chrono::milliseconds(0);
+    beginWrite();
+    isRunning.store(false, std::memory_order_relaxed);
+    isReversed.store(false, std::memory_order_relaxed);
+    accumulatedNs.store(0, std::memory_order_relaxed);
+    endWrite();
 }
 
 void TimeSimulator::reverse() {
-    std::lock_guard<std::mutex> lock(timeMutex);
-    isReversed = !isReversed;
+    // Fold the running segment first, so it keeps the direction it ran in
+    beginWrite();
+    if (isRunning.load(std::memory_order_relaxed)) {
+        foldRunningSegment(now());
+    }
+    isReversed.store(!isReversed.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    endWrite();
 }
 
-bool TimeSimulator::getIsReversed()
-{
-    return isReversed;
+void TimeSimulator::advance(int64_t nanoseconds) {
+    // Elapsed time, not the direction it runs in, so a reversed clock jumps the same way
+    beginWrite();
+    accumulatedNs.store(accumulatedNs.load(std::memory_order_relaxed) + nanoseconds, std::memory_order_relaxed);
+    endWrite();
 }
 
-double TimeSimulator::getElapsedSeconds() const {
-    std::lock_guard<std::mutex> lock(timeMutex);
-    auto elapsed_ms = accumulatedTime;
-    if (isRunning) {
-        auto now = std::chrono::system_clock::now();
-        auto duration = (isReversed ? startTime - now : now - startTime);
-        elapsed_ms += std::chrono::duration_cast<std::chrono::milliseconds>(duration);
+bool TimeSimulator::getIsReversed() const {
+    return isReversed.load(std::memory_order_acquire);
+}
+
+int64_t TimeSimulator::getElapsedNanoseconds() const {
+    const State state = read();
+    if (!state.isRunning) {
+        return state.accumulatedNs;
     }
-    return std::chrono::duration<double>(elapsed_ms).count();
+    const int64_t segment = now() - state.startNs;
+    return state.isReversed ? state.accumulatedNs - segment : state.accumulatedNs + segment;
+}
+
+double TimeSimulator::getElapsedSeconds() const {
+    return static_cast<double>(getElapsedNanoseconds()) * 1e-9;
 }
 
 void TimeSimulator::update() {
-    std::lock_guard<std::mutex> lock(timeMutex);
-    if (isRunning) {
-        auto now = std::chrono::system_clock::now();
-        if (isReversed) {
-            accumulatedTime -= std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime);
-        }
-        else {
-            accumulatedTime += std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime);
-        }
-        startTime = now; // Update start time to current time
+    // Readers already see the current time, folding only keeps the running segment short
+    beginWrite();
+    if (isRunning.load(std::memory_order_relaxed)) {
+        foldRunningSegment(now());
     }
+    endWrite();
 }
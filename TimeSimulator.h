@@ -1,26 +1,56 @@
 #pragma once
 #include "framework.h"
 
+#include <atomic>
 #include <chrono>
-#include <mutex>
+#include <cstdint>
 
+// Readers never block: the state is published through a sequence lock, so any number of worker threads can call
+// getElapsedSeconds while the UI thread starts, stops or reverses the simulation. Time comes from steady_clock and is
+// accumulated in nanoseconds, so wall clock changes do not move it and short frames are not rounded away.
 class TimeSimulator {
 public:
+    // Returns monotonic nanoseconds. Replaces steady_clock, e.g. to record or replay the samples a session saw.
+    using ClockSource = int64_t (*)(void* context);
+
     TimeSimulator();
 
+    // nullptr goes back to steady_clock. Not synchronized with readers, set it before other threads use the simulator.
+    void setClockSource(ClockSource source, void* context = nullptr);
+
     void start();                           // Start the time simulation
     void stop();                            // Stop the time simulation
     void reset();                           // Reset the time simulation
     void reverse();                         // Reverse the time simulation
-    bool getIsReversed();
+    void advance(int64_t nanoseconds);      // Move elapsed time by a jump made outside the clock, negative moves it back
+    bool getIsReversed() const;
 
     double getElapsedSeconds() const;       // Get elapsed time in seconds
+    int64_t getElapsedNanoseconds() const;
     void update();                          // Update the simulation time
 
 private:
-    bool isRunning;
-    bool isReversed;
-    std::chrono::milliseconds accumulatedTime;
-    std::chrono::system_clock::time_point startTime;
-    mutable std::mutex timeMutex;           // Mutex to synchronize time-related operations
+    using Clock = std::chrono::steady_clock;
+
+    struct State {
+        bool isRunning;
+        bool isReversed;
+        int64_t accumulatedNs;              // Signed, reversed time can run below zero
+        int64_t startNs;                    // Clock time the running segment started at
+    };
+
+    int64_t now() const;
+    State read() const;
+    void beginWrite();
+    void endWrite();
+    void foldRunningSegment(int64_t time);
+
+    // Odd while a writer is changing the fields below, writers also take it to exclude each other
+    ClockSource clockSource = nullptr;
+    void* clockContext = nullptr;
+    std::atomic<uint64_t> sequence{ 0 };
+    std::atomic<bool> isRunning{ false };
+    std::atomic<bool> isReversed{ false };
+    std::atomic<int64_t> accumulatedNs{ 0 };
+    std::atomic<int64_t> startNs{ 0 };
 };
@@ -0,0 +1,106 @@
+// LogDecoder.cpp : Turns a binary StructuredLogger file back into text lines.
+//
+// Formats come from the define records in the file itself, so the decoder needs nothing from the program that wrote
+// it. Each thread's messages are written in batches, lines from all threads are merged back into time order.
+//
+//   LogDecoder log.bin [log.txt]
+//
+// Writes to stdout when no output file is given. Build next to the static library sources, e.g.
+//   g++ -O2 -std=c++20 -pthread -I.. LogDecoder.cpp ../StructuredLog.cpp ../LogFile.cpp -o LogDecoder
+
+#include "StructuredLog.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct DecodedMessage {
+	int64_t time;
+	size_t offset;      // Of the record in the file
+};
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::fprintf(stderr, "usage: %s <log.bin> [output.txt]\n", argv[0]);
+		return 1;
+	}
+	std::ifstream input(argv[1], std::ios::binary);
+	if (!input) {
+		std::fprintf(stderr, "cannot open %s\n", argv[1]);
+		return 1;
+	}
+	const std::vector<uint8_t> data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+	uint32_t header[2] = {};
+	if (data.size() < sizeof(header) || (std::memcpy(header, data.data(), sizeof(header)), header[0] != kStructuredLogMagic) || header[1] != kStructuredLogVersion) {
+		std::fprintf(stderr, "%s is not a structured log of version %u\n", argv[1], kStructuredLogVersion);
+		return 1;
+	}
+
+	std::unordered_map<uint64_t, std::string> formats;
+	std::vector<DecodedMessage> messages;
+	size_t offset = sizeof(header);
+	while (offset + 8 <= data.size()) {
+		const uint8_t* record = data.data() + offset;
+		uint32_t size;
+		std::memcpy(&size, record, 4);
+		if (size == 0) {
+			// Unused tail of a memory-mapped log the program did not close
+			break;
+		}
+		if (size < 8 || size > data.size() - offset) {
+			std::fprintf(stderr, "damaged record at byte %zu, stopping there\n", offset);
+			break;
+		}
+		uint64_t formatId = 0;
+		if (size >= 16) {
+			std::memcpy(&formatId, record + 8, 8);
+		}
+		if (record[4] == static_cast<uint8_t>(StructuredRecord::Define) && size >= 20) {
+			uint32_t length;
+			std::memcpy(&length, record + 16, 4);
+			formats[formatId].assign(reinterpret_cast<const char*>(record + 20), std::min<size_t>(length, size - 20));
+		}
+		else if (record[4] == static_cast<uint8_t>(StructuredRecord::Message) && size >= kStructuredLogHeaderBytes) {
+			int64_t time;
+			std::memcpy(&time, record + 16, 8);
+			messages.push_back({ time, offset });
+		}
+		offset += size;
+	}
+
+	// Stable, so messages with the same timestamp keep the order one thread wrote them in
+	std::stable_sort(messages.begin(), messages.end(), [](const DecodedMessage& a, const DecodedMessage& b) { return a.time < b.time; });
+
+	std::FILE* output = argc > 2 ? std::fopen(argv[2], "w") : stdout;
+	if (output == nullptr) {
+		std::fprintf(stderr, "cannot write %s\n", argv[2]);
+		return 1;
+	}
+	std::string line;
+	size_t damaged = 0;
+	for (const DecodedMessage& message : messages) {
+		const uint8_t* record = data.data() + message.offset;
+		uint32_t size;
+		uint64_t formatId;
+		std::memcpy(&size, record, 4);
+		std::memcpy(&formatId, record + 8, 8);
+		auto format = formats.find(formatId);
+		const std::string unknown = "<unknown format " + std::to_string(formatId) + ">";
+		line.clear();
+		if (!FormatLogLine(line, message.time, record[5], format != formats.end() ? format->second.c_str() : unknown.c_str(),
+			record + kStructuredLogHeaderBytes, size - kStructuredLogHeaderBytes, record[6])) {
+			damaged++;
+		}
+		std::fwrite(line.data(), 1, line.size(), output);
+	}
+	if (output != stdout) {
+		std::fclose(output);
+	}
+	std::fprintf(stderr, "%zu messages, %zu formats, %zu with damaged arguments\n", messages.size(), formats.size(), damaged);
+	return 0;
+}
@@ -0,0 +1,431 @@
+#include "TreeBVH.h"
+#include "TreeMesh.h"
+#include "TwoOLSystem.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+using namespace DirectX;
+
+static constexpr uint32_t kBinCount = 12;
+static constexpr uint32_t kMaxLeafSize = 4;
+static constexpr uint32_t kParallelBuildSize = 4096;  // Subtrees with at least this many capsules are built on their own job
+static constexpr uint32_t kMaxSAHDepth = 48;          // Deeper than this, split at the median to keep the traversal stack bounded
+static constexpr uint32_t kStackSize = 128;
+
+static XMVECTOR CapsuleMin(const NodeCapsule& capsule) {
+	return XMVectorSubtract(XMVectorMin(XMLoadFloat3(&capsule.a), XMLoadFloat3(&capsule.b)), XMVectorReplicate(capsule.radius));
+}
+
+static XMVECTOR CapsuleMax(const NodeCapsule& capsule) {
+	return XMVectorAdd(XMVectorMax(XMLoadFloat3(&capsule.a), XMLoadFloat3(&capsule.b)), XMVectorReplicate(capsule.radius));
+}
+
+static float SurfaceArea(FXMVECTOR min, FXMVECTOR max) {
+	XMFLOAT3 e;
+	XMStoreFloat3(&e, XMVectorMax(XMVectorSubtract(max, min), XMVectorZero()));
+	return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+// Shared state of one Build call, subdivisions running on different jobs write disjoint ranges
+struct BVHBuilder {
+	const std::vector<NodeCapsule>& capsules;
+	const std::vector<XMFLOAT3>& centroids;
+	std::vector<uint32_t>& primitives;
+	std::vector<TreeBVHNode>& nodes;
+	std::vector<XMFLOAT3> boxMin;   // Capsule bounds, computed once instead of on every level
+	std::vector<XMFLOAT3> boxMax;
+	std::atomic<uint32_t> nodeCount{ 1 };
+	wi::jobsystem::context context;
+
+	BVHBuilder(const std::vector<NodeCapsule>& capsules, const std::vector<XMFLOAT3>& centroids, std::vector<uint32_t>& primitives, std::vector<TreeBVHNode>& nodes)
+		: capsules(capsules), centroids(centroids), primitives(primitives), nodes(nodes), boxMin(capsules.size()), boxMax(capsules.size()) {
+		for (size_t i = 0; i < capsules.size(); ++i) {
+			XMStoreFloat3(&boxMin[i], CapsuleMin(capsules[i]));
+			XMStoreFloat3(&boxMax[i], CapsuleMax(capsules[i]));
+		}
+	}
+
+	void Subdivide(uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth);
+};
+
+void BVHBuilder::Subdivide(uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth) {
+	TreeBVHNode& node = nodes[nodeIndex];
+
+	XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+	XMVECTOR centroidMin = boundsMin;
+	XMVECTOR centroidMax = boundsMax;
+	for (uint32_t i = first; i < first + count; ++i) {
+		const uint32_t primitive = primitives[i];
+		boundsMin = XMVectorMin(boundsMin, XMLoadFloat3(&boxMin[primitive]));
+		boundsMax = XMVectorMax(boundsMax, XMLoadFloat3(&boxMax[primitive]));
+		XMVECTOR centroid = XMLoadFloat3(&centroids[primitive]);
+		centroidMin = XMVectorMin(centroidMin, centroid);
+		centroidMax = XMVectorMax(centroidMax, centroid);
+	}
+	XMStoreFloat3(&node.min, boundsMin);
+	XMStoreFloat3(&node.max, boundsMax);
+	node.leftOrFirst = first;
+	node.count = count;
+	if (count <= kMaxLeafSize) {
+		return;
+	}
+
+	XMFLOAT3 extent;
+	XMFLOAT3 origin;
+	XMStoreFloat3(&extent, XMVectorSubtract(centroidMax, centroidMin));
+	XMStoreFloat3(&origin, centroidMin);
+	uint32_t axis = 0;
+	if (extent.y > extent.x) axis = 1;
+	if (extent.z > (&extent.x)[axis]) axis = 2;
+	const float axisExtent = (&extent.x)[axis];
+	const float axisOrigin = (&origin.x)[axis];
+
+	uint32_t leftCount = 0;
+	if (axisExtent > 1e-6f && depth < kMaxSAHDepth) {
+		const float scale = kBinCount / axisExtent;
+		auto binOf = [&](uint32_t primitive) {
+			return std::min(kBinCount - 1, static_cast<uint32_t>(((&centroids[primitive].x)[axis] - axisOrigin) * scale));
+		};
+
+		uint32_t binCounts[kBinCount] = {};
+		XMVECTOR binMin[kBinCount];
+		XMVECTOR binMax[kBinCount];
+		std::fill(binMin, binMin + kBinCount, XMVectorReplicate(FLT_MAX));
+		std::fill(binMax, binMax + kBinCount, XMVectorReplicate(-FLT_MAX));
+		for (uint32_t i = first; i < first + count; ++i) {
+			const uint32_t primitive = primitives[i];
+			const uint32_t bin = binOf(primitive);
+			binCounts[bin]++;
+			binMin[bin] = XMVectorMin(binMin[bin], XMLoadFloat3(&boxMin[primitive]));
+			binMax[bin] = XMVectorMax(binMax[bin], XMLoadFloat3(&boxMax[primitive]));
+		}
+
+		// Split after bin i puts bins 0..i on the left
+		float leftCost[kBinCount - 1];
+		XMVECTOR sweepMin = XMVectorReplicate(FLT_MAX);
+		XMVECTOR sweepMax = XMVectorReplicate(-FLT_MAX);
+		uint32_t sweepCount = 0;
+		for (uint32_t i = 0; i < kBinCount - 1; ++i) {
+			sweepMin = XMVectorMin(sweepMin, binMin[i]);
+			sweepMax = XMVectorMax(sweepMax, binMax[i]);
+			sweepCount += binCounts[i];
+			leftCost[i] = sweepCount == 0 ? -1.0f : SurfaceArea(sweepMin, sweepMax) * sweepCount;
+		}
+
+		float bestCost = FLT_MAX;
+		uint32_t bestSplit = 0;
+		sweepMin = XMVectorReplicate(FLT_MAX);
+		sweepMax = XMVectorReplicate(-FLT_MAX);
+		sweepCount = 0;
+		for (uint32_t i = kBinCount - 1; i > 0; --i) {
+			sweepMin = XMVectorMin(sweepMin, binMin[i]);
+			sweepMax = XMVectorMax(sweepMax, binMax[i]);
+			sweepCount += binCounts[i];
+			if (sweepCount == 0 || leftCost[i - 1] < 0.0f) {
+				continue;
+			}
+			const float cost = leftCost[i - 1] + SurfaceArea(sweepMin, sweepMax) * sweepCount;
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestSplit = i - 1;
+			}
+		}
+
+		auto middle = std::partition(primitives.begin() + first, primitives.begin() + first + count,
+			[&](uint32_t primitive) { return binOf(primitive) <= bestSplit; });
+		leftCount = static_cast<uint32_t>(middle - (primitives.begin() + first));
+	}
+
+	// Coincident centroids or a degenerate SAH split: fall back to the object median
+	if (leftCount == 0 || leftCount == count) {
+		leftCount = count / 2;
+		std::nth_element(primitives.begin() + first, primitives.begin() + first + leftCount, primitives.begin() + first + count,
+			[&](uint32_t lhs, uint32_t rhs) { return (&centroids[lhs].x)[axis] < (&centroids[rhs].x)[axis]; });
+	}
+
+	const uint32_t left = nodeCount.fetch_add(2);
+	node.leftOrFirst = left;
+	node.count = 0;
+
+	const uint32_t childFirst[2] = { first, first + leftCount };
+	const uint32_t childCount[2] = { leftCount, count - leftCount };
+	for (uint32_t child = 0; child < 2; ++child) {
+		const uint32_t childNode = left + child;
+		const uint32_t start = childFirst[child];
+		const uint32_t size = childCount[child];
+		if (size >= kParallelBuildSize) {
+			wi::jobsystem::Execute(context, [this, childNode, start, size, depth](wi::jobsystem::JobArgs) {
+				Subdivide(childNode, start, size, depth + 1);
+			});
+		}
+		else {
+			Subdivide(childNode, start, size, depth + 1);
+		}
+	}
+}
+
+void TreeBVH::UpdateCapsules(const std::vector<const LSystemNode*>& flat) {
+	capsules.resize(flat.size());
+	centroids.resize(flat.size());
+	for (size_t i = 0; i < flat.size(); ++i) {
+		const LSystemNode& node = *flat[i];
+		XMVECTOR a = XMLoadFloat3(&node.position);
+		XMVECTOR b = NodeEnd(node);
+		XMStoreFloat3(&capsules[i].a, a);
+		XMStoreFloat3(&capsules[i].b, b);
+		capsules[i].radius = std::max(node.radius, 0.0f);
+		XMStoreFloat3(&centroids[i], XMVectorScale(XMVectorAdd(a, b), 0.5f));
+	}
+}
+
+void TreeBVH::Build(const std::vector<LSystemGeneration>& generations) {
+	UpdateCapsules(flattenGenerations(generations));
+
+	const uint32_t count = static_cast<uint32_t>(capsules.size());
+	primitives.resize(count);
+	std::iota(primitives.begin(), primitives.end(), 0u);
+	nodes.resize(count == 0 ? 0 : count * 2 - 1);
+	nodeCount = 0;
+	if (count == 0) {
+		return;
+	}
+
+	BVHBuilder builder(capsules, centroids, primitives, nodes);
+	builder.Subdivide(0, 0, count, 0);
+	wi::jobsystem::Wait(builder.context);
+	nodeCount = builder.nodeCount.load();
+	nodes.resize(nodeCount);
+}
+
+void TreeBVH::Refit(const std::vector<LSystemGeneration>& generations) {
+	std::vector<const LSystemNode*> flat = flattenGenerations(generations);
+	if (flat.size() != capsules.size()) {
+		Build(generations);
+		return;
+	}
+	UpdateCapsules(flat);
+
+	// Children are allocated after their parent, so a reverse sweep visits them first
+	for (uint32_t i = nodeCount; i-- > 0;) {
+		TreeBVHNode& node = nodes[i];
+		XMVECTOR boundsMin;
+		XMVECTOR boundsMax;
+		if (node.count > 0) {
+			boundsMin = XMVectorReplicate(FLT_MAX);
+			boundsMax = XMVectorReplicate(-FLT_MAX);
+			for (uint32_t p = node.leftOrFirst; p < node.leftOrFirst + node.count; ++p) {
+				boundsMin = XMVectorMin(boundsMin, CapsuleMin(capsules[primitives[p]]));
+				boundsMax = XMVectorMax(boundsMax, CapsuleMax(capsules[primitives[p]]));
+			}
+		}
+		else {
+			const TreeBVHNode& left = nodes[node.leftOrFirst];
+			const TreeBVHNode& right = nodes[node.leftOrFirst + 1];
+			boundsMin = XMVectorMin(XMLoadFloat3(&left.min), XMLoadFloat3(&right.min));
+			boundsMax = XMVectorMax(XMLoadFloat3(&left.max), XMLoadFloat3(&right.max));
+		}
+		XMStoreFloat3(&node.min, boundsMin);
+		XMStoreFloat3(&node.max, boundsMax);
+	}
+}
+
+// Entry distance of the ray into the box, FLT_MAX on a miss
+static float RayBox(FXMVECTOR origin, FXMVECTOR inverseDirection, float maxDistance, const TreeBVHNode& node) {
+	XMVECTOR t0 = XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&node.min), origin), inverseDirection);
+	XMVECTOR t1 = XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&node.max), origin), inverseDirection);
+	XMFLOAT3 near;
+	XMFLOAT3 far;
+	XMStoreFloat3(&near, XMVectorMin(t0, t1));
+	XMStoreFloat3(&far, XMVectorMax(t0, t1));
+	const float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+	const float exit = std::min(std::min(far.x, far.y), std::min(far.z, maxDistance));
+	return enter <= exit ? enter : FLT_MAX;
+}
+
+// Distance along a normalized ray to a capsule, negative on a miss.
+// The ray is restarted next to the capsule first, the quadratics lose too much precision for thin branches seen from afar.
+static float RayCapsule(FXMVECTOR rayOrigin, FXMVECTOR direction, const NodeCapsule& capsule) {
+	XMVECTOR a = XMLoadFloat3(&capsule.a);
+	XMVECTOR b = XMLoadFloat3(&capsule.b);
+	const float shift = XMVectorGetX(XMVector3Dot(XMVectorSubtract(XMVectorScale(XMVectorAdd(a, b), 0.5f), rayOrigin), direction));
+	XMVECTOR origin = XMVectorMultiplyAdd(direction, XMVectorReplicate(shift), rayOrigin);
+	const float r2 = capsule.radius * capsule.radius;
+	XMVECTOR ba = XMVectorSubtract(b, a);
+	XMVECTOR oa = XMVectorSubtract(origin, a);
+	const float baba = XMVectorGetX(XMVector3Dot(ba, ba));
+	const float bard = XMVectorGetX(XMVector3Dot(ba, direction));
+	const float baoa = XMVectorGetX(XMVector3Dot(ba, oa));
+	const float rdoa = XMVectorGetX(XMVector3Dot(direction, oa));
+	const float oaoa = XMVectorGetX(XMVector3Dot(oa, oa));
+
+	// Cylinder body, skipped when the ray runs along the axis or the capsule is a sphere
+	const float k2 = baba - bard * bard;
+	if (k2 > 1e-8f * baba) {
+		const float k1 = baba * rdoa - baoa * bard;
+		const float k0 = baba * oaoa - baoa * baoa - r2 * baba;
+		const float h = k1 * k1 - k2 * k0;
+		if (h < 0.0f) {
+			return -1.0f;
+		}
+		const float t = (-k1 - std::sqrt(h)) / k2;
+		const float y = baoa + t * bard;
+		if (y > 0.0f && y < baba) {
+			return shift + t >= 0.0f ? shift + t : -1.0f;
+		}
+	}
+
+	// End caps, at most one of them can be the first hit
+	float best = -1.0f;
+	for (XMVECTOR oc : { oa, XMVectorSubtract(origin, b) }) {
+		const float k1 = XMVectorGetX(XMVector3Dot(direction, oc));
+		const float k0 = XMVectorGetX(XMVector3Dot(oc, oc)) - r2;
+		const float h = k1 * k1 - k0;
+		if (h < 0.0f) {
+			continue;
+		}
+		const float t = shift - k1 - std::sqrt(h);
+		if (t >= 0.0f && (best < 0.0f || t < best)) {
+			best = t;
+		}
+	}
+	return best;
+}
+
+bool TreeBVH::RayCast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, TreeBVHHit& hit) const {
+	if (nodeCount == 0) {
+		return false;
+	}
+	XMVECTOR rayOrigin = XMLoadFloat3(&origin);
+	XMVECTOR rayDirection = XMLoadFloat3(&direction);
+	XMVECTOR inverseDirection = XMVectorReciprocal(rayDirection);
+
+	float best = maxDistance;
+	bool found = false;
+	uint32_t stack[kStackSize];
+	uint32_t stackSize = 0;
+	if (RayBox(rayOrigin, inverseDirection, best, nodes[0]) == FLT_MAX) {
+		return false;
+	}
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		const TreeBVHNode& node = nodes[stack[--stackSize]];
+		if (node.count > 0) {
+			for (uint32_t p = node.leftOrFirst; p < node.leftOrFirst + node.count; ++p) {
+				const float t = RayCapsule(rayOrigin, rayDirection, capsules[primitives[p]]);
+				if (t >= 0.0f && t <= best) {
+					best = t;
+					hit.node = primitives[p];
+					hit.distance = t;
+					found = true;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first so the far one is usually rejected by the shortened ray
+		uint32_t nearChild = node.leftOrFirst;
+		uint32_t farChild = node.leftOrFirst + 1;
+		float nearDistance = RayBox(rayOrigin, inverseDirection, best, nodes[nearChild]);
+		float farDistance = RayBox(rayOrigin, inverseDirection, best, nodes[farChild]);
+		if (farDistance < nearDistance) {
+			std::swap(nearChild, farChild);
+			std::swap(nearDistance, farDistance);
+		}
+		if (farDistance != FLT_MAX) {
+			stack[stackSize++] = farChild;
+		}
+		if (nearDistance != FLT_MAX) {
+			stack[stackSize++] = nearChild;
+		}
+	}
+	return found;
+}
+
+size_t TreeBVH::SphereQuery(const XMFLOAT3& center, float radius, std::vector<uint32_t>& result) const {
+	const size_t before = result.size();
+	if (nodeCount == 0) {
+		return 0;
+	}
+	XMVECTOR sphereCenter = XMLoadFloat3(&center);
+
+	uint32_t stack[kStackSize];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		const TreeBVHNode& node = nodes[stack[--stackSize]];
+		XMVECTOR closest = XMVectorClamp(sphereCenter, XMLoadFloat3(&node.min), XMLoadFloat3(&node.max));
+		if (XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(closest, sphereCenter))) > radius * radius) {
+			continue;
+		}
+		if (node.count == 0) {
+			stack[stackSize++] = node.leftOrFirst + 1;
+			stack[stackSize++] = node.leftOrFirst;
+			continue;
+		}
+		for (uint32_t p = node.leftOrFirst; p < node.leftOrFirst + node.count; ++p) {
+			const NodeCapsule& capsule = capsules[primitives[p]];
+			XMVECTOR a = XMLoadFloat3(&capsule.a);
+			XMVECTOR ab = XMVectorSubtract(XMLoadFloat3(&capsule.b), a);
+			const float abab = XMVectorGetX(XMVector3Dot(ab, ab));
+			const float t = abab > 0.0f ? std::clamp(XMVectorGetX(XMVector3Dot(XMVectorSubtract(sphereCenter, a), ab)) / abab, 0.0f, 1.0f) : 0.0f;
+			XMVECTOR onSegment = XMVectorMultiplyAdd(ab, XMVectorReplicate(t), a);
+			const float reach = radius + capsule.radius;
+			if (XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(onSegment, sphereCenter))) <= reach * reach) {
+				result.push_back(primitives[p]);
+			}
+		}
+	}
+	return result.size() - before;
+}
+
+size_t TreeBVH::FrustumQuery(const XMFLOAT4 frustumPlanes[6], std::vector<uint32_t>& result) const {
+	const size_t before = result.size();
+	if (nodeCount == 0) {
+		return 0;
+	}
+	XMVECTOR planes[6];
+	for (int i = 0; i < 6; ++i) {
+		planes[i] = XMLoadFloat4(&frustumPlanes[i]);
+	}
+
+	uint32_t stack[kStackSize];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		const TreeBVHNode& node = nodes[stack[--stackSize]];
+		XMVECTOR boxMin = XMLoadFloat3(&node.min);
+		XMVECTOR boxMax = XMLoadFloat3(&node.max);
+		bool outside = false;
+		for (int i = 0; i < 6 && !outside; ++i) {
+			// Box corner furthest along the plane normal
+			XMVECTOR corner = XMVectorSelect(boxMin, boxMax, XMVectorGreaterOrEqual(planes[i], XMVectorZero()));
+			outside = XMVectorGetX(XMPlaneDotCoord(planes[i], corner)) < 0.0f;
+		}
+		if (outside) {
+			continue;
+		}
+		if (node.count == 0) {
+			stack[stackSize++] = node.leftOrFirst + 1;
+			stack[stackSize++] = node.leftOrFirst;
+			continue;
+		}
+		for (uint32_t p = node.leftOrFirst; p < node.leftOrFirst + node.count; ++p) {
+			const NodeCapsule& capsule = capsules[primitives[p]];
+			XMVECTOR a = XMLoadFloat3(&capsule.a);
+			XMVECTOR b = XMLoadFloat3(&capsule.b);
+			bool culled = false;
+			for (int i = 0; i < 6 && !culled; ++i) {
+				culled = XMVectorGetX(XMPlaneDotCoord(planes[i], a)) < -capsule.radius &&
+					XMVectorGetX(XMPlaneDotCoord(planes[i], b)) < -capsule.radius;
+			}
+			if (!culled) {
+				result.push_back(primitives[p]);
+			}
+		}
+	}
+	return result.size() - before;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+
+// Forward declaration of LSystemNode
+class LSystemNode;
+
+using LSystemGeneration = std::vector<LSystemNode>;
+
+// Swept sphere from a node's position to its tip
+struct NodeCapsule {
+	DirectX::XMFLOAT3 a;
+	DirectX::XMFLOAT3 b;
+	float radius;
+};
+
+struct TreeBVHNode {
+	DirectX::XMFLOAT3 min;
+	uint32_t leftOrFirst;   // First child for inner nodes (the second follows it), first primitive for leaves
+	DirectX::XMFLOAT3 max;
+	uint32_t count;         // Primitives in a leaf, 0 for inner nodes
+};
+
+struct TreeBVHHit {
+	uint32_t node = ~0u;    // Flat index of the node that was hit
+	float distance = 0.0f;
+};
+
+// Bounding volume hierarchy over the capsules of every node, addressed by flat index (running index over all generations)
+class TreeBVH {
+public:
+	// Binned SAH build, large subtrees are split on the job system
+	void Build(const std::vector<LSystemGeneration>& generations);
+
+	// Recompute capsules and bounds after nodes grew without changing the tree layout, rebuilds if the node count changed
+	void Refit(const std::vector<LSystemGeneration>& generations);
+
+	// Closest capsule along a normalized direction within maxDistance
+	bool RayCast(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance, TreeBVHHit& hit) const;
+
+	// Append every node whose capsule touches the sphere and return how many were added
+	size_t SphereQuery(const DirectX::XMFLOAT3& center, float radius, std::vector<uint32_t>& nodes) const;
+
+	// Frustum planes are (normal, distance) pointing inwards, like CullMeshlets.
+	// Appends every node whose capsule may be inside and returns how many were added.
+	size_t FrustumQuery(const DirectX::XMFLOAT4 frustumPlanes[6], std::vector<uint32_t>& nodes) const;
+
+	const NodeCapsule& GetCapsule(uint32_t node) const { return capsules[node]; }
+	size_t GetNodeCount() const { return capsules.size(); }
+	bool IsEmpty() const { return nodeCount == 0; }
+
+private:
+	void UpdateCapsules(const std::vector<const LSystemNode*>& flat);
+
+	std::vector<NodeCapsule> capsules;
+	std::vector<DirectX::XMFLOAT3> centroids;
+	std::vector<uint32_t> primitives;   // Flat node indices, leaves point into this
+	std::vector<TreeBVHNode> nodes;     // Children always come after their parent
+	uint32_t nodeCount = 0;
+};
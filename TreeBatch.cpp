@@ -0,0 +1,249 @@
+#include "TreeBatch.h"
+#include <algorithm>
+#include <cfloat>
+
+using namespace DirectX;
+
+static constexpr uint32_t kMinBatchCapacity = 4096;
+
+void RangeAllocator::Reset(uint32_t newCapacity) {
+	freeBlocks.clear();
+	capacity = 0;
+	used = 0;
+	Grow(newCapacity);
+}
+
+void RangeAllocator::Grow(uint32_t newCapacity) {
+	if (newCapacity <= capacity) {
+		return;
+	}
+	// The new space joins a free block that ends at the old capacity
+	if (!freeBlocks.empty() && freeBlocks.back().offset + freeBlocks.back().count == capacity) {
+		freeBlocks.back().count += newCapacity - capacity;
+	}
+	else {
+		freeBlocks.push_back({ capacity, newCapacity - capacity });
+	}
+	capacity = newCapacity;
+}
+
+bool RangeAllocator::Allocate(uint32_t count, uint32_t& offset) {
+	if (count == 0) {
+		offset = 0;
+		return true;
+	}
+	for (size_t i = 0; i < freeBlocks.size(); ++i) {
+		TreeBatchRange& block = freeBlocks[i];
+		if (block.count < count) {
+			continue;
+		}
+		offset = block.offset;
+		block.offset += count;
+		block.count -= count;
+		if (block.count == 0) {
+			freeBlocks.erase(freeBlocks.begin() + i);
+		}
+		used += count;
+		return true;
+	}
+	return false;
+}
+
+void RangeAllocator::Release(uint32_t offset, uint32_t count) {
+	if (count == 0) {
+		return;
+	}
+	used -= count;
+	auto next = std::lower_bound(freeBlocks.begin(), freeBlocks.end(), offset, [](const TreeBatchRange& block, uint32_t value) {
+		return block.offset < value;
+	});
+	const bool joinsPrevious = next != freeBlocks.begin() && (next - 1)->offset + (next - 1)->count == offset;
+	const bool joinsNext = next != freeBlocks.end() && offset + count == next->offset;
+	if (joinsPrevious && joinsNext) {
+		(next - 1)->count += count + next->count;
+		freeBlocks.erase(next);
+	}
+	else if (joinsPrevious) {
+		(next - 1)->count += count;
+	}
+	else if (joinsNext) {
+		next->offset = offset;
+		next->count += count;
+	}
+	else {
+		freeBlocks.insert(next, { offset, count });
+	}
+}
+
+uint32_t RangeAllocator::GetHighWater() const {
+	if (!freeBlocks.empty() && freeBlocks.back().offset + freeBlocks.back().count == capacity) {
+		return freeBlocks.back().offset;
+	}
+	return capacity;
+}
+
+// Doubling keeps the number of reallocations logarithmic in the batch size
+static uint32_t GrownCapacity(const RangeAllocator& allocator, uint32_t count) {
+	return std::max({ allocator.GetCapacity() * 2, allocator.GetCapacity() + count, kMinBatchCapacity });
+}
+
+bool TreeBatch::AllocateIndices(RangeAllocator& allocator, std::vector<uint32_t>& indices, uint32_t count, TreeBatchRange& range, std::vector<TreeBatchRange>& changed) {
+	range.count = count;
+	if (!allocator.Allocate(count, range.offset)) {
+		allocator.Grow(GrownCapacity(allocator, count));
+		indices.resize(allocator.GetCapacity(), 0);
+		capacityChanged = true;
+		if (!allocator.Allocate(count, range.offset)) {
+			return false;
+		}
+	}
+	if (count > 0) {
+		changed.push_back(range);
+	}
+	return true;
+}
+
+void TreeBatch::ReleaseIndices(RangeAllocator& allocator, std::vector<uint32_t>& indices, const TreeBatchRange& range, std::vector<TreeBatchRange>& changed) {
+	// All three corners on one vertex, the hole stays in the draw without producing pixels
+	std::fill(indices.begin() + range.offset, indices.begin() + range.offset + range.count, 0u);
+	allocator.Release(range.offset, range.count);
+	if (range.count > 0) {
+		changed.push_back(range);
+	}
+}
+
+uint32_t TreeBatch::Insert(const TreeMeshData& mesh, FXMMATRIX transform) {
+	// Only vertices referenced by LOD0 are copied, lower levels would never be selected inside a batch
+	std::vector<uint32_t> local(mesh.vertex_positions.size(), UINT32_MAX);
+	uint32_t vertexCount = 0;
+	uint32_t barkCount = 0;
+	uint32_t foliageCount = 0;
+	for (const TreeMeshSubset& subset : mesh.subsets) {
+		if (subset.lod != 0) {
+			continue;
+		}
+		(subset.part == TreeMeshPart::Foliage ? foliageCount : barkCount) += subset.indexCount;
+		for (uint32_t i = subset.indexOffset; i < subset.indexOffset + subset.indexCount; ++i) {
+			if (local[mesh.indices[i]] == UINT32_MAX) {
+				local[mesh.indices[i]] = vertexCount++;
+			}
+		}
+	}
+
+	uint32_t handle;
+	if (!freeSlots.empty()) {
+		handle = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else {
+		handle = static_cast<uint32_t>(slots.size());
+		slots.emplace_back();
+	}
+	TreeBatchSlot& slot = slots[handle];
+	slot = TreeBatchSlot();
+	slot.used = true;
+	XMStoreFloat4x4(&slot.transform, transform);
+
+	slot.vertices.count = vertexCount;
+	if (!vertexAllocator.Allocate(vertexCount, slot.vertices.offset)) {
+		vertexAllocator.Grow(GrownCapacity(vertexAllocator, vertexCount));
+		vertex_positions.resize(vertexAllocator.GetCapacity());
+		vertex_normals.resize(vertexAllocator.GetCapacity());
+		vertex_uvs.resize(vertexAllocator.GetCapacity());
+		vertexAllocator.Allocate(vertexCount, slot.vertices.offset);
+		capacityChanged = true;
+	}
+	if (vertexCount > 0) {
+		changedVertices.push_back(slot.vertices);
+	}
+	AllocateIndices(barkAllocator, barkIndices, barkCount, slot.barkIndices, changedBarkIndices);
+	AllocateIndices(foliageAllocator, foliageIndices, foliageCount, slot.foliageIndices, changedFoliageIndices);
+
+	// Normals go through the inverse transpose so non-uniform scale keeps them perpendicular
+	XMMATRIX normalTransform = XMMatrixTranspose(XMMatrixInverse(nullptr, transform));
+	XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+	for (size_t v = 0; v < local.size(); ++v) {
+		if (local[v] == UINT32_MAX) {
+			continue;
+		}
+		const uint32_t target = slot.vertices.offset + local[v];
+		XMVECTOR position = XMVector3Transform(XMLoadFloat3(&mesh.vertex_positions[v]), transform);
+		XMStoreFloat3(&vertex_positions[target], position);
+		XMStoreFloat3(&vertex_normals[target], XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&mesh.vertex_normals[v]), normalTransform)));
+		vertex_uvs[target] = mesh.vertex_uvs[v];
+		boundsMin = XMVectorMin(boundsMin, position);
+		boundsMax = XMVectorMax(boundsMax, position);
+	}
+	XMStoreFloat3(&slot.boundsMin, boundsMin);
+	XMStoreFloat3(&slot.boundsMax, boundsMax);
+
+	uint32_t barkCursor = slot.barkIndices.offset;
+	uint32_t foliageCursor = slot.foliageIndices.offset;
+	for (const TreeMeshSubset& subset : mesh.subsets) {
+		if (subset.lod != 0) {
+			continue;
+		}
+		const bool foliage = subset.part == TreeMeshPart::Foliage;
+		uint32_t* target = foliage ? &foliageIndices[foliageCursor] : &barkIndices[barkCursor];
+		for (uint32_t i = 0; i < subset.indexCount; ++i) {
+			target[i] = slot.vertices.offset + local[mesh.indices[subset.indexOffset + i]];
+		}
+		(foliage ? foliageCursor : barkCursor) += subset.indexCount;
+	}
+
+	treeCount++;
+	dirty = true;
+	return handle;
+}
+
+bool TreeBatch::Remove(uint32_t handle) {
+	if (handle >= slots.size() || !slots[handle].used) {
+		return false;
+	}
+	TreeBatchSlot& slot = slots[handle];
+	vertexAllocator.Release(slot.vertices.offset, slot.vertices.count);
+	ReleaseIndices(barkAllocator, barkIndices, slot.barkIndices, changedBarkIndices);
+	ReleaseIndices(foliageAllocator, foliageIndices, slot.foliageIndices, changedFoliageIndices);
+	slot.used = false;
+	freeSlots.push_back(handle);
+	treeCount--;
+	dirty = true;
+	return true;
+}
+
+void TreeBatch::Clear() {
+	*this = TreeBatch();
+	dirty = true;
+	capacityChanged = true;
+}
+
+void TreeBatch::ClearChanges() {
+	dirty = false;
+	capacityChanged = false;
+	changedVertices.clear();
+	changedBarkIndices.clear();
+	changedFoliageIndices.clear();
+}
+
+const TreeBatchSlot* TreeBatch::GetTree(uint32_t handle) const {
+	return handle < slots.size() && slots[handle].used ? &slots[handle] : nullptr;
+}
+
+void TreeBatch::GetBounds(XMFLOAT3& boundsMin, XMFLOAT3& boundsMax) const {
+	XMVECTOR lower = XMVectorReplicate(FLT_MAX);
+	XMVECTOR upper = XMVectorReplicate(-FLT_MAX);
+	bool empty = true;
+	for (const TreeBatchSlot& slot : slots) {
+		if (slot.used && slot.vertices.count > 0) {
+			lower = XMVectorMin(lower, XMLoadFloat3(&slot.boundsMin));
+			upper = XMVectorMax(upper, XMLoadFloat3(&slot.boundsMax));
+			empty = false;
+		}
+	}
+	if (empty) {
+		lower = upper = XMVectorZero();
+	}
+	XMStoreFloat3(&boundsMin, lower);
+	XMStoreFloat3(&boundsMax, upper);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "TreeMesh.h"
+
+struct TreeBatchRange {
+	uint32_t offset = 0;
+	uint32_t count = 0;
+};
+
+// First fit free list over [0, capacity). Released ranges are merged with free neighbours, so the list stays short
+// and a tree removed next to a hole leaves one bigger hole behind.
+class RangeAllocator {
+public:
+	void Reset(uint32_t capacity = 0);
+	void Grow(uint32_t capacity);
+	bool Allocate(uint32_t count, uint32_t& offset);
+	void Release(uint32_t offset, uint32_t count);
+
+	uint32_t GetCapacity() const { return capacity; }
+	uint32_t GetUsed() const { return used; }
+	uint32_t GetHighWater() const;   // End of the last allocated range, everything above is free
+	size_t GetFreeBlockCount() const { return freeBlocks.size(); }
+
+private:
+	std::vector<TreeBatchRange> freeBlocks;  // Sorted by offset, never touching each other
+	uint32_t capacity = 0;
+	uint32_t used = 0;
+};
+
+// One tree inside a batch: where its data lives and the world space bounds of its vertices
+struct TreeBatchSlot {
+	TreeBatchRange vertices;
+	TreeBatchRange barkIndices;      // Into TreeBatch::barkIndices
+	TreeBatchRange foliageIndices;   // Into TreeBatch::foliageIndices
+	DirectX::XMFLOAT4X4 transform;
+	DirectX::XMFLOAT3 boundsMin;
+	DirectX::XMFLOAT3 boundsMax;
+	bool used = false;
+};
+
+// Many trees packed into one set of vertex arrays and two index pools, bark and foliage, so the whole batch is drawn
+// as one mesh with one subset per material no matter how many trees it holds. Trees are baked into world space on insert.
+// Released index ranges are filled with degenerate triangles and every range is reused first fit before the arrays grow.
+class TreeBatch {
+public:
+	// Copy LOD0 of mesh into the batch, returns a handle for Remove and GetTree
+	uint32_t Insert(const TreeMeshData& mesh, DirectX::FXMMATRIX transform);
+	bool Remove(uint32_t handle);
+	void Clear();
+
+	const TreeBatchSlot* GetTree(uint32_t handle) const;
+	uint32_t GetTreeCount() const { return treeCount; }
+	void GetBounds(DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax) const;
+
+	// Indices up to the high water mark of each pool, the rest of the pool is free
+	uint32_t GetBarkIndexCount() const { return barkAllocator.GetHighWater(); }
+	uint32_t GetFoliageIndexCount() const { return foliageAllocator.GetHighWater(); }
+	const RangeAllocator& GetVertexAllocator() const { return vertexAllocator; }
+
+	// Something was inserted or removed since the last ClearChanges
+	bool IsDirty() const { return dirty; }
+	void ClearChanges();
+
+	// Ranges rewritten since the last ClearChanges, so only they have to be uploaded. Inserts write vertices and indices,
+	// removals only fill their index ranges with degenerate triangles.
+	const std::vector<TreeBatchRange>& GetChangedVertices() const { return changedVertices; }
+	const std::vector<TreeBatchRange>& GetChangedBarkIndices() const { return changedBarkIndices; }
+	const std::vector<TreeBatchRange>& GetChangedFoliageIndices() const { return changedFoliageIndices; }
+	// An allocator grew since the last ClearChanges, the arrays were resized and GPU buffers sized to them are too small
+	bool HasCapacityChanged() const { return capacityChanged; }
+
+	// Sized to the vertex capacity, vertices of removed trees stay behind unreferenced until they are reused
+	std::vector<DirectX::XMFLOAT3> vertex_positions;
+	std::vector<DirectX::XMFLOAT3> vertex_normals;
+	std::vector<DirectX::XMFLOAT2> vertex_uvs;
+	std::vector<uint32_t> barkIndices;
+	std::vector<uint32_t> foliageIndices;
+
+private:
+	bool AllocateIndices(RangeAllocator& allocator, std::vector<uint32_t>& indices, uint32_t count, TreeBatchRange& range, std::vector<TreeBatchRange>& changed);
+	static void ReleaseIndices(RangeAllocator& allocator, std::vector<uint32_t>& indices, const TreeBatchRange& range, std::vector<TreeBatchRange>& changed);
+
+	RangeAllocator vertexAllocator;
+	RangeAllocator barkAllocator;
+	RangeAllocator foliageAllocator;
+	std::vector<TreeBatchSlot> slots;
+	std::vector<uint32_t> freeSlots;
+	uint32_t treeCount = 0;
+	bool dirty = false;
+	bool capacityChanged = false;
+	std::vector<TreeBatchRange> changedVertices;
+	std::vector<TreeBatchRange> changedBarkIndices;
+	std::vector<TreeBatchRange> changedFoliageIndices;
+};
@@ -0,0 +1,129 @@
+#include "TreeGrowthKeyframes.h"
+#include "MeshOptimizer.h"
+#include "TwoOLSystem.h"
+#include <algorithm>
+
+using namespace DirectX;
+
+static constexpr uint32_t kLerpVectorsPerGroup = 1024;
+
+// Pose the nodes at a moment of growth: sizes scale with the node's progress through its generation,
+// and every node moves with the tip of its parent so children stay attached while the parent is short
+static void GrowTo(const std::vector<const LSystemNode*>& nodes, const LSystemHierarchy& hierarchy, const std::vector<uint32_t>& birth,
+	float time, std::vector<LSystemNode*>& grown) {
+	std::vector<XMFLOAT3> grownEnds(nodes.size());
+	for (uint32_t nodeIndex : hierarchy.order) {
+		const LSystemNode& source = *nodes[nodeIndex];
+		LSystemNode& node = *grown[nodeIndex];
+		const float progress = std::clamp(time - static_cast<float>(birth[nodeIndex]), 0.0f, 1.0f);
+		node.length = source.length * progress;
+		node.radius = source.radius * progress;
+
+		const int parent = hierarchy.parents[nodeIndex];
+		if (parent >= 0) {
+			XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&source.position), NodeEnd(*nodes[parent]));
+			XMStoreFloat3(&node.position, XMVectorAdd(XMLoadFloat3(&grownEnds[parent]), offset));
+		}
+		XMStoreFloat3(&grownEnds[nodeIndex], NodeEnd(node));
+	}
+}
+
+void BakeGrowthKeyframes(const std::vector<LSystemGeneration>& generations, const TreeMeshSettings& settings, uint32_t keyframeCount, TreeGrowthKeyframes& keyframes, TreeMeshData& mesh) {
+	keyframes = TreeGrowthKeyframes();
+	mesh = TreeMeshData();
+
+	// One level without culling or merging keeps every node's vertices present at every size
+	TreeMeshSettings stable = settings;
+	stable.lods = { TreeLODLevel{ settings.lods.empty() ? 16u : settings.lods[0].segments, 0.0f, 0.0f } };
+
+	std::vector<const LSystemNode*> nodes = flattenGenerations(generations);
+	LSystemHierarchy hierarchy = buildHierarchy(generations);
+	std::vector<uint32_t> birth;
+	birth.reserve(nodes.size());
+	for (uint32_t g = 0; g < generations.size(); ++g) {
+		birth.insert(birth.end(), generations[g].size(), g);
+	}
+
+	// The fully grown tree fixes the topology and, once optimized, the vertex order
+	GenerateMesh(generations, stable, mesh);
+	if (stable.optimizeVertexCache) {
+		OptimizeTreeMesh(mesh);
+	}
+	const uint32_t vertexCount = static_cast<uint32_t>(mesh.vertex_positions.size());
+	const float duration = static_cast<float>(generations.size());
+	if (keyframeCount == 0) {
+		keyframeCount = static_cast<uint32_t>(generations.size()) + 1;
+	}
+	keyframeCount = std::max(keyframeCount, 2u);
+
+	keyframes.vertexCount = vertexCount;
+	keyframes.stride = (vertexCount * 3 + 3) & ~3u;
+	keyframes.positions.assign(static_cast<size_t>(keyframes.stride) * keyframeCount, 0.0f);
+
+	std::vector<LSystemGeneration> grownGenerations = generations;
+	std::vector<LSystemNode*> grown;
+	grown.reserve(nodes.size());
+	for (auto& generation : grownGenerations) {
+		for (auto& node : generation) {
+			grown.push_back(&node);
+		}
+	}
+
+	TreeMeshData frame;
+	for (uint32_t k = 0; k < keyframeCount; ++k) {
+		const float time = duration * k / (keyframeCount - 1);
+		keyframes.times.push_back(time);
+		GrowTo(nodes, hierarchy, birth, time, grown);
+		GenerateMesh(grownGenerations, stable, frame);
+		if (frame.vertex_positions.size() != vertexCount) {
+			wi::backlog::post("Growth keyframe " + std::to_string(k) + " changed topology, baking stopped", wi::backlog::LogLevel::Error);
+			keyframes = TreeGrowthKeyframes();
+			return;
+		}
+
+		float* target = &keyframes.positions[static_cast<size_t>(keyframes.stride) * k];
+		for (uint32_t v = 0; v < vertexCount; ++v) {
+			const uint32_t index = mesh.remap.empty() ? v : mesh.remap[v];
+			target[index * 3 + 0] = frame.vertex_positions[v].x;
+			target[index * 3 + 1] = frame.vertex_positions[v].y;
+			target[index * 3 + 2] = frame.vertex_positions[v].z;
+		}
+	}
+}
+
+void SampleGrowthKeyframes(const TreeGrowthKeyframes& keyframes, float time, XMFLOAT3* positions) {
+	if (keyframes.times.size() < 2 || keyframes.vertexCount == 0) {
+		return;
+	}
+
+	const auto next = std::upper_bound(keyframes.times.begin(), keyframes.times.end(), time);
+	const size_t k = std::clamp<size_t>(static_cast<size_t>(next - keyframes.times.begin()), 1, keyframes.times.size() - 1) - 1;
+	const float span = keyframes.times[k + 1] - keyframes.times[k];
+	const float t = std::clamp(span > 0.0f ? (time - keyframes.times[k]) / span : 0.0f, 0.0f, 1.0f);
+
+	const float* from = &keyframes.positions[static_cast<size_t>(keyframes.stride) * k];
+	const float* to = from + keyframes.stride;
+	float* out = &positions->x;
+	const uint32_t floatCount = keyframes.vertexCount * 3;
+	const XMVECTOR weight = XMVectorReplicate(t);
+
+	// Keyframes are padded, the output is not, so the last partial vector is written lane by lane
+	wi::jobsystem::context context;
+	wi::jobsystem::Dispatch(context, keyframes.stride / 4, kLerpVectorsPerGroup, [&](wi::jobsystem::JobArgs args) {
+		const uint32_t i = args.jobIndex * 4;
+		XMVECTOR a = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(from + i));
+		XMVECTOR b = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(to + i));
+		XMVECTOR result = XMVectorLerpV(a, b, weight);
+		if (i + 4 <= floatCount) {
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(out + i), result);
+		}
+		else {
+			XMFLOAT4 tail;
+			XMStoreFloat4(&tail, result);
+			for (uint32_t lane = 0; i + lane < floatCount; ++lane) {
+				out[i + lane] = (&tail.x)[lane];
+			}
+		}
+	});
+	wi::jobsystem::Wait(context);
+}
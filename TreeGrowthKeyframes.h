@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "TreeMesh.h"
+
+// Vertex positions of one topology at several moments of growth. Time is measured in generations:
+// the nodes of generation i grow from nothing to their full length and radius between time i and i + 1.
+struct TreeGrowthKeyframes {
+	std::vector<float> times;       // Ascending, the first is 0 and the last is the generation count
+	std::vector<float> positions;   // Keyframe k holds xyz for every vertex starting at k * stride
+	uint32_t vertexCount = 0;
+	uint32_t stride = 0;            // Floats per keyframe, 3 * vertexCount padded to a multiple of 4
+
+	float GetDuration() const { return times.empty() ? 0.0f : times.back(); }
+};
+
+// Mesh the fully grown tree once with culling, merging and extra LOD levels disabled so every keyframe shares its
+// topology, then record positions at keyframeCount evenly spaced times (0 picks one per generation boundary, where the
+// piecewise linear growth makes interpolation exact). mesh receives the shared indices, normals and uvs.
+void BakeGrowthKeyframes(const std::vector<LSystemGeneration>& generations, const TreeMeshSettings& settings, uint32_t keyframeCount, TreeGrowthKeyframes& keyframes, TreeMeshData& mesh);
+
+// Interpolate between the two keyframes around time, streamed four floats at a time over the job system
+void SampleGrowthKeyframes(const TreeGrowthKeyframes& keyframes, float time, DirectX::XMFLOAT3* positions);
@@ -0,0 +1,114 @@
+#include "TreeInstancing.h"
+#include "TreeMesh.h"
+#include "TwoOLSystem.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+static constexpr float kQuaternionRange = 0.70710678f; // Largest possible magnitude of the three smallest components
+
+uint32_t PackQuaternion(FXMVECTOR quaternion) {
+	XMFLOAT4 q;
+	XMStoreFloat4(&q, XMQuaternionNormalize(quaternion));
+	float components[4] = { q.x, q.y, q.z, q.w };
+
+	uint32_t largest = 0;
+	for (uint32_t i = 1; i < 4; ++i) {
+		if (fabsf(components[i]) > fabsf(components[largest])) {
+			largest = i;
+		}
+	}
+
+	// q and -q are the same rotation, flip so the dropped component is positive
+	const float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+	uint32_t packed = largest << 30;
+	uint32_t shift = 20;
+	for (uint32_t i = 0; i < 4; ++i) {
+		if (i == largest) {
+			continue;
+		}
+		float normalized = std::clamp(components[i] * sign / kQuaternionRange, -1.0f, 1.0f) * 0.5f + 0.5f;
+		packed |= static_cast<uint32_t>(normalized * 1023.0f + 0.5f) << shift;
+		shift -= 10;
+	}
+	return packed;
+}
+
+XMVECTOR UnpackQuaternion(uint32_t packed) {
+	const uint32_t largest = packed >> 30;
+	float components[4];
+	float sumSquares = 0.0f;
+	uint32_t shift = 20;
+	for (uint32_t i = 0; i < 4; ++i) {
+		if (i == largest) {
+			continue;
+		}
+		float normalized = static_cast<float>((packed >> shift) & 1023u) / 1023.0f;
+		components[i] = (normalized * 2.0f - 1.0f) * kQuaternionRange;
+		sumSquares += components[i] * components[i];
+		shift -= 10;
+	}
+	components[largest] = sqrtf(std::max(0.0f, 1.0f - sumSquares));
+	return XMVectorSet(components[0], components[1], components[2], components[3]);
+}
+
+static SegmentInstance MakeSegmentInstance(const LSystemNode& node) {
+	SegmentInstance instance;
+	instance.position = node.position;
+	instance.length = node.length;
+	instance.radius = node.radius;
+	instance.rotation = PackQuaternion(NodeRotation(node));
+	instance.stage = node.stage;
+	instance.type = static_cast<uint32_t>(node.type);
+	return instance;
+}
+
+void BuildSegmentInstances(const std::vector<LSystemGeneration>& generations, std::vector<SegmentInstance>& instances) {
+	instances.clear();
+	for (const auto& generation : generations) {
+		for (const auto& node : generation) {
+			instances.push_back(MakeSegmentInstance(node));
+		}
+	}
+}
+
+size_t UpdateSegmentInstances(const std::vector<LSystemGeneration>& generations, std::vector<SegmentInstance>& instances, std::vector<uint32_t>* changed) {
+	size_t nodeCount = 0;
+	for (const auto& generation : generations) {
+		nodeCount += generation.size();
+	}
+	if (nodeCount != instances.size()) {
+		BuildSegmentInstances(generations, instances);
+		if (changed != nullptr) {
+			for (uint32_t i = 0; i < instances.size(); ++i) {
+				changed->push_back(i);
+			}
+		}
+		return instances.size();
+	}
+
+	size_t changedCount = 0;
+	uint32_t index = 0;
+	for (const auto& generation : generations) {
+		for (const auto& node : generation) {
+			SegmentInstance& instance = instances[index];
+			if (instance.length != node.length || instance.radius != node.radius) {
+				instance.length = node.length;
+				instance.radius = node.radius;
+				changedCount++;
+				if (changed != nullptr) {
+					changed->push_back(index);
+				}
+			}
+			index++;
+		}
+	}
+	return changedCount;
+}
+
+XMMATRIX SegmentInstanceMatrix(const SegmentInstance& instance) {
+	return XMMatrixScaling(instance.radius, instance.length, instance.radius) *
+		XMMatrixRotationQuaternion(UnpackQuaternion(instance.rotation)) *
+		XMMatrixTranslation(instance.position.x, instance.position.y, instance.position.z);
+}
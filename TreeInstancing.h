@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+
+// Forward declaration of LSystemNode
+class LSystemNode;
+
+using LSystemGeneration = std::vector<LSystemNode>;
+
+// One node drawn as a scaled unit cylinder (see GenerateUnitCylinder), 32 bytes per segment on the CPU side
+struct SegmentInstance {
+	DirectX::XMFLOAT3 position;  // Base of the segment
+	float length;
+	float radius;
+	uint32_t rotation;           // Unit quaternion packed with PackQuaternion
+	float stage;
+	uint32_t type;               // NodeType
+};
+static_assert(sizeof(SegmentInstance) == 32, "SegmentInstance is meant to stay 32 bytes");
+
+// Smallest-three quaternion packing: 2 bit index of the dropped component and 10 bits for each of the others
+uint32_t PackQuaternion(DirectX::FXMVECTOR quaternion);
+DirectX::XMVECTOR UnpackQuaternion(uint32_t packed);
+
+// One instance per node in flat order (running index over all generations)
+void BuildSegmentInstances(const std::vector<LSystemGeneration>& generations, std::vector<SegmentInstance>& instances);
+
+// Refresh length and radius after growth and return how many instances changed, indices are appended to changed when given.
+// Falls back to BuildSegmentInstances when the node count no longer matches.
+size_t UpdateSegmentInstances(const std::vector<LSystemGeneration>& generations, std::vector<SegmentInstance>& instances, std::vector<uint32_t>* changed = nullptr);
+
+// Object to world matrix placing the unit cylinder on the segment
+DirectX::XMMATRIX SegmentInstanceMatrix(const SegmentInstance& instance);
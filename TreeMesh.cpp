@@ -0,0 +1,408 @@
+#include "TreeMesh.h"
+#include "TwoOLSystem.h"
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+struct Vertex {
+	XMFLOAT3 position;
+	XMFLOAT3 normal;
+	XMFLOAT2 uv;
+
+	bool operator==(const Vertex& other) const {
+		return position.x == other.position.x && position.y == other.position.y && position.z == other.position.z &&
+			normal.x == other.normal.x && normal.y == other.normal.y && normal.z == other.normal.z &&
+			uv.x == other.uv.x && uv.y == other.uv.y;
+	}
+};
+
+namespace std {
+	template <>
+	struct hash<Vertex> {
+		size_t operator()(const Vertex& v) const {
+			size_t h1 = hash<float>()(v.position.x);
+			size_t h2 = hash<float>()(v.position.y);
+			size_t h3 = hash<float>()(v.position.z);
+			size_t h4 = hash<float>()(v.normal.x);
+			size_t h5 = hash<float>()(v.normal.y);
+			size_t h6 = hash<float>()(v.normal.z);
+			size_t h7 = hash<float>()(v.uv.x);
+			size_t h8 = hash<float>()(v.uv.y);
+			return h1 ^ (h2 << 1) ^ (h3 << 2) ^ (h4 << 3) ^ (h5 << 4) ^ (h6 << 5) ^ (h7 << 6) ^ (h8 << 7);
+		}
+	};
+}
+
+static constexpr uint32_t kMaxLODLevels = 8;
+
+TreeMeshSettings TreeMeshSettings::LODChain() {
+	TreeMeshSettings settings;
+	settings.lods = {
+		{ 16, 0.0f, 0.0f },
+		{ 8, 0.05f, 5.0f },
+		{ 5, 0.15f, 12.0f },
+		{ 3, 0.35f, 25.0f },
+	};
+	return settings;
+}
+
+uint32_t TreeMeshData::GetSubsetsPerLOD() const {
+	const uint32_t lodCount = GetLODCount();
+	return lodCount == 0 ? 0 : static_cast<uint32_t>(subsets.size()) / lodCount;
+}
+
+uint32_t TreeMeshData::GetLODCount() const {
+	uint32_t count = 0;
+	for (const auto& subset : subsets) {
+		count = std::max(count, subset.lod + 1);
+	}
+	return count;
+}
+
+XMVECTOR NodeRotation(const LSystemNode& node) {
+	XMVECTOR rotation = XMLoadFloat4(&node.rotation);
+	if (XMVectorGetX(XMVector4LengthSq(rotation)) < 1e-12f) {
+		return XMQuaternionIdentity();
+	}
+	return XMQuaternionNormalize(rotation);
+}
+
+XMVECTOR NodeEnd(const LSystemNode& node) {
+	XMVECTOR forwardVec = XMVector3Rotate(XMVectorSet(0, node.length, 0, 0), NodeRotation(node));
+	return XMVectorAdd(XMLoadFloat3(&node.position), forwardVec);
+}
+
+// Vertices generated for one cylinder, bottom and top vertex interleaved with a duplicated seam
+static uint32_t CylinderVertexCount(uint32_t segments) {
+	return (segments + 1) * 2;
+}
+
+// Write the vertices of a cylinder running from the base of one node to the end of another
+static void WriteCylinder(const LSystemNode& base, const LSystemNode& end, uint32_t segments, XMFLOAT3* positions, XMFLOAT3* normals, XMFLOAT2* uvs) {
+	XMVECTOR bottomRotation = NodeRotation(base);
+	XMVECTOR topRotation = NodeRotation(end);
+	XMVECTOR bottomPosVec = XMLoadFloat3(&base.position);
+	XMVECTOR topPosVec = NodeEnd(end);
+	float segment_angle = XM_2PI / static_cast<float>(segments);
+
+	for (uint32_t i = 0; i <= segments; ++i) {
+		float angle = segment_angle * i;
+		XMVECTOR ring = XMVectorSet(cosf(angle), 0.0f, sinf(angle), 0.0f);
+
+		// Bottom vertex
+		XMVECTOR bottomNormal = XMVector3Rotate(ring, bottomRotation);
+		XMStoreFloat3(&positions[i * 2], XMVectorMultiplyAdd(bottomNormal, XMVectorReplicate(base.radius), bottomPosVec));
+		XMStoreFloat3(&normals[i * 2], bottomNormal);
+
+		// Top vertex
+		XMVECTOR topNormal = XMVector3Rotate(ring, topRotation);
+		XMStoreFloat3(&positions[i * 2 + 1], XMVectorMultiplyAdd(topNormal, XMVectorReplicate(end.radius), topPosVec));
+		XMStoreFloat3(&normals[i * 2 + 1], topNormal);
+
+		// UV coordinates, left alone when only the shape is being refreshed
+		if (uvs != nullptr) {
+			uvs[i * 2] = XMFLOAT2(static_cast<float>(i) / segments, 0.0f);
+			uvs[i * 2 + 1] = XMFLOAT2(static_cast<float>(i) / segments, 1.0f);
+		}
+	}
+}
+
+static void AppendCylinderIndices(uint32_t firstVertex, uint32_t segments, std::vector<uint32_t>& indices) {
+	for (uint32_t i = 0; i < segments; ++i) {
+		uint32_t base = firstVertex + i * 2;
+		uint32_t next = base + 2;
+		indices.push_back(base);
+		indices.push_back(next);
+		indices.push_back(base + 1);
+
+		indices.push_back(next);
+		indices.push_back(next + 1);
+		indices.push_back(base + 1);
+	}
+}
+
+static bool IsCardNode(const LSystemNode& node, const TreeMeshSettings& settings) {
+	return settings.leafCards && (node.type == NodeType::Leaf || node.type == NodeType::Decal);
+}
+
+XMMATRIX LeafCardMatrix(const LSystemNode& node) {
+	const float height = std::max(node.length, 1e-4f);
+	const float width = std::max(node.radius * 2.0f, height * 0.5f);
+	XMFLOAT3 position = node.position;
+	return XMMatrixScaling(width, height, width) * XMMatrixRotationQuaternion(NodeRotation(node)) * XMMatrixTranslation(position.x, position.y, position.z);
+}
+
+// Write the shared card transformed by a card matrix, four vertices per quad
+static void WriteLeafCard(FXMMATRIX transform, uint32_t quads, XMFLOAT3* positions, XMFLOAT3* normals, XMFLOAT2* uvs) {
+	static const XMFLOAT2 corners[4] = { { -0.5f, 0.0f }, { 0.5f, 0.0f }, { 0.5f, 1.0f }, { -0.5f, 1.0f } };
+	for (uint32_t q = 0; q < quads; ++q) {
+		// Quads are spread evenly over half a turn so they cross at the card's axis
+		const float angle = XM_PI * static_cast<float>(q) / static_cast<float>(quads);
+		const float c = cosf(angle);
+		const float s = sinf(angle);
+		XMVECTOR normal = XMVector3Normalize(XMVector3TransformNormal(XMVectorSet(-s, 0.0f, c, 0.0f), transform));
+		for (uint32_t k = 0; k < 4; ++k) {
+			const uint32_t v = q * 4 + k;
+			XMVECTOR local = XMVectorSet(corners[k].x * c, corners[k].y, corners[k].x * s, 1.0f);
+			XMStoreFloat3(&positions[v], XMVector3Transform(local, transform));
+			XMStoreFloat3(&normals[v], normal);
+			if (uvs != nullptr) {
+				uvs[v] = XMFLOAT2(corners[k].x + 0.5f, 1.0f - corners[k].y);
+			}
+		}
+	}
+}
+
+static void AppendLeafCardIndices(uint32_t firstVertex, uint32_t quads, std::vector<uint32_t>& indices) {
+	for (uint32_t q = 0; q < quads; ++q) {
+		const uint32_t base = firstVertex + q * 4;
+		indices.insert(indices.end(), { base, base + 1, base + 2, base, base + 2, base + 3 });
+	}
+}
+
+void GenerateLeafTexture(uint32_t size, std::vector<uint32_t>& pixels) {
+	size = std::max(size, 4u);
+	pixels.assign(size * size, 0);
+	for (uint32_t y = 0; y < size; ++y) {
+		// 0 at the stalk, 1 at the tip, a short stalk before the blade starts
+		const float along = 1.0f - (static_cast<float>(y) + 0.5f) / static_cast<float>(size);
+		const float blade = std::clamp((along - 0.08f) / 0.92f, 0.0f, 1.0f);
+		const float halfWidth = along < 0.08f ? 0.02f : 0.45f * powf(sinf(XM_PI * blade), 0.7f);
+		for (uint32_t x = 0; x < size; ++x) {
+			const float across = std::abs((static_cast<float>(x) + 0.5f) / static_cast<float>(size) - 0.5f);
+			if (across > halfWidth) {
+				continue;
+			}
+			// Slightly darker midrib and edge
+			const float shade = across < 0.015f ? 0.75f : 0.85f + 0.15f * (1.0f - across / halfWidth);
+			const uint32_t value = static_cast<uint32_t>(std::clamp(shade, 0.0f, 1.0f) * 255.0f + 0.5f);
+			pixels[y * size + x] = value | (value << 8) | (value << 16) | 0xFF000000u;
+		}
+	}
+}
+
+// Geometry of a single LOD level while the hierarchy is being traversed
+struct LevelBuffers {
+	std::vector<XMFLOAT3> positions;
+	std::vector<XMFLOAT3> normals;
+	std::vector<XMFLOAT2> uvs;
+	std::vector<uint32_t> indices;
+	std::vector<uint32_t> foliageIndices;
+	std::vector<TreeMeshSpan> spans;
+	std::vector<uint32_t> chainBase;  // Node each node's cylinder starts from, UINT32_MAX until assigned
+	float cullRadius = 0.0f;
+	float collinearCos = 2.0f;        // Above any dot product when merging is disabled
+};
+
+void GenerateMesh(const std::vector<LSystemGeneration>& generations, const TreeMeshSettings& settings, TreeMeshData& mesh) {
+	std::vector<const LSystemNode*> nodes = flattenGenerations(generations);
+	LSystemHierarchy hierarchy = buildHierarchy(generations);
+	const uint32_t nodeCount = static_cast<uint32_t>(nodes.size());
+
+	float maxRadius = 0.0f;
+	for (const LSystemNode* node : nodes) {
+		maxRadius = std::max(maxRadius, node->radius);
+	}
+
+	const uint32_t levelCount = std::clamp(static_cast<uint32_t>(settings.lods.size()), 1u, kMaxLODLevels);
+	std::vector<LevelBuffers> levels(levelCount);
+	for (uint32_t l = 0; l < levelCount; ++l) {
+		const TreeLODLevel lod = l < settings.lods.size() ? settings.lods[l] : TreeLODLevel{};
+		levels[l].cullRadius = lod.cullRadiusRatio * maxRadius;
+		if (lod.collinearAngle > 0.0f) {
+			levels[l].collinearCos = cosf(XMConvertToRadians(lod.collinearAngle));
+		}
+		levels[l].chainBase.assign(nodeCount, UINT32_MAX);
+	}
+
+	// Bit l is set when a node is culled from level l
+	std::vector<uint8_t> culled(nodeCount, 0);
+
+	for (uint32_t nodeIndex : hierarchy.order) {
+		const LSystemNode& node = *nodes[nodeIndex];
+		const int parent = hierarchy.parents[nodeIndex];
+		const uint32_t childCount = hierarchy.childCount(nodeIndex);
+		const LSystemNode* child = childCount == 1 ? nodes[hierarchy.children[hierarchy.childOffsets[nodeIndex]]] : nullptr;
+		const uint32_t childIndex = child != nullptr ? hierarchy.children[hierarchy.childOffsets[nodeIndex]] : UINT32_MAX;
+
+		// Only a single child that continues exactly where this node ends and keeps its type can extend the cylinder
+		float continuationCos = -2.0f;
+		if (child != nullptr && child->type == node.type) {
+			float gap = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&child->position), NodeEnd(node))));
+			if (gap <= 0.01f * node.length + 1e-5f) {
+				XMVECTOR up = XMVectorSet(0, 1, 0, 0);
+				continuationCos = XMVectorGetX(XMVector3Dot(XMVector3Rotate(up, NodeRotation(node)), XMVector3Rotate(up, NodeRotation(*child))));
+			}
+		}
+
+		// Foliage is placed as transformed copies of the shared card, and only disappears with its parent
+		if (IsCardNode(node, settings)) {
+			const XMMATRIX cardTransform = LeafCardMatrix(node);
+			for (uint32_t l = 0; l < levelCount; ++l) {
+				LevelBuffers& level = levels[l];
+				const uint8_t bit = static_cast<uint8_t>(1u << l);
+				if (parent >= 0 && (culled[parent] & bit)) {
+					culled[nodeIndex] |= bit;
+					continue;
+				}
+				const uint32_t quads = l == 0 ? std::max(1u, settings.leafCardQuads) : 1u;
+				const uint32_t firstVertex = static_cast<uint32_t>(level.positions.size());
+				level.positions.resize(firstVertex + quads * 4);
+				level.normals.resize(firstVertex + quads * 4);
+				level.uvs.resize(firstVertex + quads * 4);
+				WriteLeafCard(cardTransform, quads, &level.positions[firstVertex], &level.normals[firstVertex], &level.uvs[firstVertex]);
+				AppendLeafCardIndices(firstVertex, quads, level.foliageIndices);
+				level.spans.push_back({ nodeIndex, nodeIndex, firstVertex, quads * 4, l, TreeMeshPart::Foliage });
+			}
+			continue;
+		}
+
+		for (uint32_t l = 0; l < levelCount; ++l) {
+			LevelBuffers& level = levels[l];
+			const uint8_t bit = static_cast<uint8_t>(1u << l);
+			if ((parent >= 0 && (culled[parent] & bit)) || node.radius < level.cullRadius) {
+				culled[nodeIndex] |= bit;
+				continue;
+			}
+
+			if (level.chainBase[nodeIndex] == UINT32_MAX) {
+				level.chainBase[nodeIndex] = nodeIndex;
+			}
+			if (continuationCos >= level.collinearCos && child->radius >= level.cullRadius) {
+				level.chainBase[childIndex] = level.chainBase[nodeIndex];
+				continue;
+			}
+
+			const uint32_t segments = std::max(3u, l < settings.lods.size() ? settings.lods[l].segments : 16u);
+			const uint32_t firstVertex = static_cast<uint32_t>(level.positions.size());
+			const uint32_t vertexCount = CylinderVertexCount(segments);
+			level.positions.resize(firstVertex + vertexCount);
+			level.normals.resize(firstVertex + vertexCount);
+			level.uvs.resize(firstVertex + vertexCount);
+			WriteCylinder(*nodes[level.chainBase[nodeIndex]], node, segments, &level.positions[firstVertex], &level.normals[firstVertex], &level.uvs[firstVertex]);
+			AppendCylinderIndices(firstVertex, segments, level.indices);
+			level.spans.push_back({ nodeIndex, level.chainBase[nodeIndex], firstVertex, vertexCount, l });
+		}
+	}
+
+	// Concatenate the levels, every level indexes into the shared vertex arrays
+	mesh = TreeMeshData();
+	size_t vertexTotal = 0;
+	size_t indexTotal = 0;
+	size_t spanTotal = 0;
+	bool hasFoliage = false;
+	for (const auto& level : levels) {
+		vertexTotal += level.positions.size();
+		indexTotal += level.indices.size() + level.foliageIndices.size();
+		spanTotal += level.spans.size();
+		hasFoliage |= !level.foliageIndices.empty();
+	}
+	mesh.vertex_positions.reserve(vertexTotal);
+	mesh.vertex_normals.reserve(vertexTotal);
+	mesh.vertex_uvs.reserve(vertexTotal);
+	mesh.indices.reserve(indexTotal);
+	mesh.spans.reserve(spanTotal);
+
+	for (uint32_t l = 0; l < levelCount; ++l) {
+		LevelBuffers& level = levels[l];
+		const uint32_t vertexOffset = static_cast<uint32_t>(mesh.vertex_positions.size());
+		const uint32_t indexOffset = static_cast<uint32_t>(mesh.indices.size());
+
+		mesh.vertex_positions.insert(mesh.vertex_positions.end(), level.positions.begin(), level.positions.end());
+		mesh.vertex_normals.insert(mesh.vertex_normals.end(), level.normals.begin(), level.normals.end());
+		mesh.vertex_uvs.insert(mesh.vertex_uvs.end(), level.uvs.begin(), level.uvs.end());
+		for (uint32_t index : level.indices) {
+			mesh.indices.push_back(index + vertexOffset);
+		}
+		for (TreeMeshSpan span : level.spans) {
+			span.firstVertex += vertexOffset;
+			mesh.spans.push_back(span);
+		}
+		mesh.subsets.push_back({ indexOffset, static_cast<uint32_t>(level.indices.size()), l, TreeMeshPart::Bark });
+
+		// Every level gets a foliage subset once any level has one, so subsets stay uniform per LOD
+		if (hasFoliage) {
+			const uint32_t foliageOffset = static_cast<uint32_t>(mesh.indices.size());
+			for (uint32_t index : level.foliageIndices) {
+				mesh.indices.push_back(index + vertexOffset);
+			}
+			mesh.subsets.push_back({ foliageOffset, static_cast<uint32_t>(level.foliageIndices.size()), l, TreeMeshPart::Foliage });
+		}
+	}
+}
+
+void GenerateUnitCylinder(uint32_t segments, TreeMeshData& mesh) {
+	segments = std::max(3u, segments);
+	LSystemNode unit{};
+	unit.length = 1.0f;
+	unit.radius = 1.0f;
+	unit.rotation = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+
+	const uint32_t vertexCount = CylinderVertexCount(segments);
+	mesh = TreeMeshData();
+	mesh.vertex_positions.resize(vertexCount);
+	mesh.vertex_normals.resize(vertexCount);
+	mesh.vertex_uvs.resize(vertexCount);
+	WriteCylinder(unit, unit, segments, mesh.vertex_positions.data(), mesh.vertex_normals.data(), mesh.vertex_uvs.data());
+	AppendCylinderIndices(0, segments, mesh.indices);
+	mesh.subsets.push_back({ 0, static_cast<uint32_t>(mesh.indices.size()), 0 });
+}
+
+void RewriteSpan(const std::vector<const LSystemNode*>& nodes, const TreeMeshSpan& span, XMFLOAT3* positions, XMFLOAT3* normals) {
+	if (span.part == TreeMeshPart::Foliage) {
+		WriteLeafCard(LeafCardMatrix(*nodes[span.node]), span.vertexCount / 4, positions, normals, nullptr);
+		return;
+	}
+	const uint32_t segments = span.vertexCount / 2 - 1;
+	WriteCylinder(*nodes[span.baseNode], *nodes[span.node], segments, positions, normals, nullptr);
+}
+
+void ApplyVertexRemap(TreeMeshData& mesh, const std::vector<uint32_t>& remap, uint32_t newVertexCount) {
+	std::vector<XMFLOAT3> positions(newVertexCount);
+	std::vector<XMFLOAT3> normals(newVertexCount);
+	std::vector<XMFLOAT2> uvs(newVertexCount);
+	for (size_t i = 0; i < remap.size(); ++i) {
+		positions[remap[i]] = mesh.vertex_positions[i];
+		normals[remap[i]] = mesh.vertex_normals[i];
+		uvs[remap[i]] = mesh.vertex_uvs[i];
+	}
+	mesh.vertex_positions = std::move(positions);
+	mesh.vertex_normals = std::move(normals);
+	mesh.vertex_uvs = std::move(uvs);
+
+	for (auto& index : mesh.indices) {
+		index = remap[index];
+	}
+
+	if (mesh.remap.empty()) {
+		mesh.remap = remap;
+	}
+	else {
+		for (auto& target : mesh.remap) {
+			target = remap[target];
+		}
+	}
+}
+
+void WeldVertices(TreeMeshData& mesh) {
+	std::unordered_map<Vertex, uint32_t> uniqueVertices;
+	uniqueVertices.reserve(mesh.vertex_positions.size());
+	std::vector<uint32_t> remap(mesh.vertex_positions.size());
+	uint32_t weldedCount = 0;
+
+	for (size_t i = 0; i < mesh.vertex_positions.size(); ++i) {
+		Vertex vertex = { mesh.vertex_positions[i], mesh.vertex_normals[i], mesh.vertex_uvs[i] };
+		auto result = uniqueVertices.emplace(vertex, weldedCount);
+		if (result.second) {
+			weldedCount++;
+		}
+		remap[i] = result.first->second;
+	}
+
+	if (weldedCount == mesh.vertex_positions.size()) {
+		return; // Nothing to merge, keep the identity mapping
+	}
+	ApplyVertexRemap(mesh, remap, weldedCount);
+}
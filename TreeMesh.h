@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+
+// Forward declaration of LSystemNode
+class LSystemNode;
+
+using LSystemGeneration = std::vector<LSystemNode>;
+
+// Detail settings for one level of the LOD chain
+struct TreeLODLevel {
+	uint32_t segments = 16;         // Number of segments around each cylinder
+	float cullRadiusRatio = 0.0f;   // Nodes thinner than this fraction of the thickest node are culled with their children
+	float collinearAngle = 0.0f;    // Max bend in degrees for a node and its only child to be merged into one cylinder, 0 disables merging
+};
+
+// Options controlling how the L-system is turned into triangles
+struct TreeMeshSettings {
+	std::vector<TreeLODLevel> lods = { TreeLODLevel{} }; // LOD0 first, at most 8 levels
+	bool optimizeVertexCache = true;                      // Reorder triangles and vertices for the GPU after welding
+	bool leafCards = true;                                // Leaf and Decal nodes become alpha-tested cards in their own subset
+	uint32_t leafCardQuads = 2;                           // Crossed quads per card at LOD0, lower levels use a single quad
+	bool buildMeshlets = false;                           // Partition the final mesh into clusters for fine grained culling and streaming
+	uint32_t meshletMaxVertices = 64;
+	uint32_t meshletMaxTriangles = 124;
+	bool buildSkeleton = false;                           // Emit an armature with per-vertex bone weights so growth and sway can be posed on the GPU
+	uint32_t maxBones = 256;
+
+	// Four level chain from full detail down to a trunk and main limbs
+	static TreeMeshSettings LODChain();
+};
+
+// Which material a subset or span is drawn with
+enum class TreeMeshPart : uint32_t {
+	Bark,
+	Foliage
+};
+
+// A run of generated vertices that belongs to one node at one LOD level
+struct TreeMeshSpan {
+	uint32_t node;          // Flat index of the node the span ends at
+	uint32_t baseNode;      // Flat index of the node the span starts at, differs from node when collinear nodes were merged
+	uint32_t firstVertex;   // In generation order, see TreeMeshData::remap
+	uint32_t vertexCount;
+	uint32_t lod;
+	TreeMeshPart part = TreeMeshPart::Bark;
+};
+
+struct TreeMeshSubset {
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	uint32_t lod;
+	TreeMeshPart part = TreeMeshPart::Bark;
+};
+
+// CPU-side tree geometry, independent of the scene so it can be built and inspected headless
+struct TreeMeshData {
+	std::vector<DirectX::XMFLOAT3> vertex_positions;
+	std::vector<DirectX::XMFLOAT3> vertex_normals;
+	std::vector<DirectX::XMFLOAT2> vertex_uvs;
+	std::vector<uint32_t> indices;
+	std::vector<TreeMeshSubset> subsets;  // Ordered by LOD level, bark then foliage within a level when the tree has cards
+	std::vector<TreeMeshSpan> spans;
+	std::vector<uint32_t> remap;          // Generated vertex -> current vertex, empty while vertices are still in generation order
+
+	uint32_t GetLODCount() const;
+	uint32_t GetSubsetsPerLOD() const;
+};
+
+// Mesh every node of every generation, all LOD levels are produced in a single traversal of the hierarchy
+void GenerateMesh(const std::vector<LSystemGeneration>& generations, const TreeMeshSettings& settings, TreeMeshData& mesh);
+
+// Radius 1, height 1 cylinder along +Y with its base at the origin, shared by instanced segments
+void GenerateUnitCylinder(uint32_t segments, TreeMeshData& mesh);
+
+// Object to tree matrix that places a leaf card (quads crossed around +Y, one unit wide and tall) on a Leaf or Decal node
+DirectX::XMMATRIX LeafCardMatrix(const LSystemNode& node);
+
+// RGBA8 leaf for the card UVs, base at v = 1. White with an alpha cutout, the foliage material's base color tints it.
+void GenerateLeafTexture(uint32_t size, std::vector<uint32_t>& pixels);
+
+// Node rotation as a unit quaternion, nodes saved without a rotation point straight up
+DirectX::XMVECTOR NodeRotation(const LSystemNode& node);
+
+// Tip of a node: its position moved by length along its rotated +Y axis
+DirectX::XMVECTOR NodeEnd(const LSystemNode& node);
+
+// Regenerate the positions and normals of one span from the current node data, indexed in generation order
+void RewriteSpan(const std::vector<const LSystemNode*>& nodes, const TreeMeshSpan& span, DirectX::XMFLOAT3* positions, DirectX::XMFLOAT3* normals);
+
+// Merge identical vertices and rewrite the indices to match
+void WeldVertices(TreeMeshData& mesh);
+
+// Move vertex i to remap[i] (several vertices may share a target) and update indices and TreeMeshData::remap
+void ApplyVertexRemap(TreeMeshData& mesh, const std::vector<uint32_t>& remap, uint32_t newVertexCount);
@@ -0,0 +1,361 @@
+#include "TreeMeshCache.h"
+#include "TwoOLSystem.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr uint32_t kTreeMeshCacheMagic = 0x31434D54; // "TMC1"
+static constexpr uint64_t kSectionAlignment = 16;
+
+// Node data is hashed straight from the generation arrays, which needs a layout without padding
+static_assert(std::is_trivially_copyable<LSystemNode>::value, "LSystemNode is hashed as raw bytes");
+static_assert(sizeof(LSystemNode) == 14 * 4, "LSystemNode has padding, hash its fields one by one instead");
+static_assert(std::is_trivially_copyable<TreeMeshSubset>::value && std::is_trivially_copyable<TreeMeshSpan>::value, "Cached arrays are written as raw bytes");
+
+static constexpr uint64_t kPrime1 = 11400714785074694791ULL;
+static constexpr uint64_t kPrime2 = 14029467366897019727ULL;
+static constexpr uint64_t kPrime3 = 1609587929392839161ULL;
+static constexpr uint64_t kPrime4 = 9650029242287828579ULL;
+static constexpr uint64_t kPrime5 = 2870177450012600261ULL;
+
+static uint64_t RotateLeft(uint64_t value, int bits) {
+	return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t Read64(const uint8_t* p) {
+	uint64_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint32_t Read32(const uint8_t* p) {
+	uint32_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint64_t HashRound(uint64_t accumulator, uint64_t input) {
+	accumulator += input * kPrime2;
+	accumulator = RotateLeft(accumulator, 31);
+	return accumulator * kPrime1;
+}
+
+static uint64_t HashMergeRound(uint64_t hash, uint64_t accumulator) {
+	hash ^= HashRound(0, accumulator);
+	return hash * kPrime1 + kPrime4;
+}
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed) {
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	const uint8_t* end = p + size;
+	uint64_t hash;
+
+	if (size >= 32) {
+		uint64_t v1 = seed + kPrime1 + kPrime2;
+		uint64_t v2 = seed + kPrime2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - kPrime1;
+		const uint8_t* limit = end - 32;
+		do {
+			v1 = HashRound(v1, Read64(p));
+			v2 = HashRound(v2, Read64(p + 8));
+			v3 = HashRound(v3, Read64(p + 16));
+			v4 = HashRound(v4, Read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+		hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+		hash = HashMergeRound(hash, v1);
+		hash = HashMergeRound(hash, v2);
+		hash = HashMergeRound(hash, v3);
+		hash = HashMergeRound(hash, v4);
+	}
+	else {
+		hash = seed + kPrime5;
+	}
+	hash += size;
+
+	for (; p + 8 <= end; p += 8) {
+		hash ^= HashRound(0, Read64(p));
+		hash = RotateLeft(hash, 27) * kPrime1 + kPrime4;
+	}
+	if (p + 4 <= end) {
+		hash ^= Read32(p) * kPrime1;
+		hash = RotateLeft(hash, 23) * kPrime2 + kPrime3;
+		p += 4;
+	}
+	for (; p < end; ++p) {
+		hash ^= *p * kPrime5;
+		hash = RotateLeft(hash, 11) * kPrime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= kPrime2;
+	hash ^= hash >> 29;
+	hash *= kPrime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+uint64_t HashTreeMeshKey(const std::vector<LSystemGeneration>& generations, const TreeMeshSettings& settings) {
+	// Settings first, flattened into plain words so padding never reaches the hash
+	std::vector<uint32_t> words = {
+		kTreeMeshCacheVersion,
+		settings.optimizeVertexCache ? 1u : 0u,
+		settings.leafCards ? 1u : 0u,
+		settings.leafCardQuads,
+		static_cast<uint32_t>(settings.lods.size()),
+	};
+	for (const auto& lod : settings.lods) {
+		uint32_t cullRadiusRatio;
+		uint32_t collinearAngle;
+		std::memcpy(&cullRadiusRatio, &lod.cullRadiusRatio, sizeof(float));
+		std::memcpy(&collinearAngle, &lod.collinearAngle, sizeof(float));
+		words.insert(words.end(), { lod.segments, cullRadiusRatio, collinearAngle });
+	}
+	uint64_t hash = HashBytes(words.data(), words.size() * sizeof(uint32_t));
+
+	// Generation boundaries matter to the mesher, so each generation is hashed on its own and chained
+	for (const auto& generation : generations) {
+		hash = HashBytes(generation.data(), generation.size() * sizeof(LSystemNode), hash);
+	}
+	return HashBytes(nullptr, 0, hash ^ generations.size());
+}
+
+std::string TreeMeshCachePath(const std::string& directory, uint64_t key) {
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.tmc", static_cast<unsigned long long>(key));
+	return (std::filesystem::path(directory) / name).string();
+}
+
+// Pointer and size of every cached array, in file order
+struct CacheSection {
+	const void* data;
+	size_t size;
+};
+
+static void GetSections(const TreeMeshData& mesh, CacheSection sections[7]) {
+	sections[0] = { mesh.vertex_positions.data(), mesh.vertex_positions.size() * sizeof(DirectX::XMFLOAT3) };
+	sections[1] = { mesh.vertex_normals.data(), mesh.vertex_normals.size() * sizeof(DirectX::XMFLOAT3) };
+	sections[2] = { mesh.vertex_uvs.data(), mesh.vertex_uvs.size() * sizeof(DirectX::XMFLOAT2) };
+	sections[3] = { mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t) };
+	sections[4] = { mesh.subsets.data(), mesh.subsets.size() * sizeof(TreeMeshSubset) };
+	sections[5] = { mesh.spans.data(), mesh.spans.size() * sizeof(TreeMeshSpan) };
+	sections[6] = { mesh.remap.data(), mesh.remap.size() * sizeof(uint32_t) };
+}
+
+static uint64_t ChecksumSections(const CacheSection sections[7]) {
+	uint64_t hash = 0;
+	for (int i = 0; i < 7; ++i) {
+		hash = HashBytes(sections[i].data, sections[i].size, hash);
+	}
+	return hash;
+}
+
+bool SaveTreeMeshCache(const std::string& path, uint64_t key, const TreeMeshData& mesh) {
+	CacheSection sections[7];
+	GetSections(mesh, sections);
+
+	TreeMeshCacheHeader header = {};
+	header.magic = kTreeMeshCacheMagic;
+	header.version = kTreeMeshCacheVersion;
+	header.key = key;
+	header.checksum = ChecksumSections(sections);
+	header.vertexCount = static_cast<uint32_t>(mesh.vertex_positions.size());
+	header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+	header.subsetCount = static_cast<uint32_t>(mesh.subsets.size());
+	header.spanCount = static_cast<uint32_t>(mesh.spans.size());
+	header.remapCount = static_cast<uint32_t>(mesh.remap.size());
+	uint64_t offset = sizeof(TreeMeshCacheHeader);
+	for (int i = 0; i < 7; ++i) {
+		offset = (offset + kSectionAlignment - 1) & ~(kSectionAlignment - 1);
+		header.offsets[i] = offset;
+		offset += sections[i].size;
+	}
+
+	std::error_code error;
+	std::filesystem::path target(path);
+	if (target.has_parent_path()) {
+		std::filesystem::create_directories(target.parent_path(), error);
+	}
+	std::filesystem::path temporary = target;
+	temporary += ".tmp";
+
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		static const char padding[kSectionAlignment] = {};
+		uint64_t written = sizeof(header);
+		for (int i = 0; i < 7; ++i) {
+			file.write(padding, static_cast<std::streamsize>(header.offsets[i] - written));
+			file.write(static_cast<const char*>(sections[i].data), static_cast<std::streamsize>(sections[i].size));
+			written = header.offsets[i] + sections[i].size;
+		}
+		if (!file) {
+			file.close();
+			std::filesystem::remove(temporary, error);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(temporary, target, error);
+	if (error) {
+		std::filesystem::remove(temporary, error);
+		return false;
+	}
+	return true;
+}
+
+// Read only view of a whole file, unmapped when it goes out of scope
+class MappedCacheFile {
+public:
+	MappedCacheFile() = default;
+	MappedCacheFile(const MappedCacheFile&) = delete;
+	MappedCacheFile& operator=(const MappedCacheFile&) = delete;
+	~MappedCacheFile();
+	bool Open(const std::string& path);
+	const char* GetData() const { return view; }
+	uint64_t GetSize() const { return size; }
+
+private:
+	const char* view = nullptr;
+	uint64_t size = 0;
+#ifdef _WIN32
+	HANDLE fileHandle = INVALID_HANDLE_VALUE;
+	HANDLE mappingHandle = nullptr;
+#else
+	int descriptor = -1;
+#endif
+};
+
+#ifdef _WIN32
+
+bool MappedCacheFile::Open(const std::string& path) {
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	LARGE_INTEGER fileSize;
+	if (fileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart <= 0) {
+		return false;
+	}
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	void* mapped = mappingHandle != nullptr ? MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (mapped == nullptr) {
+		return false;
+	}
+	view = static_cast<const char*>(mapped);
+	size = static_cast<uint64_t>(fileSize.QuadPart);
+	return true;
+}
+
+MappedCacheFile::~MappedCacheFile() {
+	if (view != nullptr) {
+		UnmapViewOfFile(view);
+	}
+	if (mappingHandle != nullptr) {
+		CloseHandle(mappingHandle);
+	}
+	if (fileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(fileHandle);
+	}
+}
+
+#else
+
+bool MappedCacheFile::Open(const std::string& path) {
+	descriptor = open(path.c_str(), O_RDONLY);
+	struct stat status;
+	if (descriptor < 0 || fstat(descriptor, &status) != 0 || status.st_size <= 0) {
+		return false;
+	}
+	void* mapped = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+	view = static_cast<const char*>(mapped);
+	size = static_cast<uint64_t>(status.st_size);
+	return true;
+}
+
+MappedCacheFile::~MappedCacheFile() {
+	if (view != nullptr) {
+		munmap(const_cast<char*>(view), static_cast<size_t>(size));
+	}
+	if (descriptor >= 0) {
+		close(descriptor);
+	}
+}
+
+#endif
+
+template <typename T>
+static void CopySection(const CacheSection& section, std::vector<T>& target) {
+	target.resize(section.size / sizeof(T));
+	if (section.size > 0) {
+		std::memcpy(target.data(), section.data, section.size);
+	}
+}
+
+bool LoadTreeMeshCache(const std::string& path, uint64_t key, TreeMeshData& mesh) {
+	MappedCacheFile file;
+	if (!file.Open(path) || file.GetSize() < sizeof(TreeMeshCacheHeader)) {
+		return false;
+	}
+	TreeMeshCacheHeader header;
+	std::memcpy(&header, file.GetData(), sizeof(header));
+	if (header.magic != kTreeMeshCacheMagic || header.version != kTreeMeshCacheVersion || header.key != key) {
+		return false;
+	}
+
+	// Reject headers whose arrays would run past the end, then checksum the arrays in place before copying anything
+	const uint64_t fileSize = file.GetSize();
+	const uint64_t sizes[7] = {
+		header.vertexCount * uint64_t(sizeof(DirectX::XMFLOAT3)),
+		header.vertexCount * uint64_t(sizeof(DirectX::XMFLOAT3)),
+		header.vertexCount * uint64_t(sizeof(DirectX::XMFLOAT2)),
+		header.indexCount * uint64_t(sizeof(uint32_t)),
+		header.subsetCount * uint64_t(sizeof(TreeMeshSubset)),
+		header.spanCount * uint64_t(sizeof(TreeMeshSpan)),
+		header.remapCount * uint64_t(sizeof(uint32_t)),
+	};
+	CacheSection sections[7];
+	for (int i = 0; i < 7; ++i) {
+		if (header.offsets[i] > fileSize || sizes[i] > fileSize - header.offsets[i]) {
+			return false;
+		}
+		sections[i].data = file.GetData() + header.offsets[i];
+		sections[i].size = static_cast<size_t>(sizes[i]);
+	}
+	if (ChecksumSections(sections) != header.checksum) {
+		return false;
+	}
+
+	TreeMeshData loaded;
+	CopySection(sections[0], loaded.vertex_positions);
+	CopySection(sections[1], loaded.vertex_normals);
+	CopySection(sections[2], loaded.vertex_uvs);
+	CopySection(sections[3], loaded.indices);
+	CopySection(sections[4], loaded.subsets);
+	CopySection(sections[5], loaded.spans);
+	CopySection(sections[6], loaded.remap);
+
+	mesh = std::move(loaded);
+	return true;
+}
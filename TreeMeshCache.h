@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "TreeMesh.h"
+
+// Bumped whenever the meshing output or the file layout changes, old cache files then miss
+static constexpr uint32_t kTreeMeshCacheVersion = 1;
+
+// File layout: this header, then positions, normals, uvs, indices, subsets, spans and remap as raw arrays.
+// Every array starts on a 16 byte boundary at the offset given here, so a mapped file can be read in place.
+struct TreeMeshCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;          // HashTreeMeshKey of the tree and settings the mesh was built from
+	uint64_t checksum;     // Hash of the arrays, catches truncated or damaged files
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t subsetCount;
+	uint32_t spanCount;
+	uint32_t remapCount;
+	uint32_t reserved;
+	uint64_t offsets[7];
+};
+
+// 64-bit xxHash of a byte range
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+// Identifies a tree mesh by the raw node data of every generation and every setting that changes the output
+uint64_t HashTreeMeshKey(const std::vector<LSystemGeneration>& generations, const TreeMeshSettings& settings);
+
+// "<directory>/<key as 16 hex digits>.tmc"
+std::string TreeMeshCachePath(const std::string& directory, uint64_t key);
+
+// Write the welded, optimized mesh with its spans and remap, through a temporary file so readers never see half a file
+bool SaveTreeMeshCache(const std::string& path, uint64_t key, const TreeMeshData& mesh);
+
+// Maps the file, checks it in place and copies the arrays out of the mapping.
+// False when the file is missing, from another version or key, or damaged.
+bool LoadTreeMeshCache(const std::string& path, uint64_t key, TreeMeshData& mesh);
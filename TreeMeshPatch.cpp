@@ -0,0 +1,172 @@
+#include "TreeMeshPatch.h"
+#include "TwoOLSystem.h"
+#include <algorithm>
+#include <cfloat>
+
+using namespace DirectX;
+
+static constexpr uint32_t kMaxRangeGap = 8;   // Vertices re-sent rather than starting another copy
+
+void TreeMeshPatch::Clear() {
+	layout = 0;
+	sequence = 0;
+	ranges.clear();
+	positions.clear();
+	normals.clear();
+}
+
+void TreeMeshPatcher::SetLayout(const std::vector<LSystemGeneration>& generations, const TreeMeshData& mesh) {
+	std::vector<const LSystemNode*> nodes = flattenGenerations(generations);
+	const uint32_t nodeCount = static_cast<uint32_t>(nodes.size());
+
+	std::lock_guard<std::mutex> guard(lock);
+	layout++;
+	sequence = 0;
+	accepted = 0;
+
+	nodeSizes.resize(nodeCount);
+	for (uint32_t i = 0; i < nodeCount; ++i) {
+		nodeSizes[i] = XMFLOAT2(nodes[i]->length, nodes[i]->radius);
+	}
+
+	// A span depends on the node it ends at and on the node its chain starts from
+	nodeSpanOffsets.assign(nodeCount + 1, 0);
+	for (const auto& span : mesh.spans) {
+		nodeSpanOffsets[span.node + 1]++;
+		if (span.baseNode != span.node) {
+			nodeSpanOffsets[span.baseNode + 1]++;
+		}
+	}
+	for (uint32_t i = 0; i < nodeCount; ++i) {
+		nodeSpanOffsets[i + 1] += nodeSpanOffsets[i];
+	}
+	nodeSpans.resize(nodeSpanOffsets[nodeCount]);
+	std::vector<uint32_t> fill(nodeSpanOffsets.begin(), nodeSpanOffsets.end() - 1);
+	for (uint32_t s = 0; s < mesh.spans.size(); ++s) {
+		const TreeMeshSpan& span = mesh.spans[s];
+		nodeSpans[fill[span.node]++] = s;
+		if (span.baseNode != span.node) {
+			nodeSpans[fill[span.baseNode]++] = s;
+		}
+	}
+
+	spans = mesh.spans;
+	remap = mesh.remap;
+	spanSequences.assign(spans.size(), 0);
+	positions = mesh.vertex_positions;
+	normals = mesh.vertex_normals;
+}
+
+void TreeMeshPatcher::Reset() {
+	std::lock_guard<std::mutex> guard(lock);
+	layout++;
+	sequence = 0;
+	accepted = 0;
+	spans.clear();
+	remap.clear();
+	nodeSpanOffsets.clear();
+	nodeSpans.clear();
+	nodeSizes.clear();
+	spanSequences.clear();
+	positions.clear();
+	normals.clear();
+}
+
+bool TreeMeshPatcher::MakePatch(const std::vector<LSystemGeneration>& generations, TreeMeshPatch& patch) {
+	std::vector<const LSystemNode*> nodes = flattenGenerations(generations);
+
+	std::lock_guard<std::mutex> guard(lock);
+	patch.Clear();
+	patch.layout = layout;
+	if (spans.empty() || nodes.size() != nodeSizes.size()) {
+		return false;
+	}
+	patch.sequence = ++sequence;
+
+	// Rewrite the spans of nodes that changed length or radius since the last call into the rest pose copy
+	for (uint32_t i = 0; i < nodes.size(); ++i) {
+		XMFLOAT2 size(nodes[i]->length, nodes[i]->radius);
+		if (size.x == nodeSizes[i].x && size.y == nodeSizes[i].y) {
+			continue;
+		}
+		nodeSizes[i] = size;
+		for (uint32_t k = nodeSpanOffsets[i]; k < nodeSpanOffsets[i + 1]; ++k) {
+			spanSequences[nodeSpans[k]] = sequence;
+		}
+	}
+	dirtyVertices.clear();
+	for (uint32_t s = 0; s < spans.size(); ++s) {
+		if (spanSequences[s] != sequence) {
+			continue;
+		}
+		const TreeMeshSpan& span = spans[s];
+		spanPositions.resize(span.vertexCount);
+		spanNormals.resize(span.vertexCount);
+		RewriteSpan(nodes, span, spanPositions.data(), spanNormals.data());
+		for (uint32_t v = 0; v < span.vertexCount; ++v) {
+			const uint32_t target = remap.empty() ? span.firstVertex + v : remap[span.firstVertex + v];
+			positions[target] = spanPositions[v];
+			normals[target] = spanNormals[v];
+		}
+	}
+
+	// Everything the render thread has not accepted yet, from this call or from patches it skipped
+	for (uint32_t s = 0; s < spans.size(); ++s) {
+		if (spanSequences[s] <= accepted) {
+			continue;
+		}
+		const TreeMeshSpan& span = spans[s];
+		for (uint32_t v = 0; v < span.vertexCount; ++v) {
+			dirtyVertices.push_back(remap.empty() ? span.firstVertex + v : remap[span.firstVertex + v]);
+		}
+	}
+	if (dirtyVertices.empty()) {
+		return true;
+	}
+
+	// Coalesce into ranges, small gaps are cheaper to re-send than to split
+	std::sort(dirtyVertices.begin(), dirtyVertices.end());
+	dirtyVertices.erase(std::unique(dirtyVertices.begin(), dirtyVertices.end()), dirtyVertices.end());
+	for (uint32_t v : dirtyVertices) {
+		if (!patch.ranges.empty() && v <= patch.ranges.back().x + patch.ranges.back().y + kMaxRangeGap) {
+			patch.ranges.back().y = v - patch.ranges.back().x + 1;
+		}
+		else {
+			patch.ranges.push_back(XMUINT2(v, 1));
+		}
+	}
+
+	XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+	for (const XMUINT2& range : patch.ranges) {
+		patch.positions.insert(patch.positions.end(), positions.begin() + range.x, positions.begin() + range.x + range.y);
+		patch.normals.insert(patch.normals.end(), normals.begin() + range.x, normals.begin() + range.x + range.y);
+		for (uint32_t v = range.x; v < range.x + range.y; ++v) {
+			XMVECTOR position = XMLoadFloat3(&positions[v]);
+			boundsMin = XMVectorMin(boundsMin, position);
+			boundsMax = XMVectorMax(boundsMax, position);
+		}
+	}
+	XMStoreFloat3(&patch.boundsMin, boundsMin);
+	XMStoreFloat3(&patch.boundsMax, boundsMax);
+	return true;
+}
+
+bool TreeMeshPatcher::Accept(const TreeMeshPatch& patch) {
+	std::lock_guard<std::mutex> guard(lock);
+	if (patch.layout != layout || patch.sequence == 0 || patch.sequence <= accepted) {
+		return false;
+	}
+	accepted = patch.sequence;
+	return true;
+}
+
+uint64_t TreeMeshPatcher::GetLayout() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return layout;
+}
+
+size_t TreeMeshPatcher::GetNodeCount() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return nodeSizes.size();
+}
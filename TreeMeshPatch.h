@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <DirectXMath.h>
+#include "TreeMesh.h"
+
+// Vertices of a meshed tree rewritten after nodes changed length or radius, ready to be copied to the GPU
+struct TreeMeshPatch {
+	uint64_t layout = 0;                        // Layout the patch was made against, see TreeMeshPatcher::SetLayout
+	uint64_t sequence = 0;                      // Order of the patch within its layout
+	std::vector<DirectX::XMUINT2> ranges;       // (first, count) in the mesh's final vertex order
+	std::vector<DirectX::XMFLOAT3> positions;   // Every vertex of every range, in range order
+	std::vector<DirectX::XMFLOAT3> normals;
+	DirectX::XMFLOAT3 boundsMin = DirectX::XMFLOAT3(0, 0, 0);   // Of the rewritten vertices, only valid with ranges
+	DirectX::XMFLOAT3 boundsMax = DirectX::XMFLOAT3(0, 0, 0);
+
+	// Empty and not from any layout, keeps the capacity
+	void Clear();
+};
+
+// Turns growth of a meshed tree into patches, off the thread that owns the mesh: a growth worker calls MakePatch on
+// every step and the render thread applies only the newest patch it sees. Patches are cumulative, each one holds every
+// span changed since the last patch the render thread accepted, so skipped patches lose nothing.
+// Keeps its own copy of the rest positions and normals so ranges can bridge small gaps. All calls are synchronized.
+class TreeMeshPatcher {
+public:
+	// Track a freshly meshed tree, call before its arrays are moved into the scene. Patches of earlier layouts are refused.
+	void SetLayout(const std::vector<LSystemGeneration>& generations, const TreeMeshData& mesh);
+	void Reset();
+
+	// Rewrite the spans of nodes that changed since the last call and fill patch with everything not yet accepted.
+	// False and an empty patch when there is no layout or the node count no longer matches it.
+	bool MakePatch(const std::vector<LSystemGeneration>& generations, TreeMeshPatch& patch);
+
+	// Render thread: true when patch belongs to the current layout and is newer than the last one accepted
+	bool Accept(const TreeMeshPatch& patch);
+
+	uint64_t GetLayout() const;
+	size_t GetNodeCount() const;
+
+	// Span layout of the tracked mesh. Only SetLayout and Reset change it, so their caller may read it without a lock.
+	const std::vector<TreeMeshSpan>& GetSpans() const { return spans; }
+	const std::vector<uint32_t>& GetRemap() const { return remap; }
+
+private:
+	mutable std::mutex lock;
+	uint64_t layout = 0;
+	uint64_t sequence = 0;                    // Of the last MakePatch
+	uint64_t accepted = 0;                    // Sequence of the last patch Accept returned true for
+	std::vector<TreeMeshSpan> spans;
+	std::vector<uint32_t> remap;
+	std::vector<uint32_t> nodeSpanOffsets;    // Spans touching node i are nodeSpans[nodeSpanOffsets[i] .. nodeSpanOffsets[i + 1])
+	std::vector<uint32_t> nodeSpans;
+	std::vector<DirectX::XMFLOAT2> nodeSizes; // Length and radius each node was last meshed with
+	std::vector<uint64_t> spanSequences;      // Sequence each span was last rewritten in
+	std::vector<DirectX::XMFLOAT3> positions; // Rest pose in final vertex order
+	std::vector<DirectX::XMFLOAT3> normals;
+	std::vector<DirectX::XMFLOAT3> spanPositions;
+	std::vector<DirectX::XMFLOAT3> spanNormals;
+	std::vector<uint32_t> dirtyVertices;
+};
@@ -0,0 +1,226 @@
+#include "TreeMeshlets.h"
+#include "TreeMesh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+// Bounds and normal cone of a finished meshlet
+static void ComputeMeshletBounds(const TreeMeshData& mesh, const TreeMeshletData& data, TreeMeshlet& meshlet, bool allowCone) {
+	XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+	for (uint32_t i = 0; i < meshlet.vertexCount; ++i) {
+		XMVECTOR position = XMLoadFloat3(&mesh.vertex_positions[data.vertices[meshlet.vertexOffset + i]]);
+		boundsMin = XMVectorMin(boundsMin, position);
+		boundsMax = XMVectorMax(boundsMax, position);
+	}
+	XMVECTOR center = XMVectorScale(XMVectorAdd(boundsMin, boundsMax), 0.5f);
+	float radius = 0.0f;
+	for (uint32_t i = 0; i < meshlet.vertexCount; ++i) {
+		XMVECTOR position = XMLoadFloat3(&mesh.vertex_positions[data.vertices[meshlet.vertexOffset + i]]);
+		radius = std::max(radius, XMVectorGetX(XMVector3Length(XMVectorSubtract(position, center))));
+	}
+	XMStoreFloat3(&meshlet.center, center);
+	meshlet.radius = radius;
+
+	// Cone axis is the average triangle normal, the cone is kept only if no triangle is more than ~84 degrees off it
+	meshlet.coneApex = meshlet.center;
+	meshlet.coneAxis = XMFLOAT3(0.0f, 1.0f, 0.0f);
+	meshlet.coneCutoff = 1.0f;
+	if (!allowCone) {
+		return;
+	}
+
+	std::vector<XMVECTOR> normals(meshlet.triangleCount);
+	std::vector<XMVECTOR> corners(meshlet.triangleCount);
+	XMVECTOR axis = XMVectorZero();
+	for (uint32_t t = 0; t < meshlet.triangleCount; ++t) {
+		const uint8_t* local = &data.triangles[meshlet.triangleOffset + t * 3];
+		XMVECTOR a = XMLoadFloat3(&mesh.vertex_positions[data.vertices[meshlet.vertexOffset + local[0]]]);
+		XMVECTOR b = XMLoadFloat3(&mesh.vertex_positions[data.vertices[meshlet.vertexOffset + local[1]]]);
+		XMVECTOR c = XMLoadFloat3(&mesh.vertex_positions[data.vertices[meshlet.vertexOffset + local[2]]]);
+		XMVECTOR normal = XMVector3Cross(XMVectorSubtract(b, a), XMVectorSubtract(c, a));
+		if (XMVectorGetX(XMVector3LengthSq(normal)) > 0.0f) {
+			normal = XMVector3Normalize(normal);
+		}
+		normals[t] = normal;
+		corners[t] = a;
+		axis = XMVectorAdd(axis, normal);
+	}
+	if (XMVectorGetX(XMVector3LengthSq(axis)) == 0.0f) {
+		return;
+	}
+	axis = XMVector3Normalize(axis);
+
+	float minDot = 1.0f;
+	for (const XMVECTOR& normal : normals) {
+		minDot = std::min(minDot, XMVectorGetX(XMVector3Dot(normal, axis)));
+	}
+	if (minDot <= 0.1f) {
+		return;
+	}
+
+	// Move the apex back along the axis until every triangle plane is in front of it
+	float maxT = 0.0f;
+	for (uint32_t t = 0; t < meshlet.triangleCount; ++t) {
+		const float dc = XMVectorGetX(XMVector3Dot(XMVectorSubtract(center, corners[t]), normals[t]));
+		const float dn = XMVectorGetX(XMVector3Dot(axis, normals[t]));
+		maxT = std::max(maxT, dc / dn);
+	}
+	XMStoreFloat3(&meshlet.coneApex, XMVectorSubtract(center, XMVectorScale(axis, maxT)));
+	XMStoreFloat3(&meshlet.coneAxis, axis);
+	meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+}
+
+void BuildMeshlets(const TreeMeshData& mesh, TreeMeshletData& data, uint32_t maxVertices, uint32_t maxTriangles, const std::vector<uint32_t>& noConeSubsets) {
+	data = TreeMeshletData();
+	maxVertices = std::clamp(maxVertices, 3u, 256u);
+	maxTriangles = std::max(maxTriangles, 1u);
+	const size_t vertexCount = mesh.vertex_positions.size();
+	const uint32_t triangleCount = static_cast<uint32_t>(mesh.indices.size() / 3);
+
+	// Triangles using each vertex
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (uint32_t index : mesh.indices) {
+		adjacencyOffsets[index + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; ++v) {
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	}
+	std::vector<uint32_t> adjacency(adjacencyOffsets[vertexCount]);
+	{
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < mesh.indices.size(); ++i) {
+			adjacency[fill[mesh.indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint16_t> localIndex(vertexCount, UINT16_MAX);
+	std::vector<uint32_t> candidates;
+
+	for (uint32_t subsetIndex = 0; subsetIndex < mesh.subsets.size(); ++subsetIndex) {
+		const TreeMeshSubset& subset = mesh.subsets[subsetIndex];
+		const uint32_t firstTriangle = subset.indexOffset / 3;
+		const uint32_t endTriangle = firstTriangle + subset.indexCount / 3;
+		const bool allowCone = std::find(noConeSubsets.begin(), noConeSubsets.end(), subsetIndex) == noConeSubsets.end();
+		uint32_t cursor = firstTriangle;
+
+		TreeMeshlet meshlet = {};
+		auto beginMeshlet = [&]() {
+			meshlet = {};
+			meshlet.vertexOffset = static_cast<uint32_t>(data.vertices.size());
+			meshlet.triangleOffset = static_cast<uint32_t>(data.triangles.size());
+			meshlet.subset = subsetIndex;
+		};
+		auto finishMeshlet = [&]() {
+			if (meshlet.triangleCount == 0) {
+				return;
+			}
+			for (uint32_t i = 0; i < meshlet.vertexCount; ++i) {
+				localIndex[data.vertices[meshlet.vertexOffset + i]] = UINT16_MAX;
+			}
+			ComputeMeshletBounds(mesh, data, meshlet, allowCone);
+			data.meshlets.push_back(meshlet);
+		};
+		auto newVertices = [&](uint32_t triangle) {
+			uint32_t count = 0;
+			for (uint32_t k = 0; k < 3; ++k) {
+				count += localIndex[mesh.indices[triangle * 3 + k]] == UINT16_MAX ? 1 : 0;
+			}
+			return count;
+		};
+
+		// Candidates survive a full meshlet so the next one starts where the branch left off
+		candidates.clear();
+		beginMeshlet();
+		while (true) {
+			// Best connected candidate: the one that adds the fewest vertices
+			uint32_t best = UINT32_MAX;
+			uint32_t bestCost = 4;
+			for (size_t c = 0; c < candidates.size(); ++c) {
+				const uint32_t triangle = candidates[c];
+				if (emitted[triangle]) {
+					candidates[c--] = candidates.back();
+					candidates.pop_back();
+					continue;
+				}
+				const uint32_t cost = newVertices(triangle);
+				if (cost < bestCost) {
+					bestCost = cost;
+					best = triangle;
+					if (cost == 0) {
+						break;
+					}
+				}
+			}
+
+			// Nothing connected left, continue with the next triangle in generation order
+			if (best == UINT32_MAX) {
+				while (cursor < endTriangle && emitted[cursor]) {
+					cursor++;
+				}
+				if (cursor == endTriangle) {
+					break;
+				}
+				best = cursor;
+				bestCost = newVertices(best);
+			}
+
+			if (meshlet.vertexCount + bestCost > maxVertices || meshlet.triangleCount + 1 > maxTriangles) {
+				finishMeshlet();
+				beginMeshlet();
+				continue;
+			}
+
+			emitted[best] = 1;
+			for (uint32_t k = 0; k < 3; ++k) {
+				const uint32_t vertex = mesh.indices[best * 3 + k];
+				if (localIndex[vertex] == UINT16_MAX) {
+					localIndex[vertex] = static_cast<uint16_t>(meshlet.vertexCount++);
+					data.vertices.push_back(vertex);
+					for (uint32_t a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; ++a) {
+						const uint32_t neighbour = adjacency[a];
+						if (!emitted[neighbour] && neighbour >= firstTriangle && neighbour < endTriangle) {
+							candidates.push_back(neighbour);
+						}
+					}
+				}
+				data.triangles.push_back(static_cast<uint8_t>(localIndex[vertex]));
+			}
+			meshlet.triangleCount++;
+		}
+		finishMeshlet();
+	}
+}
+
+bool IsMeshletVisible(const TreeMeshlet& meshlet, const XMFLOAT4 frustumPlanes[6], const XMFLOAT3& cameraPosition) {
+	XMVECTOR center = XMLoadFloat3(&meshlet.center);
+	for (uint32_t p = 0; p < 6; ++p) {
+		XMVECTOR plane = XMLoadFloat4(&frustumPlanes[p]);
+		if (XMVectorGetX(XMVector3Dot(plane, center)) + frustumPlanes[p].w < -meshlet.radius) {
+			return false;
+		}
+	}
+
+	if (meshlet.coneCutoff < 1.0f) {
+		XMVECTOR view = XMVectorSubtract(XMLoadFloat3(&meshlet.coneApex), XMLoadFloat3(&cameraPosition));
+		if (XMVectorGetX(XMVector3LengthSq(view)) > 0.0f &&
+			XMVectorGetX(XMVector3Dot(XMVector3Normalize(view), XMLoadFloat3(&meshlet.coneAxis))) >= meshlet.coneCutoff) {
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t CullMeshlets(const TreeMeshletData& meshlets, const XMFLOAT4 frustumPlanes[6], const XMFLOAT3& cameraPosition, std::vector<uint32_t>& visible) {
+	size_t kept = 0;
+	for (uint32_t i = 0; i < meshlets.meshlets.size(); ++i) {
+		if (IsMeshletVisible(meshlets.meshlets[i], frustumPlanes, cameraPosition)) {
+			visible.push_back(i);
+			kept++;
+		}
+	}
+	return kept;
+}
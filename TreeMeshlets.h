@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+
+struct TreeMeshData;
+
+// A small cluster of triangles with its own local vertex list
+struct TreeMeshlet {
+	uint32_t vertexOffset;        // Into TreeMeshletData::vertices
+	uint32_t triangleOffset;      // Into TreeMeshletData::triangles, three local indices per triangle
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+	uint32_t subset;              // TreeMeshData subset the triangles came from
+	DirectX::XMFLOAT3 center;     // Bounding sphere
+	float radius;
+	DirectX::XMFLOAT3 coneApex;   // Normal cone, every triangle faces away from cameras inside it
+	DirectX::XMFLOAT3 coneAxis;
+	float coneCutoff;             // Cosine test value, 1 when the cone is too wide to ever cull
+};
+
+struct TreeMeshletData {
+	std::vector<TreeMeshlet> meshlets;
+	std::vector<uint32_t> vertices;   // Mesh vertex index for every meshlet-local vertex
+	std::vector<uint8_t> triangles;   // Meshlet-local vertex indices
+};
+
+// Greedy partition of every subset into clusters of at most maxVertices vertices and maxTriangles triangles.
+// Triangles sharing vertices with the open cluster are taken first, so clusters grow along the branches they were generated from.
+// Subsets listed in noConeSubsets (e.g. double-sided foliage) get a cone that never culls.
+void BuildMeshlets(const TreeMeshData& mesh, TreeMeshletData& meshlets, uint32_t maxVertices = 64, uint32_t maxTriangles = 124, const std::vector<uint32_t>& noConeSubsets = {});
+
+// Frustum planes are (normal, distance) pointing inwards, a point p is inside when dot(normal, p) + distance >= 0
+bool IsMeshletVisible(const TreeMeshlet& meshlet, const DirectX::XMFLOAT4 frustumPlanes[6], const DirectX::XMFLOAT3& cameraPosition);
+
+// Append the indices of the visible meshlets and return how many were kept
+size_t CullMeshlets(const TreeMeshletData& meshlets, const DirectX::XMFLOAT4 frustumPlanes[6], const DirectX::XMFLOAT3& cameraPosition, std::vector<uint32_t>& visible);
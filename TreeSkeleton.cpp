@@ -0,0 +1,150 @@
+#include "TreeSkeleton.h"
+#include "TreeMesh.h"
+#include "TwoOLSystem.h"
+#include <algorithm>
+#include <numeric>
+
+using namespace DirectX;
+
+static constexpr uint32_t kSkinBatchSize = 4096;
+
+static bool IsFoliage(const LSystemNode& node) {
+	return node.type == NodeType::Leaf || node.type == NodeType::Decal;
+}
+
+void BuildTreeSkeleton(const std::vector<LSystemGeneration>& generations, uint32_t maxBones, TreeSkeleton& skeleton) {
+	std::vector<const LSystemNode*> nodes = flattenGenerations(generations);
+	LSystemHierarchy hierarchy = buildHierarchy(generations);
+	const uint32_t nodeCount = static_cast<uint32_t>(nodes.size());
+
+	skeleton.bones.clear();
+	skeleton.nodeBones.assign(nodeCount, 0);
+	if (nodeCount == 0) {
+		return;
+	}
+
+	// Chains are created parents first, so a chain's parent always has a lower index
+	struct Chain {
+		int parent;
+		uint32_t firstNode;
+		uint32_t lastNode;
+		uint32_t nodeCount;
+		float weight;
+	};
+	std::vector<Chain> chains;
+	std::vector<uint32_t> chainOf(nodeCount);
+	for (uint32_t nodeIndex : hierarchy.order) {
+		const LSystemNode& node = *nodes[nodeIndex];
+		const int parent = hierarchy.parents[nodeIndex];
+		const float volume = std::max(node.length * node.radius * node.radius, 1e-12f);
+
+		if (parent >= 0 && IsFoliage(node)) {
+			chainOf[nodeIndex] = chainOf[parent];
+			chains[chainOf[parent]].weight += volume;
+			continue;
+		}
+		if (parent >= 0 && hierarchy.childCount(parent) == 1 && nodes[parent]->type == node.type) {
+			Chain& chain = chains[chainOf[parent]];
+			chainOf[nodeIndex] = chainOf[parent];
+			chain.lastNode = nodeIndex;
+			chain.nodeCount++;
+			chain.weight += volume;
+			continue;
+		}
+		chainOf[nodeIndex] = static_cast<uint32_t>(chains.size());
+		chains.push_back({ parent >= 0 ? static_cast<int>(chainOf[parent]) : -1, nodeIndex, nodeIndex, 1, volume });
+	}
+
+	// Subtree weights, children before parents
+	const uint32_t chainCount = static_cast<uint32_t>(chains.size());
+	std::vector<float> subtree(chainCount);
+	for (uint32_t c = chainCount; c-- > 0;) {
+		subtree[c] += chains[c].weight;
+		if (chains[c].parent >= 0) {
+			subtree[chains[c].parent] += subtree[c];
+		}
+	}
+
+	// A parent outweighs each of its children and wins ties by index, so the kept set is closed under parents
+	std::vector<uint32_t> ranking(chainCount);
+	std::iota(ranking.begin(), ranking.end(), 0u);
+	const uint32_t keepCount = std::min(chainCount, std::max(maxBones, 1u));
+	std::partial_sort(ranking.begin(), ranking.begin() + keepCount, ranking.end(), [&](uint32_t lhs, uint32_t rhs) {
+		return subtree[lhs] != subtree[rhs] ? subtree[lhs] > subtree[rhs] : lhs < rhs;
+	});
+	std::vector<uint8_t> kept(chainCount, 0);
+	for (uint32_t i = 0; i < keepCount; ++i) {
+		kept[ranking[i]] = 1;
+	}
+
+	// Several roots can only share the first bone once the budget is spent, all other chains fold upwards
+	std::vector<uint32_t> boneOf(chainCount, 0);
+	for (uint32_t c = 0; c < chainCount; ++c) {
+		const Chain& chain = chains[c];
+		if (!kept[c]) {
+			boneOf[c] = chain.parent >= 0 ? boneOf[chain.parent] : 0;
+			continue;
+		}
+		boneOf[c] = static_cast<uint32_t>(skeleton.bones.size());
+		const LSystemNode& first = *nodes[chain.firstNode];
+		TreeBone& bone = skeleton.bones.emplace_back();
+		bone.parent = chain.parent >= 0 ? static_cast<int>(boneOf[chain.parent]) : -1;
+		bone.firstNode = chain.firstNode;
+		bone.nodeCount = chain.nodeCount;
+		bone.head = first.position;
+		XMStoreFloat3(&bone.tail, NodeEnd(*nodes[chain.lastNode]));
+		XMStoreFloat4(&bone.rotation, NodeRotation(first));
+		bone.radius = first.radius;
+	}
+
+	for (uint32_t n = 0; n < nodeCount; ++n) {
+		skeleton.nodeBones[n] = boneOf[chainOf[n]];
+	}
+}
+
+void ComputeSkinWeights(const TreeMeshData& mesh, const TreeSkeleton& skeleton, TreeSkinWeights& weights) {
+	const uint32_t vertexCount = static_cast<uint32_t>(mesh.vertex_positions.size());
+	weights.boneIndices.assign(vertexCount, XMUINT4(0, 0, 0, 0));
+	weights.boneWeights.assign(vertexCount, XMFLOAT4(1, 0, 0, 0));
+	if (vertexCount == 0 || skeleton.bones.empty()) {
+		return;
+	}
+
+	// Welded vertices can be shared by several spans, the first span in mesh order owns them.
+	// Walking backwards lets the earliest span write last, which keeps this pass short and the result fixed.
+	std::vector<uint32_t> owner(vertexCount, UINT32_MAX);
+	for (size_t s = mesh.spans.size(); s-- > 0;) {
+		const TreeMeshSpan& span = mesh.spans[s];
+		for (uint32_t v = span.firstVertex; v < span.firstVertex + span.vertexCount; ++v) {
+			owner[mesh.remap.empty() ? v : mesh.remap[v]] = span.node;
+		}
+	}
+
+	wi::jobsystem::context context;
+	wi::jobsystem::Dispatch(context, vertexCount, kSkinBatchSize, [&](wi::jobsystem::JobArgs args) {
+		const uint32_t v = args.jobIndex;
+		if (owner[v] == UINT32_MAX || owner[v] >= skeleton.nodeBones.size()) {
+			return;
+		}
+		const uint32_t boneIndex = skeleton.nodeBones[owner[v]];
+		const TreeBone& bone = skeleton.bones[boneIndex];
+		weights.boneIndices[v].x = boneIndex;
+		if (bone.parent < 0) {
+			return;
+		}
+
+		// Distance from the joint along the bone, the parent bone fully owns the joint itself
+		XMVECTOR head = XMLoadFloat3(&bone.head);
+		XMVECTOR axis = XMVectorSubtract(XMLoadFloat3(&bone.tail), head);
+		const float length = XMVectorGetX(XMVector3Length(axis));
+		const float blend = std::min(2.0f * bone.radius, 0.5f * length);
+		if (blend <= 0.0f) {
+			return;
+		}
+		const float along = XMVectorGetX(XMVector3Dot(XMVectorSubtract(XMLoadFloat3(&mesh.vertex_positions[v]), head), axis)) / length;
+		const float parentWeight = std::clamp(1.0f - along / blend, 0.0f, 1.0f);
+		weights.boneIndices[v].y = static_cast<uint32_t>(bone.parent);
+		weights.boneWeights[v] = XMFLOAT4(1.0f - parentWeight, parentWeight, 0, 0);
+	});
+	wi::jobsystem::Wait(context);
+}
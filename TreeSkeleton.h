@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+
+// Forward declaration of LSystemNode
+class LSystemNode;
+
+using LSystemGeneration = std::vector<LSystemNode>;
+
+struct TreeMeshData;
+
+// One bone per kept branch chain, in bind pose
+struct TreeBone {
+	int parent;                   // Bone index, -1 for the root, always lower than the bone's own index
+	uint32_t firstNode;           // Flat index of the node the chain starts at
+	uint32_t nodeCount;           // Nodes in the chain itself, folded chains not included
+	DirectX::XMFLOAT3 head;       // Base of the chain
+	DirectX::XMFLOAT3 tail;       // Tip of the chain's last node
+	DirectX::XMFLOAT4 rotation;   // Orientation of the first node
+	float radius;                 // Radius at the head
+};
+
+struct TreeSkeleton {
+	std::vector<TreeBone> bones;
+	std::vector<uint32_t> nodeBones;   // Bone every flat node is skinned to
+};
+
+// Up to four influences per vertex, unused slots have weight 0
+struct TreeSkinWeights {
+	std::vector<DirectX::XMUINT4> boneIndices;
+	std::vector<DirectX::XMFLOAT4> boneWeights;
+};
+
+// A chain runs from a node through single children of the same type, Leaf and Decal nodes ride on their parent's chain.
+// When there are more chains than maxBones, the chains carrying the least wood (length * radius^2 of their whole subtree)
+// are folded into their nearest kept ancestor, so every kept bone's parent is kept as well.
+void BuildTreeSkeleton(const std::vector<LSystemGeneration>& generations, uint32_t maxBones, TreeSkeleton& skeleton);
+
+// Weights for the final vertex order of mesh, found through its spans and remap.
+// Vertices follow their node's bone, fading in from the parent bone over the first two radii of a chain so joints bend without cracks.
+// Runs on the job system, every vertex is computed independently so the result does not depend on scheduling.
+void ComputeSkinWeights(const TreeMeshData& mesh, const TreeSkeleton& skeleton, TreeSkinWeights& weights);
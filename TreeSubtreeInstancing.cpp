@@ -0,0 +1,183 @@
+#include "TreeSubtreeInstancing.h"
+#include "TreeMesh.h"
+#include "TreeMeshCache.h"
+#include "TwoOLSystem.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <unordered_map>
+
+using namespace DirectX;
+
+static uint64_t Quantize(float value, float tolerance) {
+	return static_cast<uint64_t>(std::llround(static_cast<double>(value) / tolerance));
+}
+
+void HashSubtrees(const std::vector<LSystemGeneration>& generations, const SubtreeHashSettings& settings, TreeSubtreeInstancing& instancing) {
+	std::vector<const LSystemNode*> nodes = flattenGenerations(generations);
+	LSystemHierarchy hierarchy = buildHierarchy(generations);
+	const uint32_t nodeCount = static_cast<uint32_t>(nodes.size());
+
+	instancing = TreeSubtreeInstancing();
+	instancing.hashes.assign(nodeCount, 0);
+	instancing.subtreeSizes.assign(nodeCount, 1);
+
+	// Children before parents, each child contributes its hash and where it sits in its parent's frame. The hash alone
+	// may collide, so the same key built from the children's shapes is compared before two subtrees share a shape.
+	std::vector<uint64_t> entries;
+	std::vector<std::array<uint64_t, 8>> shapeEntries;
+	std::vector<uint64_t> key;
+	std::unordered_map<uint64_t, uint32_t> firstShapeOf;   // Hash to the first shape with it, others follow in nextShape
+	std::vector<uint32_t> nextShape;
+	std::vector<uint32_t> shapeKeyOffsets(1, 0);
+	std::vector<uint64_t> shapeKeys;
+	firstShapeOf.reserve(nodeCount);
+	instancing.shapes.assign(nodeCount, 0);
+	for (size_t i = hierarchy.order.size(); i-- > 0;) {
+		const uint32_t nodeIndex = hierarchy.order[i];
+		const LSystemNode& node = *nodes[nodeIndex];
+		const XMVECTOR inverseRotation = XMQuaternionInverse(NodeRotation(node));
+		const XMVECTOR position = XMLoadFloat3(&node.position);
+
+		entries.clear();
+		shapeEntries.clear();
+		for (uint32_t c = hierarchy.childOffsets[nodeIndex]; c < hierarchy.childOffsets[nodeIndex + 1]; ++c) {
+			const uint32_t childIndex = hierarchy.children[c];
+			const LSystemNode& child = *nodes[childIndex];
+			XMFLOAT3 offset;
+			XMStoreFloat3(&offset, XMVector3Rotate(XMVectorSubtract(XMLoadFloat3(&child.position), position), inverseRotation));
+			XMFLOAT4 rotation;
+			XMStoreFloat4(&rotation, XMQuaternionMultiply(NodeRotation(child), inverseRotation));
+			if (rotation.w < 0.0f) {
+				rotation = XMFLOAT4(-rotation.x, -rotation.y, -rotation.z, -rotation.w);
+			}
+			std::array<uint64_t, 8> entry = {
+				instancing.hashes[childIndex],
+				Quantize(offset.x, settings.lengthTolerance), Quantize(offset.y, settings.lengthTolerance), Quantize(offset.z, settings.lengthTolerance),
+				Quantize(rotation.x, settings.rotationTolerance), Quantize(rotation.y, settings.rotationTolerance),
+				Quantize(rotation.z, settings.rotationTolerance), Quantize(rotation.w, settings.rotationTolerance),
+			};
+			entries.push_back(HashBytes(entry.data(), sizeof(entry)));
+			entry[0] = instancing.shapes[childIndex];
+			shapeEntries.push_back(entry);
+			instancing.subtreeSizes[nodeIndex] += instancing.subtreeSizes[childIndex];
+		}
+		// Sorted so the order children were emitted in does not matter
+		std::sort(entries.begin(), entries.end());
+		std::sort(shapeEntries.begin(), shapeEntries.end());
+
+		key.assign({ static_cast<uint64_t>(node.type), Quantize(node.length, settings.lengthTolerance), Quantize(node.radius, settings.radiusTolerance) });
+		key.insert(key.end(), entries.begin(), entries.end());
+		const uint64_t hash = HashBytes(key.data(), key.size() * sizeof(uint64_t));
+		instancing.hashes[nodeIndex] = hash;
+
+		key.resize(3);
+		for (const auto& entry : shapeEntries) {
+			key.insert(key.end(), entry.begin(), entry.end());
+		}
+		auto [first, inserted] = firstShapeOf.emplace(hash, static_cast<uint32_t>(nextShape.size()));
+		uint32_t shape = inserted ? UINT32_MAX : first->second;
+		uint32_t last = shape;
+		while (shape != UINT32_MAX && !std::equal(key.begin(), key.end(), shapeKeys.begin() + shapeKeyOffsets[shape], shapeKeys.begin() + shapeKeyOffsets[shape + 1])) {
+			last = shape;
+			shape = nextShape[shape];
+		}
+		if (shape == UINT32_MAX) {
+			shape = static_cast<uint32_t>(nextShape.size());
+			nextShape.push_back(UINT32_MAX);
+			shapeKeys.insert(shapeKeys.end(), key.begin(), key.end());
+			shapeKeyOffsets.push_back(static_cast<uint32_t>(shapeKeys.size()));
+			if (last != UINT32_MAX) {
+				nextShape[last] = shape;
+			}
+		}
+		instancing.shapes[nodeIndex] = shape;
+	}
+
+	std::vector<uint32_t> occurrences(nextShape.size(), 0);
+	for (uint32_t shape : instancing.shapes) {
+		occurrences[shape]++;
+	}
+
+	// Parents come first in order, so a node whose parent is instanced or covered is covered as well
+	std::vector<uint32_t> prototypeOf(nextShape.size(), UINT32_MAX);
+	std::vector<uint8_t> covered(nodeCount, 0);
+	for (uint32_t nodeIndex : hierarchy.order) {
+		const int parent = hierarchy.parents[nodeIndex];
+		if (parent >= 0 && covered[parent]) {
+			covered[nodeIndex] = 1;
+			continue;
+		}
+		const uint32_t shape = instancing.shapes[nodeIndex];
+		const uint32_t size = instancing.subtreeSizes[nodeIndex];
+		if (occurrences[shape] < 2 || size < settings.minNodes || size > settings.maxNodes) {
+			instancing.residualNodes.push_back(nodeIndex);
+			continue;
+		}
+		covered[nodeIndex] = 1;
+
+		if (prototypeOf[shape] == UINT32_MAX) {
+			prototypeOf[shape] = static_cast<uint32_t>(instancing.prototypes.size());
+			// The first copy found is the representative, its nodes are collected parents first
+			SubtreePrototype& prototype = instancing.prototypes.emplace_back();
+			prototype.hash = instancing.hashes[nodeIndex];
+			prototype.firstNode = static_cast<uint32_t>(instancing.nodes.size());
+			prototype.nodeCount = size;
+			prototype.instanceCount = 0;
+			instancing.nodes.push_back(nodeIndex);
+			for (size_t n = prototype.firstNode; n < instancing.nodes.size(); ++n) {
+				const uint32_t current = instancing.nodes[n];
+				for (uint32_t c = hierarchy.childOffsets[current]; c < hierarchy.childOffsets[current + 1]; ++c) {
+					instancing.nodes.push_back(hierarchy.children[c]);
+				}
+			}
+		}
+		instancing.prototypes[prototypeOf[shape]].instanceCount++;
+
+		const LSystemNode& root = *nodes[nodeIndex];
+		SubtreeInstance& instance = instancing.instances.emplace_back();
+		instance.prototype = prototypeOf[shape];
+		instance.rootNode = nodeIndex;
+		XMStoreFloat4x4(&instance.transform, XMMatrixRotationQuaternion(NodeRotation(root)) * XMMatrixTranslationFromVector(XMLoadFloat3(&root.position)));
+	}
+}
+
+void ExtractSubtreePrototype(const std::vector<LSystemGeneration>& generations, const TreeSubtreeInstancing& instancing, uint32_t prototype, std::vector<LSystemGeneration>& subtree) {
+	std::vector<const LSystemNode*> nodes = flattenGenerations(generations);
+	const SubtreePrototype& source = instancing.prototypes[prototype];
+	const LSystemNode& root = *nodes[instancing.nodes[source.firstNode]];
+	const XMVECTOR inverseRotation = XMQuaternionInverse(NodeRotation(root));
+	const XMVECTOR origin = XMLoadFloat3(&root.position);
+
+	subtree.assign(1, LSystemGeneration());
+	subtree[0].reserve(source.nodeCount);
+	for (uint32_t n = source.firstNode; n < source.firstNode + source.nodeCount; ++n) {
+		LSystemNode node = *nodes[instancing.nodes[n]];
+		XMStoreFloat3(&node.position, XMVector3Rotate(XMVectorSubtract(XMLoadFloat3(&node.position), origin), inverseRotation));
+		XMStoreFloat4(&node.rotation, XMQuaternionMultiply(NodeRotation(node), inverseRotation));
+		subtree[0].push_back(node);
+	}
+	// Cut loose from the rest of the tree even if the parent id happens to be reused inside the subtree
+	subtree[0][0].parentid = -1;
+}
+
+void ExtractResidualNodes(const std::vector<LSystemGeneration>& generations, const TreeSubtreeInstancing& instancing, std::vector<LSystemGeneration>& residual) {
+	size_t nodeCount = 0;
+	for (const auto& generation : generations) {
+		nodeCount += generation.size();
+	}
+	std::vector<uint8_t> keep(nodeCount, 0);
+	for (uint32_t nodeIndex : instancing.residualNodes) {
+		keep[nodeIndex] = 1;
+	}
+
+	residual.assign(generations.size(), LSystemGeneration());
+	uint32_t flatIndex = 0;
+	for (size_t g = 0; g < generations.size(); ++g) {
+		for (const LSystemNode& node : generations[g]) {
+			if (keep[flatIndex++]) {
+				residual[g].push_back(node);
+			}
+		}
+	}
+}
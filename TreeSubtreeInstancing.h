@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+
+// Forward declaration of LSystemNode
+class LSystemNode;
+
+using LSystemGeneration = std::vector<LSystemNode>;
+
+// Values closer than a tolerance usually land in the same bucket and count as equal, values straddling a bucket edge do not
+struct SubtreeHashSettings {
+	float lengthTolerance = 1e-3f;     // Length, radius and positions relative to the parent, in world units
+	float radiusTolerance = 1e-4f;
+	float rotationTolerance = 1e-3f;   // Per component of the rotation relative to the parent
+	uint32_t minNodes = 4;             // Smaller repeats are cheaper to mesh in place than to instance
+	uint32_t maxNodes = 512;           // Larger repeats are split into their repeating parts, so prototypes stay small and reused often
+};
+
+// A subtree shape meshed once, its nodes moved into the local frame of its root
+struct SubtreePrototype {
+	uint64_t hash;
+	uint32_t firstNode;       // Flat node indices of the representative subtree are nodes[firstNode .. firstNode + nodeCount), parents first
+	uint32_t nodeCount;
+	uint32_t instanceCount;
+};
+
+struct SubtreeInstance {
+	uint32_t prototype;
+	uint32_t rootNode;                  // Flat index of the node the copy hangs off
+	DirectX::XMFLOAT4X4 transform;      // Prototype space to tree space, rotation and translation of rootNode
+};
+
+struct TreeSubtreeInstancing {
+	std::vector<uint64_t> hashes;           // Per flat node, equal hashes almost always mean equal subtrees up to a rigid transform
+	std::vector<uint32_t> shapes;           // Per flat node, equal shapes mean equal subtrees, checked key by key when hashes match
+	std::vector<uint32_t> subtreeSizes;     // Per flat node, counting itself
+	std::vector<SubtreePrototype> prototypes;
+	std::vector<uint32_t> nodes;            // Node lists of the prototypes
+	std::vector<SubtreeInstance> instances;
+	std::vector<uint32_t> residualNodes;    // Nodes outside every instance, meshed as they are
+};
+
+// Hash every subtree bottom-up from its type, length, radius and the position and rotation of each child relative to
+// its parent, children in sorted order. Subtrees with equal hashes only share a shape when their quantized keys match too.
+// Walking down from the roots, the first shape that repeats and fits the size limits becomes an instance and its
+// descendants are not visited.
+void HashSubtrees(const std::vector<LSystemGeneration>& generations, const SubtreeHashSettings& settings, TreeSubtreeInstancing& instancing);
+
+// Nodes of a prototype with its root at the origin and unrotated, as one generation ready for GenerateMesh
+void ExtractSubtreePrototype(const std::vector<LSystemGeneration>& generations, const TreeSubtreeInstancing& instancing, uint32_t prototype, std::vector<LSystemGeneration>& subtree);
+
+// The residual nodes in their original generations
+void ExtractResidualNodes(const std::vector<LSystemGeneration>& generations, const TreeSubtreeInstancing& instancing, std::vector<LSystemGeneration>& residual);
@@ -0,0 +1,228 @@
+#include "TreeWind.h"
+#include "TreeSkeleton.h"
+#include "TwoOLSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+
+using namespace DirectX;
+
+static constexpr uint32_t kWindQuadsPerGroup = 256;   // Job system group size, in groups of four vertices
+static constexpr uint32_t kMinWindowVertices = 1024;  // A budget never starves the tree completely
+
+// The trunk only takes part in the main bend, branches bend quadratically away from their pivot
+static float BranchWeight(const TreeBone& bone, float boneLevel, const XMFLOAT3& position) {
+	if (boneLevel == 0.0f) {
+		return 0.0f;
+	}
+	XMVECTOR head = XMLoadFloat3(&bone.head);
+	XMVECTOR axis = XMVectorSubtract(XMLoadFloat3(&bone.tail), head);
+	const float length = XMVectorGetX(XMVector3Length(axis));
+	if (length <= 0.0f) {
+		return 0.0f;
+	}
+	const float along = std::clamp(XMVectorGetX(XMVector3Dot(XMVectorSubtract(XMLoadFloat3(&position), head), axis)) / (length * length), 0.0f, 1.0f);
+	return along * along * length;
+}
+
+void TreeWindDeformer::Reset() {
+	*this = TreeWindDeformer();
+}
+
+void TreeWindDeformer::Setup(const XMFLOAT3* positions, uint32_t count, const std::vector<TreeMeshSpan>& spans, const std::vector<uint32_t>& remap, const TreeSkeleton& skeleton) {
+	Reset();
+	vertexCount = count;
+	const uint32_t padded = (count + 3) & ~3u;
+	restX.assign(padded, 0.0f);
+	restY.assign(padded, 0.0f);
+	restZ.assign(padded, 0.0f);
+	trunkWeight.assign(padded, 0.0f);
+	branchWeight.assign(padded, 0.0f);
+	leafWeight.assign(padded, 0.0f);
+	phase.assign(padded, 0.0f);
+	level.assign(padded, 0.0f);
+	pivot.assign(padded, 0);
+	// Chain 0 is the trunk root, its pivot never moves, vertices without a chain use it too
+	const size_t chainCount = std::max<size_t>(skeleton.bones.size(), 1);
+	chainParent.assign(chainCount, -1);
+	chainLevel.assign(chainCount, 0.0f);
+	chainPhase.assign(chainCount, 0.0f);
+	pivotWeight.assign(chainCount, 0.0f);
+	pivotSway.assign(chainCount, 0.0f);
+	if (count == 0) {
+		return;
+	}
+
+	float baseY = FLT_MAX;
+	float topY = -FLT_MAX;
+	for (uint32_t v = 0; v < count; ++v) {
+		restX[v] = positions[v].x;
+		restY[v] = positions[v].y;
+		restZ[v] = positions[v].z;
+		baseY = std::min(baseY, positions[v].y);
+		topY = std::max(topY, positions[v].y);
+	}
+	treeHeight = std::max(topY - baseY, 1e-3f);
+
+	// Same ownership rule as the skin weights, the first span touching a welded vertex wins
+	std::vector<uint32_t> ownerNode(count, UINT32_MAX);
+	for (size_t s = spans.size(); s-- > 0;) {
+		const TreeMeshSpan& span = spans[s];
+		for (uint32_t v = span.firstVertex; v < span.firstVertex + span.vertexCount; ++v) {
+			const uint32_t target = remap.empty() ? v : remap[v];
+			ownerNode[target] = span.node;
+			leafWeight[target] = span.part == TreeMeshPart::Foliage ? 1.0f : 0.0f;
+		}
+	}
+
+	for (size_t b = 0; b < skeleton.bones.size(); ++b) {
+		const TreeBone& bone = skeleton.bones[b];
+		chainParent[b] = bone.parent;
+		chainLevel[b] = bone.parent < 0 ? 0.0f : chainLevel[bone.parent] + 1.0f;
+		chainPhase[b] = static_cast<float>((static_cast<uint32_t>(b) * 2654435761u) >> 8) * (XM_2PI / 16777216.0f);
+		if (bone.parent >= 0) {
+			pivotWeight[b] = BranchWeight(skeleton.bones[bone.parent], chainLevel[bone.parent], bone.head);
+		}
+	}
+
+	for (uint32_t v = 0; v < count; ++v) {
+		const float height = (restY[v] - baseY) / treeHeight;
+		trunkWeight[v] = height * height;
+		if (ownerNode[v] >= skeleton.nodeBones.size()) {
+			continue;
+		}
+		const uint32_t boneIndex = skeleton.nodeBones[ownerNode[v]];
+		phase[v] = chainPhase[boneIndex];
+		level[v] = chainLevel[boneIndex];
+		pivot[v] = boneIndex;
+		branchWeight[v] = BranchWeight(skeleton.bones[boneIndex], chainLevel[boneIndex], positions[v]);
+	}
+}
+
+void TreeWindDeformer::UpdatePivots(float time, const TreeWindSettings& settings) {
+	// A pivot moves by what its parent's pivot moves plus the parent's own sway at that point, parents come first
+	const float amplitude = settings.strength * settings.branchAmplitude;
+	for (size_t c = 0; c < chainParent.size(); ++c) {
+		const int parent = chainParent[c];
+		if (parent < 0) {
+			pivotSway[c] = 0.0f;
+			continue;
+		}
+		const float frequency = settings.branchFrequency * (1.0f + settings.levelFrequency * std::max(chainLevel[parent] - 1.0f, 0.0f));
+		pivotSway[c] = pivotSway[parent] + sinf(time * frequency + chainPhase[parent]) * amplitude * pivotWeight[c];
+	}
+}
+
+void TreeWindDeformer::SetRestPosition(uint32_t vertex, const XMFLOAT3& position) {
+	if (vertex < vertexCount) {
+		restX[vertex] = position.x;
+		restY[vertex] = position.y;
+		restZ[vertex] = position.z;
+	}
+}
+
+void TreeWindDeformer::DeformRange(uint32_t first, uint32_t count, float time, const TreeWindSettings& settings, XMFLOAT3* positions) const {
+	const XMVECTOR direction = XMVector3Normalize(XMVectorSet(settings.direction.x, 0.0f, settings.direction.z, 0.0f));
+	XMFLOAT3 windDirection;
+	XMStoreFloat3(&windDirection, direction);
+	const XMVECTOR windX = XMVectorReplicate(windDirection.x);
+	const XMVECTOR windZ = XMVectorReplicate(windDirection.z);
+
+	// Same for every vertex: how far the top of the tree leans this frame
+	const float trunkSway = settings.strength * settings.trunkAmplitude * treeHeight * (1.0f + 0.5f * sinf(time * settings.trunkFrequency));
+	const XMVECTOR trunk = XMVectorReplicate(trunkSway);
+	const XMVECTOR branchAmplitude = XMVectorReplicate(settings.strength * settings.branchAmplitude);
+	const XMVECTOR leafAmplitude = XMVectorReplicate(settings.strength * settings.leafAmplitude);
+	const XMVECTOR branchTime = XMVectorReplicate(time * settings.branchFrequency);
+	const XMVECTOR levelFrequency = XMVectorReplicate(settings.levelFrequency);
+	const XMVECTOR one = XMVectorReplicate(1.0f);
+	const XMVECTOR leafTime = XMVectorReplicate(time * settings.leafFrequency);
+	const XMVECTOR lift = XMVectorReplicate(0.3f);
+	const XMVECTOR half = XMVectorReplicate(0.5f);
+	const XMVECTOR three = XMVectorReplicate(3.0f);
+
+	const uint32_t end = first + count;
+	const uint32_t quadCount = (count + 3) / 4;
+	wi::jobsystem::context context;
+	wi::jobsystem::Dispatch(context, quadCount, kWindQuadsPerGroup, [&](wi::jobsystem::JobArgs args) {
+		const uint32_t v = first + args.jobIndex * 4;
+		XMVECTOR x = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&restX[v]));
+		XMVECTOR y = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&restY[v]));
+		XMVECTOR z = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&restZ[v]));
+		XMVECTOR vertexPhase = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&phase[v]));
+		XMVECTOR branch = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&branchWeight[v]));
+		XMVECTOR leaf = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&leafWeight[v]));
+		XMVECTOR vertexLevel = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&level[v]));
+		XMVECTOR inherited = XMVectorSet(pivotSway[pivot[v]], pivotSway[pivot[v + 1]], pivotSway[pivot[v + 2]], pivotSway[pivot[v + 3]]);
+
+		// Where the parent pivot went, plus the chain's own sway around it, finer branches swing faster
+		XMVECTOR frequency = XMVectorMultiplyAdd(levelFrequency, XMVectorMax(XMVectorSubtract(vertexLevel, one), XMVectorZero()), one);
+		XMVECTOR ownSway = XMVectorMultiply(XMVectorSin(XMVectorMultiplyAdd(branchTime, frequency, vertexPhase)), XMVectorMultiply(branchAmplitude, branch));
+		XMVECTOR branchSway = XMVectorAdd(inherited, ownSway);
+		XMVECTOR leafSway = XMVectorMultiply(XMVectorSin(XMVectorMultiplyAdd(vertexPhase, three, XMVectorAdd(leafTime, y))), XMVectorMultiply(leafAmplitude, leaf));
+
+		// Along the wind: main bend plus branch sway. Up: a little branch lift and leaf flutter. Across: leaf flutter.
+		XMVECTOR along = XMVectorMultiplyAdd(trunk, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&trunkWeight[v])), branchSway);
+		XMVECTOR up = XMVectorMultiplyAdd(branchSway, lift, leafSway);
+		XMVECTOR across = XMVectorMultiply(leafSway, half);
+
+		x = XMVectorAdd(x, XMVectorAdd(XMVectorMultiply(windX, along), XMVectorMultiply(windZ, across)));
+		y = XMVectorAdd(y, up);
+		z = XMVectorAdd(z, XMVectorSubtract(XMVectorMultiply(windZ, along), XMVectorMultiply(windX, across)));
+
+		XMFLOAT4A outX, outY, outZ;
+		XMStoreFloat4A(&outX, x);
+		XMStoreFloat4A(&outY, y);
+		XMStoreFloat4A(&outZ, z);
+		const uint32_t lanes = std::min(4u, end - v);
+		for (uint32_t i = 0; i < lanes; ++i) {
+			positions[v + i] = XMFLOAT3((&outX.x)[i], (&outY.x)[i], (&outZ.x)[i]);
+		}
+	});
+	wi::jobsystem::Wait(context);
+}
+
+TreeWindStats TreeWindDeformer::Deform(float time, const TreeWindSettings& settings, XMFLOAT3* positions, double budgetMilliseconds) {
+	TreeWindStats stats;
+	if (vertexCount == 0) {
+		return stats;
+	}
+
+	// The first call runs unbudgeted to measure the cost per vertex
+	uint32_t count = vertexCount;
+	if (budgetMilliseconds > 0.0 && nanosecondsPerVertex > 0.0) {
+		const double affordable = budgetMilliseconds * 1e6 / nanosecondsPerVertex;
+		count = static_cast<uint32_t>(std::clamp(affordable, double(kMinWindowVertices), double(vertexCount)));
+		count = std::min((count + 3) & ~3u, vertexCount);
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	UpdatePivots(time, settings);
+	if (count >= vertexCount) {
+		DeformRange(0, vertexCount, time, settings, positions);
+		stats.ranges[stats.rangeCount++] = XMUINT2(0, vertexCount);
+		cursor = 0;
+	}
+	else {
+		// The cursor stays on a multiple of four so every window starts on a whole vector
+		const uint32_t head = std::min(count, vertexCount - cursor);
+		DeformRange(cursor, head, time, settings, positions);
+		stats.ranges[stats.rangeCount++] = XMUINT2(cursor, head);
+		const uint32_t wrapped = count - head;
+		if (wrapped > 0) {
+			DeformRange(0, wrapped, time, settings, positions);
+			stats.ranges[stats.rangeCount++] = XMUINT2(0, wrapped);
+			cursor = wrapped & ~3u;
+		}
+		else {
+			cursor = cursor + head >= vertexCount ? 0 : cursor + head;
+		}
+	}
+	stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	stats.vertexCount = count;
+
+	const double measured = stats.milliseconds * 1e6 / count;
+	nanosecondsPerVertex = nanosecondsPerVertex == 0.0 ? measured : nanosecondsPerVertex * 0.9 + measured * 0.1;
+	stats.nanosecondsPerVertex = nanosecondsPerVertex;
+	return stats;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "TreeMesh.h"
+
+struct TreeSkeleton;
+
+struct TreeWindSettings {
+	DirectX::XMFLOAT3 direction = DirectX::XMFLOAT3(1, 0, 0);  // Horizontal, normalized
+	float strength = 1.0f;          // Scales every layer, 0 returns the rest pose
+	float trunkAmplitude = 0.02f;   // Lean of the tree top as a fraction of the tree height
+	float trunkFrequency = 0.4f;    // Radians per second
+	float branchAmplitude = 0.06f;  // Sway of a branch tip as a fraction of the branch length
+	float branchFrequency = 1.7f;
+	float levelFrequency = 0.3f;    // Each branch level deeper swings this much faster, relative to branchFrequency
+	float leafAmplitude = 0.03f;    // Flutter of foliage in world units
+	float leafFrequency = 7.0f;
+};
+
+struct TreeWindStats {
+	DirectX::XMUINT2 ranges[2];     // (first, count) of the vertices written this call, the window wraps around the end
+	uint32_t rangeCount = 0;
+	uint32_t vertexCount = 0;
+	double milliseconds = 0.0;
+	double nanosecondsPerVertex = 0.0;  // Smoothed over calls, drives the budget
+};
+
+// Layered trunk, branch and leaf sway on the CPU for meshes that are not skinned.
+// Sway is hierarchical: a chain first moves with everything its parent pivot moves by, then sways around it.
+// Per-vertex data is kept as structure of arrays so the pass runs four vertices per DirectXMath vector, spread over the job system.
+class TreeWindDeformer {
+public:
+	// Capture rest positions and hierarchy data of a mesh in its final vertex order, skeleton should have one bone per chain
+	void Setup(const DirectX::XMFLOAT3* positions, uint32_t vertexCount, const std::vector<TreeMeshSpan>& spans, const std::vector<uint32_t>& remap, const TreeSkeleton& skeleton);
+	void Reset();
+
+	// A vertex was moved by growth, wind is applied around its new rest position from now on
+	void SetRestPosition(uint32_t vertex, const DirectX::XMFLOAT3& position);
+
+	// Write deformed positions. With a budget, only as many vertices as fit are processed, continuing where the last call stopped.
+	// Mesh bounds are not grown, sway is expected to stay inside the culling slack.
+	TreeWindStats Deform(float time, const TreeWindSettings& settings, DirectX::XMFLOAT3* positions, double budgetMilliseconds = 0.0);
+
+	uint32_t GetVertexCount() const { return vertexCount; }
+
+private:
+	void UpdatePivots(float time, const TreeWindSettings& settings);
+	void DeformRange(uint32_t first, uint32_t count, float time, const TreeWindSettings& settings, DirectX::XMFLOAT3* positions) const;
+
+	// Padded to a multiple of four
+	std::vector<float> restX;
+	std::vector<float> restY;
+	std::vector<float> restZ;
+	std::vector<float> trunkWeight;    // (height above the base / tree height)^2
+	std::vector<float> branchWeight;   // (distance along the branch / branch length)^2 * branch length, 0 on the trunk
+	std::vector<float> leafWeight;     // 1 on foliage
+	std::vector<float> phase;          // Per branch, so neighbours don't swing in lockstep
+	std::vector<float> level;          // Branch level of the vertex's chain, 0 on the trunk
+	std::vector<uint32_t> pivot;       // Chain whose parent pivot the vertex hangs from, indexes the per chain arrays
+
+	// Per chain, parents before children
+	std::vector<int> chainParent;
+	std::vector<float> chainLevel;
+	std::vector<float> chainPhase;
+	std::vector<float> pivotWeight;    // Parent's branchWeight at the chain's pivot
+	std::vector<float> pivotSway;      // Sway the pivot inherits from all ancestors this frame, rebuilt by UpdatePivots
+	float treeHeight = 0.0f;
+	uint32_t vertexCount = 0;
+	uint32_t cursor = 0;
+	double nanosecondsPerVertex = 0.0;
+};
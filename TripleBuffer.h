@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// One producer and one consumer hand over whole values without waiting on each other. The producer fills its back slot
+// and publishes it, the consumer takes the newest published slot whenever it wants, values it never saw are skipped.
+template <typename T>
+class TripleBuffer {
+public:
+	// Producer side
+	T& GetWriteBuffer() { return slots[back]; }
+	void Publish() {
+		back = middle.exchange(back | kFresh, std::memory_order_acq_rel) & kIndexMask;
+	}
+
+	// Consumer side: the newest published value, or nullptr when nothing was published since the last call.
+	// The returned slot belongs to the consumer until its next Acquire.
+	T* Acquire() {
+		if ((middle.load(std::memory_order_relaxed) & kFresh) == 0) {
+			return nullptr;
+		}
+		front = middle.exchange(front, std::memory_order_acq_rel) & kIndexMask;
+		return &slots[front];
+	}
+	T& GetReadBuffer() { return slots[front]; }
+
+	// Forget published values, neither side may be using the buffer
+	void Reset() {
+		back = 0;
+		middle.store(1, std::memory_order_relaxed);
+		front = 2;
+	}
+
+private:
+	static constexpr uint32_t kIndexMask = 3;
+	static constexpr uint32_t kFresh = 4;
+
+	T slots[3];
+	uint32_t back = 0;                      // Producer only
+	std::atomic<uint32_t> middle{ 1 };      // Slot index, kFresh when the producer published it after the last Acquire
+	uint32_t front = 2;                     // Consumer only
+};
@@ -2,10 +2,13 @@
 
 #include <DirectXMath.h>
 #include "TwoOLSystem.h" // Include your L-system library header
+#include "StructuredLog.h"
 #include <sstream>
 #include <fstream>
 #include <iostream>
 #include <vector>
+#include <unordered_map>
+#include <algorithm>
 
 std::string LSystemNode::serialize() const {
 	std::ostringstream oss;
@@ -21,8 +24,9 @@ LSystemNode LSystemNode::deserialize(const std::string& data) {
 	std::istringstream iss(data);
 	int typeInt;
 
-	// Output the input data for debugging
-	wi::backlog::post("Deserializing data: [" + data + "]", wi::backlog::LogLevel::Default);
+	// Per node diagnostics are Trace, compiled out of release builds and skipped at runtime unless the structured log
+	// is installed at Trace level
+	LOG_TRACE("Deserializing data: [{}]", data);
 
 	// Check for leading and trailing whitespaces
 	if (data.empty()) {
@@ -34,60 +38,60 @@ LSystemNode LSystemNode::deserialize(const std::string& data) {
 		wi::backlog::post("Failed to read type. Input data: [" + data + "]", wi::backlog::LogLevel::Error);
 		return node;
 	}
-	//wi::backlog::post("Read type: " + std::to_string(typeInt), wi::backlog::LogLevel::Default);
+	LOG_TRACE("Read type: {}", typeInt);
 
 	if (!(iss >> node.nodeid)) {
 		wi::backlog::post("Failed to read nodeid", wi::backlog::LogLevel::Error);
 		return node;
 	}
-	//wi::backlog::post("Read nodeid: " + std::to_string(node.nodeid), wi::backlog::LogLevel::Default);
+	LOG_TRACE("Read nodeid: {}", node.nodeid);
 
 	if (!(iss >> node.parentid)) {
 		wi::backlog::post("Failed to read parentid", wi::backlog::LogLevel::Error);
 		return node;
 	}
-	//wi::backlog::post("Read parentid: " + std::to_string(node.parentid), wi::backlog::LogLevel::Default);
+	LOG_TRACE("Read parentid: {}", node.parentid);
 
 	if (!(iss >> node.stage)) {
 		wi::backlog::post("Failed to read stage", wi::backlog::LogLevel::Error);
 		return node;
 	}
-	//wi::backlog::post("Read stage: " + std::to_string(node.stage), wi::backlog::LogLevel::Default);
+	LOG_TRACE("Read stage: {}", node.stage);
 
 	if (!(iss >> node.length)) {
 		wi::backlog::post("Failed to read length", wi::backlog::LogLevel::Error);
 		return node;
 	}
-	//wi::backlog::post("Read length: " + std::to_string(node.length), wi::backlog::LogLevel::Default);
+	LOG_TRACE("Read length: {}", node.length);
 
 	if (!(iss >> node.radius)) {
 		wi::backlog::post("Failed to read radius", wi::backlog::LogLevel::Error);
 		return node;
 	}
-	//wi::backlog::post("Read radius: " + std::to_string(node.radius), wi::backlog::LogLevel::Default);
+	LOG_TRACE("Read radius: {}", node.radius);
 
 	if (!(iss >> node.angle)) {
 		wi::backlog::post("Failed to read angle", wi::backlog::LogLevel::Error);
 		return node;
 	}
-	//wi::backlog::post("Read angle: " + std::to_string(node.angle), wi::backlog::LogLevel::Default);
+	LOG_TRACE("Read angle: {}", node.angle);
 
 	if (!(iss >> node.position.x >> node.position.y >> node.position.z)) {
 		wi::backlog::post("Failed to read position", wi::backlog::LogLevel::Error);
 		return node;
 	}
-	//wi::backlog::post("Read position: " + std::to_string(node.position.x) + ", " + std::to_string(node.position.y) + ", " + std::to_string(node.position.z), wi::backlog::LogLevel::Default);
+	LOG_TRACE("Read position: {}, {}, {}", node.position.x, node.position.y, node.position.z);
 
 	if (!(iss >> node.rotation.x >> node.rotation.y >> node.rotation.z >> node.rotation.w)) {
 		wi::backlog::post("Failed to read rotation", wi::backlog::LogLevel::Error);
 		return node;
 	}
-	//wi::backlog::post("Read rotation: " + std::to_string(node.rotation.x) + ", " + std::to_string(node.rotation.y) + ", " + std::to_string(node.rotation.z) + ", " + std::to_string(node.rotation.w), wi::backlog::LogLevel::Default);
+	LOG_TRACE("Read rotation: {}, {}, {}, {}", node.rotation.x, node.rotation.y, node.rotation.z, node.rotation.w);
 
 	node.type = static_cast<NodeType>(typeInt);
 
 	// Output the nodeid after deserialization for debugging
-	wi::backlog::post("Deserialized node ID: " + std::to_string(node.nodeid), wi::backlog::LogLevel::Default);
+	LOG_TRACE("Deserialized node ID: {}", node.nodeid);
 
 	return node;
 }
@@ -134,6 +138,134 @@ std::vector<LSystemGeneration> loadGenerationsFromFile(const std::string& filena
 	return generations;
 }
 
+std::vector<const LSystemNode*> flattenGenerations(const std::vector<LSystemGeneration>& generations) {
+	std::vector<const LSystemNode*> nodes;
+	size_t count = 0;
+	for (const auto& generation : generations) {
+		count += generation.size();
+	}
+	nodes.reserve(count);
+	for (const auto& generation : generations) {
+		for (const auto& node : generation) {
+			nodes.push_back(&node);
+		}
+	}
+	return nodes;
+}
+
+LSystemHierarchy buildHierarchy(const std::vector<LSystemGeneration>& generations) {
+	LSystemHierarchy hierarchy;
+	std::vector<const LSystemNode*> nodes = flattenGenerations(generations);
+	const uint32_t nodeCount = static_cast<uint32_t>(nodes.size());
+
+	// Resolve parent ids to flat indices, the first node with a given id wins
+	std::unordered_map<int, uint32_t> indexById;
+	indexById.reserve(nodeCount);
+	for (uint32_t i = 0; i < nodeCount; ++i) {
+		indexById.emplace(nodes[i]->nodeid, i);
+	}
+
+	hierarchy.parents.resize(nodeCount, -1);
+	hierarchy.childOffsets.assign(nodeCount + 1, 0);
+	for (uint32_t i = 0; i < nodeCount; ++i) {
+		auto it = indexById.find(nodes[i]->parentid);
+		if (it != indexById.end() && it->second != i) {
+			hierarchy.parents[i] = static_cast<int>(it->second);
+			hierarchy.childOffsets[it->second + 1]++;
+		}
+	}
+	for (uint32_t i = 0; i < nodeCount; ++i) {
+		hierarchy.childOffsets[i + 1] += hierarchy.childOffsets[i];
+	}
+
+	hierarchy.children.resize(hierarchy.childOffsets[nodeCount]);
+	std::vector<uint32_t> fill(hierarchy.childOffsets.begin(), hierarchy.childOffsets.end() - 1);
+	for (uint32_t i = 0; i < nodeCount; ++i) {
+		if (hierarchy.parents[i] >= 0) {
+			hierarchy.children[fill[hierarchy.parents[i]]++] = i;
+		}
+	}
+
+	// Depth-first order from every root, nodes caught in parent cycles are appended at the end
+	hierarchy.order.reserve(nodeCount);
+	std::vector<uint8_t> visited(nodeCount, 0);
+	std::vector<uint32_t> stack;
+	auto visit = [&](uint32_t root) {
+		stack.push_back(root);
+		while (!stack.empty()) {
+			uint32_t node = stack.back();
+			stack.pop_back();
+			if (visited[node]) {
+				continue;
+			}
+			visited[node] = 1;
+			hierarchy.order.push_back(node);
+			for (uint32_t c = hierarchy.childOffsets[node + 1]; c > hierarchy.childOffsets[node]; --c) {
+				stack.push_back(hierarchy.children[c - 1]);
+			}
+		}
+	};
+	for (uint32_t i = 0; i < nodeCount; ++i) {
+		if (hierarchy.parents[i] < 0) {
+			visit(i);
+		}
+	}
+	for (uint32_t i = 0; i < nodeCount; ++i) {
+		if (!visited[i]) {
+			visit(i);
+		}
+	}
+
+	return hierarchy;
+}
+
+// Length and radius gained per simulated second once a node's stage is reached
+static float growthRate(NodeType type) {
+	switch (type) {
+	case NodeType::Forward:
+		return 0.100f;
+	case NodeType::Branch:
+		return 0.050f;
+	case NodeType::Twig:
+		return 0.010f;
+	case NodeType::Leaf:
+		return 0.005f;
+	case NodeType::Decal:
+		return 0.001f;
+	default:
+		return 0.0f;
+	}
+}
+
+void stepGrowth(std::vector<LSystemGeneration>& generations, double time, double dt) {
+	for (auto& gen : generations) {
+		for (auto& node : gen) {
+			if (time > node.stage) {
+				const float delta = static_cast<float>(dt) * growthRate(node.type);
+				node.length = std::max(node.length + delta, 0.0f);
+				node.radius = std::max(node.radius + delta, 0.0f);
+			}
+		}
+	}
+}
+
+void fastForwardGrowth(std::vector<LSystemGeneration>& generations, double time, double duration) {
+	// Only the part of the interval after a node's stage counts, which is what infinitely small steps would add up to
+	const double lower = std::min(time, time + duration);
+	const double upper = std::max(time, time + duration);
+	const double direction = duration < 0.0 ? -1.0 : 1.0;
+	for (auto& gen : generations) {
+		for (auto& node : gen) {
+			const double active = upper - std::max(lower, static_cast<double>(node.stage));
+			if (active > 0.0) {
+				const double delta = direction * active * growthRate(node.type);
+				node.length = static_cast<float>(std::max(node.length + delta, 0.0));
+				node.radius = static_cast<float>(std::max(node.radius + delta, 0.0));
+			}
+		}
+	}
+}
+
 void simulateGrowth(std::vector<LSystemGeneration>& generations, double elapsedTime) {
 	float timeScale = static_cast<float>(elapsedTime) / 1000000.0f; // Convert to seconds
 	for (auto& gen : generations) {
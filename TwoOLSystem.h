@@ -1,6 +1,7 @@
 #pragma once
 
 #include "framework.h"
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <DirectXMath.h>
@@ -38,8 +39,29 @@ public:
 // Structure for representing a generation (collection of nodes)
 using LSystemGeneration = std::vector<LSystemNode>;
 
+// Parent/child links between nodes, addressed by flat index (running index over all generations)
+struct LSystemHierarchy {
+	std::vector<int> parents;             // Flat index of each node's parent, -1 for roots
+	std::vector<uint32_t> childOffsets;   // Children of node i are children[childOffsets[i] .. childOffsets[i + 1])
+	std::vector<uint32_t> children;
+	std::vector<uint32_t> order;          // Depth-first order, every parent before its children
+
+	size_t size() const { return parents.size(); }
+	uint32_t childCount(uint32_t node) const { return childOffsets[node + 1] - childOffsets[node]; }
+};
+
 // Function declarations for operations with L-system generations
 void saveGenerationsToFile(const std::vector<LSystemGeneration>& generations, const std::string& filename);
 std::vector<LSystemGeneration> loadGenerationsFromFile(const std::string& filename);
+std::vector<const LSystemNode*> flattenGenerations(const std::vector<LSystemGeneration>& generations);
+LSystemHierarchy buildHierarchy(const std::vector<LSystemGeneration>& generations);
 void simulateGrowth(std::vector<LSystemGeneration>& generations, double elapsedTime);
 void simulateNegativeGrowth(std::vector<LSystemGeneration>& generations, double elapsedTime);
+
+// Advance growth by dt simulated seconds (negative shrinks) from time, for fixed timestep callers such as GrowthScheduler.
+// Nodes grow at a constant rate per type once time passes their stage, length and radius never drop below zero.
+void stepGrowth(std::vector<LSystemGeneration>& generations, double time, double dt);
+
+// Closed form of stepGrowth over any interval: the result small steps converge to, in one pass over the nodes however
+// long the interval is. Nodes whose stage falls inside the interval only grow for the part after it.
+void fastForwardGrowth(std::vector<LSystemGeneration>& generations, double time, double duration);
@@ -0,0 +1,161 @@
+#include "VertexQuantization.h"
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+size_t QuantizedTreeMesh::GetSizeInBytes() const {
+	return vertices.size() * sizeof(PackedTreeVertex) + indices16.size() * sizeof(uint16_t) + indices32.size() * sizeof(uint32_t);
+}
+
+static int16_t ToSnorm16(float value) {
+	return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+uint32_t EncodeOctahedralNormal(FXMVECTOR normal) {
+	XMFLOAT3 n;
+	XMStoreFloat3(&n, normal);
+	const float sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	float x = sum > 0.0f ? n.x / sum : 0.0f;
+	float y = sum > 0.0f ? n.y / sum : 0.0f;
+
+	// Fold the lower hemisphere over the diagonals
+	if (n.z < 0.0f) {
+		const float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		const float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+	return static_cast<uint16_t>(ToSnorm16(x)) | (static_cast<uint32_t>(static_cast<uint16_t>(ToSnorm16(y))) << 16);
+}
+
+XMVECTOR DecodeOctahedralNormal(int16_t encodedX, int16_t encodedY) {
+	float x = std::max(encodedX / 32767.0f, -1.0f);
+	float y = std::max(encodedY / 32767.0f, -1.0f);
+	const float z = 1.0f - fabsf(x) - fabsf(y);
+	if (z < 0.0f) {
+		const float unfoldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		const float unfoldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = unfoldedX;
+		y = unfoldedY;
+	}
+	return XMVector3Normalize(XMVectorSet(x, y, z, 0.0f));
+}
+
+void QuantizeTreeMesh(const TreeMeshData& mesh, QuantizedTreeMesh& packed, QuantizationReport* report) {
+	packed = QuantizedTreeMesh();
+	const size_t vertexCount = mesh.vertex_positions.size();
+	if (vertexCount == 0) {
+		return;
+	}
+
+	XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+	for (const auto& position : mesh.vertex_positions) {
+		boundsMin = XMVectorMin(boundsMin, XMLoadFloat3(&position));
+		boundsMax = XMVectorMax(boundsMax, XMLoadFloat3(&position));
+	}
+	XMStoreFloat3(&packed.aabbMin, boundsMin);
+	XMStoreFloat3(&packed.aabbMax, boundsMax);
+
+	// Flat axes still get a nonzero extent so the scale stays finite
+	XMVECTOR extent = XMVectorMax(XMVectorSubtract(boundsMax, boundsMin), XMVectorReplicate(1e-6f));
+	XMVECTOR scale = XMVectorDivide(XMVectorReplicate(65535.0f), extent);
+
+	packed.vertices.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i) {
+		PackedTreeVertex& vertex = packed.vertices[i];
+		XMFLOAT3 quantized;
+		XMStoreFloat3(&quantized, XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&mesh.vertex_positions[i]), boundsMin), scale));
+		vertex.position[0] = static_cast<uint16_t>(std::clamp(std::lround(quantized.x), 0l, 65535l));
+		vertex.position[1] = static_cast<uint16_t>(std::clamp(std::lround(quantized.y), 0l, 65535l));
+		vertex.position[2] = static_cast<uint16_t>(std::clamp(std::lround(quantized.z), 0l, 65535l));
+		vertex.reserved = 0;
+
+		const uint32_t normal = EncodeOctahedralNormal(XMLoadFloat3(&mesh.vertex_normals[i]));
+		vertex.normal[0] = static_cast<int16_t>(normal & 0xFFFF);
+		vertex.normal[1] = static_cast<int16_t>(normal >> 16);
+
+		vertex.uv[0] = XMConvertFloatToHalf(mesh.vertex_uvs[i].x);
+		vertex.uv[1] = XMConvertFloatToHalf(mesh.vertex_uvs[i].y);
+	}
+
+	// Subsets that reference less than 64K consecutive vertices can use short indices relative to their first vertex
+	bool shortIndices = true;
+	for (const auto& subset : mesh.subsets) {
+		uint32_t lowest = UINT32_MAX;
+		uint32_t highest = 0;
+		for (uint32_t i = 0; i < subset.indexCount; ++i) {
+			lowest = std::min(lowest, mesh.indices[subset.indexOffset + i]);
+			highest = std::max(highest, mesh.indices[subset.indexOffset + i]);
+		}
+		const uint32_t baseVertex = subset.indexCount > 0 ? lowest : 0;
+		shortIndices &= subset.indexCount == 0 || highest - lowest <= 0xFFFF;
+		packed.subsets.push_back({ subset.indexOffset, subset.indexCount, baseVertex, subset.lod, subset.part });
+	}
+	if (shortIndices) {
+		packed.indices16.resize(mesh.indices.size());
+		for (const auto& subset : packed.subsets) {
+			for (uint32_t i = 0; i < subset.indexCount; ++i) {
+				packed.indices16[subset.indexOffset + i] = static_cast<uint16_t>(mesh.indices[subset.indexOffset + i] - subset.baseVertex);
+			}
+		}
+	}
+	else {
+		packed.indices32 = mesh.indices;
+		for (auto& subset : packed.subsets) {
+			subset.baseVertex = 0;
+		}
+	}
+
+	if (report != nullptr) {
+		TreeMeshData decoded;
+		DequantizeTreeMesh(packed, decoded);
+		*report = QuantizationReport();
+		XMFLOAT3 extentf;
+		XMStoreFloat3(&extentf, extent);
+		report->positionErrorBound = 0.5f * sqrtf(extentf.x * extentf.x + extentf.y * extentf.y + extentf.z * extentf.z) / 65535.0f;
+		float minNormalCos = 1.0f;
+		for (size_t i = 0; i < vertexCount; ++i) {
+			const float positionError = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&decoded.vertex_positions[i]), XMLoadFloat3(&mesh.vertex_positions[i]))));
+			report->maxPositionError = std::max(report->maxPositionError, positionError);
+			XMVECTOR sourceNormal = XMVector3Normalize(XMLoadFloat3(&mesh.vertex_normals[i]));
+			minNormalCos = std::min(minNormalCos, XMVectorGetX(XMVector3Dot(sourceNormal, XMLoadFloat3(&decoded.vertex_normals[i]))));
+			report->maxUVError = std::max({ report->maxUVError, fabsf(decoded.vertex_uvs[i].x - mesh.vertex_uvs[i].x), fabsf(decoded.vertex_uvs[i].y - mesh.vertex_uvs[i].y) });
+		}
+		report->maxNormalErrorDegrees = XMConvertToDegrees(acosf(std::clamp(minNormalCos, -1.0f, 1.0f)));
+		report->sourceBytes = vertexCount * (sizeof(XMFLOAT3) * 2 + sizeof(XMFLOAT2)) + mesh.indices.size() * sizeof(uint32_t);
+		report->packedBytes = packed.GetSizeInBytes();
+	}
+}
+
+void DequantizeTreeMesh(const QuantizedTreeMesh& packed, TreeMeshData& mesh) {
+	mesh = TreeMeshData();
+	const size_t vertexCount = packed.vertices.size();
+	XMVECTOR boundsMin = XMLoadFloat3(&packed.aabbMin);
+	XMVECTOR extent = XMVectorMax(XMVectorSubtract(XMLoadFloat3(&packed.aabbMax), boundsMin), XMVectorReplicate(1e-6f));
+	XMVECTOR step = XMVectorDivide(extent, XMVectorReplicate(65535.0f));
+
+	mesh.vertex_positions.resize(vertexCount);
+	mesh.vertex_normals.resize(vertexCount);
+	mesh.vertex_uvs.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i) {
+		const PackedTreeVertex& vertex = packed.vertices[i];
+		XMVECTOR quantized = XMVectorSet(vertex.position[0], vertex.position[1], vertex.position[2], 0.0f);
+		XMStoreFloat3(&mesh.vertex_positions[i], XMVectorMultiplyAdd(quantized, step, boundsMin));
+		XMStoreFloat3(&mesh.vertex_normals[i], DecodeOctahedralNormal(vertex.normal[0], vertex.normal[1]));
+		mesh.vertex_uvs[i] = XMFLOAT2(XMConvertHalfToFloat(vertex.uv[0]), XMConvertHalfToFloat(vertex.uv[1]));
+	}
+
+	mesh.indices.resize(packed.HasShortIndices() ? packed.indices16.size() : packed.indices32.size());
+	for (const auto& subset : packed.subsets) {
+		for (uint32_t i = 0; i < subset.indexCount; ++i) {
+			const uint32_t index = subset.indexOffset + i;
+			mesh.indices[index] = packed.HasShortIndices() ? packed.indices16[index] + subset.baseVertex : packed.indices32[index];
+		}
+		mesh.subsets.push_back({ subset.indexOffset, subset.indexCount, subset.lod, subset.part });
+	}
+}
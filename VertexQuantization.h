@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "TreeMesh.h"
+
+// Interleaved 16 byte vertex
+struct PackedTreeVertex {
+	uint16_t position[3];  // Unorm16 inside the mesh AABB
+	uint16_t reserved;     // Keeps the stride at 16 bytes
+	int16_t normal[2];     // Octahedral encoded, snorm16
+	uint16_t uv[2];        // Half floats
+};
+static_assert(sizeof(PackedTreeVertex) == 16, "PackedTreeVertex is meant to stay 16 bytes");
+
+struct QuantizedTreeSubset {
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	uint32_t baseVertex;   // Added to every index of the subset
+	uint32_t lod;
+	TreeMeshPart part;
+};
+
+struct QuantizedTreeMesh {
+	DirectX::XMFLOAT3 aabbMin = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT3 aabbMax = DirectX::XMFLOAT3(0, 0, 0);
+	std::vector<PackedTreeVertex> vertices;
+	std::vector<uint16_t> indices16;      // Used when every subset spans fewer than 65536 vertices
+	std::vector<uint32_t> indices32;      // Otherwise
+	std::vector<QuantizedTreeSubset> subsets;
+
+	bool HasShortIndices() const { return indices32.empty(); }
+	size_t GetSizeInBytes() const;
+};
+
+// Measured against the source mesh
+struct QuantizationReport {
+	float maxPositionError = 0.0f;       // World units
+	float positionErrorBound = 0.0f;     // Half a quantization step along the AABB diagonal, maxPositionError never exceeds it
+	float maxNormalErrorDegrees = 0.0f;
+	float maxUVError = 0.0f;
+	size_t sourceBytes = 0;
+	size_t packedBytes = 0;
+};
+
+uint32_t EncodeOctahedralNormal(DirectX::FXMVECTOR normal);   // Two snorm16 in the low and high halves
+DirectX::XMVECTOR DecodeOctahedralNormal(int16_t x, int16_t y);
+
+void QuantizeTreeMesh(const TreeMeshData& mesh, QuantizedTreeMesh& packed, QuantizationReport* report = nullptr);
+
+// Expand back into float arrays, spans and remap are not stored and stay empty
+void DequantizeTreeMesh(const QuantizedTreeMesh& packed, TreeMeshData& mesh);
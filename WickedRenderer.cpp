@@ -1,4 +1,5 @@
 #include "WickedRenderer.h"
+#include "MeshOptimizer.h"
 #include <unordered_map>
 #include <fstream>
 #include <algorithm>
@@ -7,6 +8,9 @@
 #include <iostream>
 #include <random>
 #include <vector>
+#include <cfloat>
+#include <chrono>
+#include <functional>
 
 //using namespace wi;
 using namespace wi::ecs;
@@ -18,138 +22,180 @@ WickedRenderer::WickedRenderer() {
 }
 
 WickedRenderer::~WickedRenderer() {
-    // Destructor implementation
-}
-
-struct Vertex {
-	XMFLOAT3 position;
-	XMFLOAT3 normal;
-	XMFLOAT2 uv;
-
-	bool operator==(const Vertex& other) const {
-		return position.x == other.position.x && position.y == other.position.y && position.z == other.position.z &&
-			normal.x == other.normal.x && normal.y == other.normal.y && normal.z == other.normal.z &&
-			uv.x == other.uv.x && uv.y == other.uv.y;
-	}
-};
-
-namespace std {
-	template <>
-	struct hash<Vertex> {
-		size_t operator()(const Vertex& v) const {
-			size_t h1 = hash<float>()(v.position.x);
-			size_t h2 = hash<float>()(v.position.y);
-			size_t h3 = hash<float>()(v.position.z);
-			size_t h4 = hash<float>()(v.normal.x);
-			size_t h5 = hash<float>()(v.normal.y);
-			size_t h6 = hash<float>()(v.normal.z);
-			size_t h7 = hash<float>()(v.uv.x);
-			size_t h8 = hash<float>()(v.uv.y);
-			return h1 ^ (h2 << 1) ^ (h3 << 2) ^ (h4 << 3) ^ (h5 << 4) ^ (h6 << 5) ^ (h7 << 6) ^ (h8 << 7);
-		}
-	};
+    // Let a background build notice it was superseded before the staging area goes away
+    latestBuild++;
+    wi::jobsystem::Wait(buildContext);
 }
 
-static void WeldVertices(
-	const std::vector<XMFLOAT3>& vertex_positions,
-	const std::vector<XMFLOAT3>& vertex_normals,
-	const std::vector<XMFLOAT2>& vertex_uvs,
-	std::vector<XMFLOAT3>& weldedVertexPositions,
-	std::vector<XMFLOAT3>& weldedVertexNormals,
-	std::vector<XMFLOAT2>& weldedVertexUVs,
-	std::vector<uint32_t>& weldedIndices
-) {
-	std::unordered_map<Vertex, uint32_t> uniqueVertices;
-	for (size_t i = 0; i < vertex_positions.size(); ++i) {
-		Vertex vertex = { vertex_positions[i], vertex_normals[i], vertex_uvs[i] };
-		auto it = uniqueVertices.find(vertex);
-		if (it == uniqueVertices.end()) {
-			uint32_t newIndex = static_cast<uint32_t>(weldedVertexPositions.size());
-			uniqueVertices[vertex] = newIndex;
-
-			weldedVertexPositions.push_back(vertex_positions[i]);
-			weldedVertexNormals.push_back(vertex_normals[i]);
-			weldedVertexUVs.push_back(vertex_uvs[i]);
-			weldedIndices.push_back(newIndex);
-		}
-		else {
-			weldedIndices.push_back(it->second);
-		}
+// Generation, welding and GPU ordering shared by every path that meshes a whole tree.
+// Returns false when cancelled reports true between stages, meshData is then incomplete.
+static bool BuildTreeMesh(const std::vector<LSystemGeneration>& generations, const TreeMeshSettings& settings, TreeMeshData& meshData, const std::function<bool()>& cancelled = nullptr) {
+	GenerateMesh(generations, settings, meshData);
+	if (cancelled && cancelled()) {
+		return false;
 	}
+
+	// Weld vertices
+	WeldVertices(meshData);
+	if (cancelled && cancelled()) {
+		return false;
+	}
+
+	if (settings.optimizeVertexCache) {
+		MeshOptimizeReport report;
+		OptimizeTreeMesh(meshData, &report);
+		wi::backlog::post("Vertex cache ACMR " + std::to_string(report.before.acmr) + " -> " + std::to_string(report.after.acmr) +
+			", ATVR " + std::to_string(report.before.atvr) + " -> " + std::to_string(report.after.atvr) +
+			" in " + std::to_string(report.milliseconds) + " ms", wi::backlog::LogLevel::Default);
+	}
+	return true;
 }
 
-static void GenerateMesh(const std::vector<LSystemNode>& nodes, std::vector<XMFLOAT3>& vertex_positions, std::vector<XMFLOAT3>& vertex_normals, std::vector<XMFLOAT2>& vertex_uvs, std::vector<uint32_t>& indices) {
-	std::vector<XMFLOAT3> weldedVertexPositions;
-	std::vector<XMFLOAT3> weldedVertexNormals;
-	std::vector<XMFLOAT2> weldedVertexUVs;
-	std::vector<uint32_t> weldedIndices;
+// BuildTreeMesh behind the on-disk cache when a cache directory is set
+static bool LoadOrBuildTreeMesh(const std::vector<LSystemGeneration>& generations, const TreeMeshSettings& settings, const std::string& cacheDirectory, TreeMeshData& meshData, const std::function<bool()>& cancelled = nullptr) {
+	if (cacheDirectory.empty()) {
+		return BuildTreeMesh(generations, settings, meshData, cancelled);
+	}
 
-	// Prepare for mesh generation
-	for (const auto& node : nodes) {
-		float radius = node.radius;
-		float height = node.length;
+	auto start = std::chrono::high_resolution_clock::now();
+	const uint64_t key = HashTreeMeshKey(generations, settings);
+	const std::string path = TreeMeshCachePath(cacheDirectory, key);
+	if (LoadTreeMeshCache(path, key, meshData)) {
+		wi::backlog::post("Loaded tree mesh from cache " + path + " in " + std::to_string(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count()) + " ms", wi::backlog::LogLevel::Default);
+		return true;
+	}
 
-		// Current node's position and rotation
-		DirectX::XMFLOAT3 position = node.position;
-		DirectX::XMFLOAT4 rotation = node.rotation;
+	if (!BuildTreeMesh(generations, settings, meshData, cancelled)) {
+		return false;
+	}
+	if (!SaveTreeMeshCache(path, key, meshData)) {
+		wi::backlog::post("Could not write tree mesh cache " + path, wi::backlog::LogLevel::Warning);
+	}
+	return true;
+}
+
+static void BuildTreeMeshlets(const TreeMeshData& meshData, const TreeMeshSettings& settings, TreeMeshletData& meshlets) {
+	meshlets = TreeMeshletData();
+	if (!settings.buildMeshlets) {
+		return;
+	}
+
+	// Foliage is double-sided, so its clusters must never be cone culled
+	std::vector<uint32_t> foliageSubsets;
+	for (uint32_t i = 0; i < meshData.subsets.size(); ++i) {
+		if (meshData.subsets[i].part == TreeMeshPart::Foliage) {
+			foliageSubsets.push_back(i);
+		}
+	}
+	BuildMeshlets(meshData, meshlets, settings.meshletMaxVertices, settings.meshletMaxTriangles, foliageSubsets);
+	wi::backlog::post("Partitioned tree into " + std::to_string(meshlets.meshlets.size()) + " meshlets", wi::backlog::LogLevel::Default);
+}
 
-		// Calculate forward vector
-		DirectX::XMVECTOR forwardVec = DirectX::XMVector3Rotate(DirectX::XMVectorSet(0, height, 0, 0), DirectX::XMLoadFloat4(&rotation));
-		DirectX::XMVECTOR currentPosVec = DirectX::XMLoadFloat3(&position);
-		DirectX::XMVECTOR newPosVec = DirectX::XMVectorAdd(currentPosVec, forwardVec);
-		DirectX::XMStoreFloat3(&position, newPosVec);
+// Bones and weights for a freshly meshed tree, left empty unless the settings ask for them
+static void BuildTreeSkin(const std::vector<LSystemGeneration>& generations, const TreeMeshData& meshData, const TreeMeshSettings& settings, TreeSkeleton& skeleton, TreeSkinWeights& skin) {
+	skeleton = TreeSkeleton();
+	skin = TreeSkinWeights();
+	if (!settings.buildSkeleton) {
+		return;
+	}
+	BuildTreeSkeleton(generations, settings.maxBones, skeleton);
+	ComputeSkinWeights(meshData, skeleton, skin);
+	wi::backlog::post("Skinned tree to " + std::to_string(skeleton.bones.size()) + " bones", wi::backlog::LogLevel::Default);
+}
 
-		const uint32_t segments = 16; // Number of segments around the cylinder
-		float segment_angle = XM_2PI / static_cast<float>(segments);
+void WickedRenderer::CreateTree(scene::Scene& scene, const std::string& name, const std::vector<LSystemGeneration>& generations) {
+	// Supersedes any build still running in the background
+	latestBuild++;
+	buildTarget = ecs::INVALID_ENTITY;
+	rebuildQueued = false;
 
-		DirectX::XMVECTOR bottomPosVec = currentPosVec;
-		DirectX::XMVECTOR topPosVec = newPosVec;
-		DirectX::XMFLOAT3 topPos; DirectX::XMStoreFloat3(&topPos, topPosVec);
+	// Generate mesh data, one subset per LOD level
+	TreeMeshData meshData;
+	LoadOrBuildTreeMesh(generations, meshSettings, meshCacheDirectory, meshData);
 
-		for (uint32_t i = 0; i <= segments; ++i) {
-			float angle = segment_angle * i;
-			float x = radius * cos(angle);
-			float z = radius * sin(angle);
+	TreeMeshletData meshlets;
+	BuildTreeMeshlets(meshData, meshSettings, meshlets);
 
-			// Bottom vertex
-			XMFLOAT3 bottomVertex = XMFLOAT3(x, 0.0f, z);
-			DirectX::XMVECTOR rotatedBottomVertex = DirectX::XMVector3Rotate(DirectX::XMLoadFloat3(&bottomVertex), DirectX::XMLoadFloat4(&rotation));
-			DirectX::XMStoreFloat3(&bottomVertex, DirectX::XMVectorAdd(rotatedBottomVertex, bottomPosVec));
-			vertex_positions.push_back(bottomVertex);
+	TreeSkeleton skeleton;
+	TreeSkinWeights skin;
+	BuildTreeSkin(generations, meshData, meshSettings, skeleton, skin);
 
-			// Top vertex
-			XMFLOAT3 topVertex = XMFLOAT3(x, height, z);
-			DirectX::XMVECTOR rotatedTopVertex = DirectX::XMVector3Rotate(DirectX::XMLoadFloat3(&topVertex), DirectX::XMLoadFloat4(&rotation));
-			DirectX::XMStoreFloat3(&topVertex, DirectX::XMVectorAdd(rotatedTopVertex, topPosVec));
-			vertex_positions.push_back(topVertex);
+	PublishTree(scene, name, generations, meshData, meshlets, skeleton, skin);
+}
 
-			// Normals pointing outwards
-			XMFLOAT3 normal = XMFLOAT3(x, 0.0f, z);
-			DirectX::XMStoreFloat3(&normal, DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&normal)));
-			vertex_normals.push_back(normal); // Bottom vertex normal
-			vertex_normals.push_back(normal); // Top vertex normal
+void WickedRenderer::CreateTreeAsync(const std::string& name, const std::vector<LSystemGeneration>& generations) {
+	rebuildQueued = false;
+	StartBuild(name, generations, ecs::INVALID_ENTITY);
+}
 
-			// UV coordinates
-			vertex_uvs.push_back(XMFLOAT2(static_cast<float>(i) / segments, 0.0f)); // Bottom vertex UV
-			vertex_uvs.push_back(XMFLOAT2(static_cast<float>(i) / segments, 1.0f)); // Top vertex UV
+void WickedRenderer::StartBuild(const std::string& name, std::vector<LSystemGeneration> generations, ecs::Entity target) {
+	const uint64_t token = ++latestBuild;
+	buildTarget = target;
+
+	// The job works on its own copies so the caller may keep editing its generations and settings
+	auto build = std::make_shared<PendingTree>();
+	build->token = token;
+	build->name = name;
+	build->target = target;
+	build->generations = std::move(generations);
+	const TreeMeshSettings settings = meshSettings;
+	const std::string cacheDirectory = meshCacheDirectory;
+
+	wi::jobsystem::Execute(buildContext, [this, build, settings, cacheDirectory](wi::jobsystem::JobArgs) {
+		auto cancelled = [this, build] { return latestBuild.load() != build->token; };
+		if (!LoadOrBuildTreeMesh(build->generations, settings, cacheDirectory, build->meshData, cancelled) || cancelled()) {
+			return;
 		}
+		BuildTreeMeshlets(build->meshData, settings, build->meshlets);
+		BuildTreeSkin(build->generations, build->meshData, settings, build->skeleton, build->skin);
 
-		// Indices
-		for (uint32_t i = 0; i < segments; ++i) {
-			uint32_t base = i * 2;
-			uint32_t next = ((i + 1) % segments) * 2;
-			indices.push_back(base);
-			indices.push_back(next);
-			indices.push_back(base + 1);
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		if (!cancelled()) {
+			pendingTree = build;
+		}
+	});
+}
 
-			indices.push_back(next);
-			indices.push_back(next + 1);
-			indices.push_back(base + 1);
+bool WickedRenderer::PublishPending(scene::Scene& scene) {
+	std::shared_ptr<PendingTree> build;
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		build = std::move(pendingTree);
+	}
+	bool published = false;
+	if (build != nullptr && build->token == latestBuild.load()) {
+		if (build->target != ecs::INVALID_ENTITY && build->target == entity && scene.meshes.Contains(entity)) {
+			// Remeshed after nodes were added or removed, same entity, new buffers
+			treeMeshlets = std::move(build->meshlets);
+			TrackTree(build->generations, build->meshData);
+			PublishMesh(scene, entity, build->meshData, &build->skeleton, &build->skin);
 		}
+		else {
+			PublishTree(scene, build->name, build->generations, build->meshData, build->meshlets, build->skeleton, build->skin);
+		}
+		published = true;
+	}
+
+	// What UpdateTree was asked for while the rebuild ran: patched in place, or the next rebuild if the node count moved on
+	if (rebuildQueued && !IsBuildPending()) {
+		rebuildQueued = false;
+		const std::vector<LSystemGeneration> queued = std::move(queuedRebuild);
+		queuedRebuild.clear();
+		UpdateTree(scene, queued);
 	}
+	return published;
 }
 
-void WickedRenderer::CreateTree(scene::Scene& scene, const std::string& name, const std::vector<LSystemGeneration>& generations) {
+bool WickedRenderer::IsBuildPending() const {
+	if (wi::jobsystem::IsBusy(buildContext)) {
+		return true;
+	}
+	std::lock_guard<std::mutex> lock(pendingMutex);
+	return pendingTree != nullptr;
+}
+
+void WickedRenderer::PublishTree(scene::Scene& scene, const std::string& name, const std::vector<LSystemGeneration>& generations, TreeMeshData& meshData, TreeMeshletData& meshlets,
+	const TreeSkeleton& skeleton, TreeSkinWeights& skin) {
 	// Create the entity
 	ecs::Entity treeEntity = ecs::CreateEntity();
 	if (!name.empty()) {
@@ -157,50 +203,666 @@ void WickedRenderer::CreateTree(scene::Scene& scene, const std::string& name, co
 	}
 
 	scene.layers.Create(treeEntity);
-	TransformComponent& treeTransform = scene.transforms.Create(treeEntity);
+	scene.transforms.Create(treeEntity);
 	ObjectComponent& object = scene.objects.Create(treeEntity);
 
-	// Random number generator for rotation
-	std::random_device rd;
-	std::mt19937 generate(rd());
-	std::uniform_real_distribution<float> disAngle(0.0f, DirectX::XM_2PI);
-
-	std::vector<XMFLOAT3> vertex_positions;
-	std::vector<XMFLOAT3> vertex_normals;
-	std::vector<XMFLOAT2> vertex_uvs;
-	std::vector<uint32_t> indices;
-	std::vector<XMFLOAT3> weldedVertexPositions;
-	std::vector<XMFLOAT3> weldedVertexNormals;
-	std::vector<XMFLOAT2> weldedVertexUVs;
-	std::vector<uint32_t> weldedIndices;
-
-	// Generate mesh data
-	for (const auto& generation : generations) {
-		GenerateMesh(generation, vertex_positions, vertex_normals, vertex_uvs, indices);
+	treeMeshlets = std::move(meshlets);
+
+	// Remember the layout so UpdateTree can patch this tree in place
+	entity = treeEntity;
+	TrackTree(generations, meshData);
+
+	PublishMesh(scene, treeEntity, meshData, &skeleton, &skin);
+	object.meshID = treeEntity;
+}
+
+// Bone entities under a new armature attached to the tree, with local transforms relative to the parent bone
+ecs::Entity WickedRenderer::CreateArmature(scene::Scene& scene, ecs::Entity meshEntity, const TreeSkeleton& skeleton) {
+	ecs::Entity armatureEntity = ecs::CreateEntity();
+	scene.names.Create(armatureEntity) = "armature";
+	scene.transforms.Create(armatureEntity);
+	ArmatureComponent& armature = scene.armatures.Create(armatureEntity);
+	scene.Component_Attach(armatureEntity, meshEntity);
+
+	armature.boneCollection.resize(skeleton.bones.size());
+	armature.inverseBindMatrices.resize(skeleton.bones.size());
+	for (size_t b = 0; b < skeleton.bones.size(); ++b) {
+		const TreeBone& bone = skeleton.bones[b];
+		XMVECTOR rotation = XMLoadFloat4(&bone.rotation);
+		XMVECTOR head = XMLoadFloat3(&bone.head);
+		XMMATRIX bind = XMMatrixRotationQuaternion(rotation) * XMMatrixTranslationFromVector(head);
+		XMStoreFloat4x4(&armature.inverseBindMatrices[b], XMMatrixInverse(nullptr, bind));
+
+		ecs::Entity boneEntity = ecs::CreateEntity();
+		scene.names.Create(boneEntity) = "bone_" + std::to_string(b);
+		TransformComponent& transform = scene.transforms.Create(boneEntity);
+		ecs::Entity parentEntity = armatureEntity;
+		if (bone.parent >= 0) {
+			const TreeBone& parent = skeleton.bones[bone.parent];
+			XMVECTOR parentRotation = XMLoadFloat4(&parent.rotation);
+			XMVECTOR inverseParentRotation = XMQuaternionInverse(parentRotation);
+			rotation = XMQuaternionMultiply(rotation, inverseParentRotation);
+			head = XMVector3Rotate(XMVectorSubtract(head, XMLoadFloat3(&parent.head)), inverseParentRotation);
+			parentEntity = armature.boneCollection[bone.parent];
+		}
+		XMStoreFloat4(&transform.rotation_local, rotation);
+		XMStoreFloat3(&transform.translation_local, head);
+		transform.SetDirty();
+		scene.Component_Attach(boneEntity, parentEntity, true);
+		armature.boneCollection[b] = boneEntity;
 	}
+	return armatureEntity;
+}
 
-	// Weld vertices
-	WeldVertices(vertex_positions, vertex_normals, vertex_uvs, weldedVertexPositions, weldedVertexNormals, weldedVertexUVs, weldedIndices);
+const wi::Resource& WickedRenderer::GetLeafTexture() {
+	if (leafTexture.IsValid()) {
+		return leafTexture;
+	}
+	using namespace wi::graphics;
+	const uint32_t size = 64;
+	std::vector<uint32_t> pixels;
+	GenerateLeafTexture(size, pixels);
+
+	TextureDesc desc;
+	desc.width = size;
+	desc.height = size;
+	desc.mip_levels = 1;
+	desc.array_size = 1;
+	desc.format = Format::R8G8B8A8_UNORM;
+	desc.bind_flags = BindFlag::SHADER_RESOURCE;
+
+	SubresourceData data;
+	data.data_ptr = pixels.data();
+	data.row_pitch = size * GetFormatStride(desc.format);
+	data.slice_pitch = data.row_pitch * size;
+
+	Texture texture;
+	if (GetDevice()->CreateTexture(&desc, &data, &texture)) {
+		leafTexture.SetTexture(texture);
+	}
+	else {
+		wi::backlog::post("Leaf texture could not be created, foliage cards are drawn as solid quads", wi::backlog::LogLevel::Warning);
+	}
+	return leafTexture;
+}
 
-	// Create mesh component
-	MeshComponent& mesh = scene.meshes.Create(treeEntity);
-	MeshComponent::MeshSubset& subset = mesh.subsets.emplace_back();
-	subset.indexCount = static_cast<uint32_t>(weldedIndices.size());
+void WickedRenderer::PublishMesh(scene::Scene& scene, ecs::Entity meshEntity, TreeMeshData& meshData, const TreeSkeleton* skeleton, TreeSkinWeights* skin) {
+	MeshComponent* existing = scene.meshes.GetComponent(meshEntity);
+	MeshComponent& mesh = existing != nullptr ? *existing : scene.meshes.Create(meshEntity);
+	if (!scene.materials.Contains(meshEntity)) {
+		scene::MaterialComponent& material = scene.materials.Create(meshEntity);
+		material.SetDoubleSided(true);
+	}
 
-	scene::MaterialComponent& material = scene.materials.Create(treeEntity);
-	material.SetDoubleSided(true);
-	subset.materialID = treeEntity;
+	// Foliage cards get their own alpha-tested material, reused when the mesh is published again
+	ecs::Entity foliageMaterial = ecs::INVALID_ENTITY;
+	for (const auto& subset : mesh.subsets) {
+		if (subset.materialID != meshEntity) {
+			foliageMaterial = subset.materialID;
+		}
+	}
+	for (const auto& treeSubset : meshData.subsets) {
+		if (treeSubset.part == TreeMeshPart::Foliage && foliageMaterial == ecs::INVALID_ENTITY) {
+			foliageMaterial = ecs::CreateEntity();
+			scene::MaterialComponent& leafMaterial = scene.materials.Create(foliageMaterial);
+			leafMaterial.SetDoubleSided(true);
+			leafMaterial.SetAlphaRef(0.5f);
+			leafMaterial.textures[MaterialComponent::BASECOLORMAP].resource = GetLeafTexture();
+			leafMaterial.SetBaseColor(XMFLOAT4(0.25f, 0.45f, 0.15f, 1.0f));
+			scene.Component_Attach(foliageMaterial, meshEntity);
+		}
+	}
 
-	mesh.vertex_positions = std::move(weldedVertexPositions);
-	mesh.vertex_normals = std::move(weldedVertexNormals);
-	mesh.vertex_uvset_0 = std::move(weldedVertexUVs);
-	mesh.indices = std::move(weldedIndices);
+	mesh.subsets.clear();
+	for (const auto& treeSubset : meshData.subsets) {
+		MeshComponent::MeshSubset& subset = mesh.subsets.emplace_back();
+		subset.indexOffset = treeSubset.indexOffset;
+		subset.indexCount = treeSubset.indexCount;
+		subset.materialID = treeSubset.part == TreeMeshPart::Foliage ? foliageMaterial : meshEntity;
+	}
+	mesh.subsets_per_lod = meshData.GetLODCount() > 1 ? meshData.GetSubsetsPerLOD() : 0;
+
+	mesh.vertex_positions = std::move(meshData.vertex_positions);
+	mesh.vertex_normals = std::move(meshData.vertex_normals);
+	mesh.vertex_uvset_0 = std::move(meshData.vertex_uvs);
+	mesh.indices = std::move(meshData.indices);
+
+	// A republished mesh replaces its old armature
+	if (mesh.armatureID != ecs::INVALID_ENTITY) {
+		scene.Entity_Remove(mesh.armatureID);
+		mesh.armatureID = ecs::INVALID_ENTITY;
+	}
+	if (skeleton != nullptr && skin != nullptr && !skeleton->bones.empty()) {
+		mesh.armatureID = CreateArmature(scene, meshEntity, *skeleton);
+		mesh.vertex_boneindices = std::move(skin->boneIndices);
+		mesh.vertex_boneweights = std::move(skin->boneWeights);
+	}
+	else {
+		mesh.vertex_boneindices.clear();
+		mesh.vertex_boneweights.clear();
+	}
 
 	mesh.CreateRenderData();
-	object.meshID = treeEntity;
 
 	// Debug output
 	wi::backlog::post("Created tree with " + std::to_string(mesh.vertex_positions.size()) + " vertices and " + std::to_string(mesh.indices.size()) + " indices.", wi::backlog::LogLevel::Default);
+	for (const auto& subset : meshData.subsets) {
+		wi::backlog::post("  LOD" + std::to_string(subset.lod) + (subset.part == TreeMeshPart::Foliage ? " foliage: " : " bark: ") +
+			std::to_string(subset.indexCount / 3) + " triangles", wi::backlog::LogLevel::Default);
+	}
+}
+
+void WickedRenderer::TrackTree(const std::vector<LSystemGeneration>& generations, TreeMeshData& meshData) {
+	treePatcher.SetLayout(generations, meshData);
+
+	// Set up again from the new rest pose on the next UpdateTreeWind
+	windDeformer.Reset();
+}
+
+// Copy runs of vertices from the CPU arrays into the mesh's existing GPU buffer, false if the buffer layout doesn't allow patching
+static bool UploadVertexRanges(MeshComponent& mesh, const std::vector<XMUINT2>& ranges) {
+	using namespace wi::graphics;
+	if (!mesh.generalBuffer.IsValid() || !mesh.vb_pos_wind.IsValid() || !mesh.vb_nor.IsValid() ||
+		mesh.position_format != MeshComponent::Vertex_POS32W::FORMAT) {
+		return false;
+	}
+
+	GraphicsDevice* device = GetDevice();
+	CommandList cmd = device->BeginCommandList();
+
+	GPUBarrier toCopy[] = { GPUBarrier::Buffer(&mesh.generalBuffer, ResourceState::SHADER_RESOURCE, ResourceState::COPY_DST) };
+	device->Barrier(toCopy, 1, cmd);
+
+	for (const XMUINT2& range : ranges) {
+		const uint32_t first = range.x;
+		const uint32_t count = range.y;
+		const uint64_t positionBytes = count * sizeof(MeshComponent::Vertex_POS32W);
+		const uint64_t normalBytes = count * sizeof(MeshComponent::Vertex_NOR);
+
+		GraphicsDevice::GPUAllocation allocation = device->AllocateGPU(positionBytes + normalBytes, cmd);
+		auto* positions = static_cast<MeshComponent::Vertex_POS32W*>(allocation.data);
+		auto* normals = reinterpret_cast<MeshComponent::Vertex_NOR*>(static_cast<uint8_t*>(allocation.data) + positionBytes);
+		for (uint32_t i = 0; i < count; ++i) {
+			const uint32_t v = first + i;
+			positions[i].FromFULL(mesh.vertex_positions[v], mesh.vertex_windweights.empty() ? 0 : mesh.vertex_windweights[v]);
+			normals[i].FromFULL(mesh.vertex_normals[v]);
+		}
+
+		device->CopyBuffer(&mesh.generalBuffer, mesh.vb_pos_wind.offset + first * sizeof(MeshComponent::Vertex_POS32W), &allocation.buffer, allocation.offset, positionBytes, cmd);
+		device->CopyBuffer(&mesh.generalBuffer, mesh.vb_nor.offset + first * sizeof(MeshComponent::Vertex_NOR), &allocation.buffer, allocation.offset + positionBytes, normalBytes, cmd);
+	}
+
+	GPUBarrier toRead[] = { GPUBarrier::Buffer(&mesh.generalBuffer, ResourceState::COPY_DST, ResourceState::SHADER_RESOURCE) };
+	device->Barrier(toRead, 1, cmd);
+	return true;
+}
+
+bool WickedRenderer::UpdateTree(scene::Scene& scene, const std::vector<LSystemGeneration>& generations, const TreeMeshPatch* patch) {
+	MeshComponent* mesh = scene.meshes.GetComponent(entity);
+	if (mesh == nullptr) {
+		return false;
+	}
+
+	if (IsBuildPending()) {
+		if (buildTarget != entity) {
+			return false;
+		}
+		// Starting over for every step would never finish while growth keeps adding nodes, so a running rebuild is
+		// left alone and the newest layout is applied once it is published
+		queuedRebuild = generations;
+		rebuildQueued = true;
+		return true;
+	}
+
+	if (flattenGenerations(generations).size() != treePatcher.GetNodeCount()) {
+		// Nodes were added or removed, remesh off the main thread
+		StartBuild(std::string(), generations, entity);
+		return true;
+	}
+
+	// A patch from the growth worker only needs copying, otherwise the changed spans are rewritten here
+	if (patch == nullptr || !treePatcher.Accept(*patch)) {
+		if (!treePatcher.MakePatch(generations, updatePatch) || !treePatcher.Accept(updatePatch)) {
+			return true;
+		}
+		patch = &updatePatch;
+	}
+	ApplyTreePatch(*mesh, *patch);
+	return true;
+}
+
+void WickedRenderer::ApplyTreePatch(MeshComponent& mesh, const TreeMeshPatch& patch) {
+	if (patch.ranges.empty()) {
+		return;
+	}
+	size_t source = 0;
+	for (const XMUINT2& range : patch.ranges) {
+		std::copy_n(patch.positions.begin() + source, range.y, mesh.vertex_positions.begin() + range.x);
+		std::copy_n(patch.normals.begin() + source, range.y, mesh.vertex_normals.begin() + range.x);
+		for (uint32_t i = 0; i < range.y; ++i) {
+			windDeformer.SetRestPosition(range.x + i, patch.positions[source + i]);
+		}
+		source += range.y;
+	}
+	mesh.aabb = wi::primitive::AABB::Merge(mesh.aabb, wi::primitive::AABB(patch.boundsMin, patch.boundsMax));
+
+	if (!UploadVertexRanges(mesh, patch.ranges)) {
+		// Quantized positions can't be patched, switch this mesh to full precision once and upload everything
+		mesh.SetQuantizedPositionsDisabled(true);
+		mesh.CreateRenderData();
+	}
+}
+
+TreeWindStats WickedRenderer::UpdateTreeWind(scene::Scene& scene, const std::vector<LSystemGeneration>& generations, float time, const TreeWindSettings& settings, double budgetMilliseconds) {
+	MeshComponent* mesh = scene.meshes.GetComponent(entity);
+	if (mesh == nullptr || mesh->vertex_positions.empty()) {
+		return TreeWindStats();
+	}
+
+	if (windDeformer.GetVertexCount() != mesh->vertex_positions.size()) {
+		// One bone per chain, so every branch gets its own pivot and phase
+		TreeSkeleton skeleton;
+		BuildTreeSkeleton(generations, UINT32_MAX, skeleton);
+		windDeformer.Setup(mesh->vertex_positions.data(), static_cast<uint32_t>(mesh->vertex_positions.size()), treePatcher.GetSpans(), treePatcher.GetRemap(), skeleton);
+	}
+
+	TreeWindStats stats = windDeformer.Deform(time, settings, mesh->vertex_positions.data(), budgetMilliseconds);
+	std::vector<XMUINT2> ranges(stats.ranges, stats.ranges + stats.rangeCount);
+	if (!UploadVertexRanges(*mesh, ranges)) {
+		mesh->SetQuantizedPositionsDisabled(true);
+		mesh->CreateRenderData();
+	}
+	return stats;
+}
+
+void WickedRenderer::CreateTreeGrowth(scene::Scene& scene, const std::string& name, const std::vector<LSystemGeneration>& generations, uint32_t keyframeCount) {
+	TreeMeshData meshData;
+	BakeGrowthKeyframes(generations, meshSettings, keyframeCount, growthKeyframes, meshData);
+	if (growthEntity != ecs::INVALID_ENTITY) {
+		scene.Entity_Remove(growthEntity);
+		growthEntity = ecs::INVALID_ENTITY;
+	}
+	if (growthKeyframes.times.empty()) {
+		return;
+	}
+	wi::backlog::post("Baked " + std::to_string(growthKeyframes.times.size()) + " growth keyframes of " + std::to_string(growthKeyframes.vertexCount) + " vertices", wi::backlog::LogLevel::Default);
+
+	growthEntity = ecs::CreateEntity();
+	if (!name.empty()) {
+		scene.names.Create(growthEntity) = name;
+	}
+	scene.layers.Create(growthEntity);
+	scene.transforms.Create(growthEntity);
+	ObjectComponent& object = scene.objects.Create(growthEntity);
+
+	PublishMesh(scene, growthEntity, meshData);
+	object.meshID = growthEntity;
+
+	// Bounds must hold every pose, not only the fully grown one CreateRenderData saw
+	XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+	for (size_t k = 0; k < growthKeyframes.times.size(); ++k) {
+		const float* positions = &growthKeyframes.positions[k * growthKeyframes.stride];
+		for (uint32_t v = 0; v < growthKeyframes.vertexCount; ++v) {
+			XMVECTOR position = XMVectorSet(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2], 0.0f);
+			boundsMin = XMVectorMin(boundsMin, position);
+			boundsMax = XMVectorMax(boundsMax, position);
+		}
+	}
+	MeshComponent& mesh = *scene.meshes.GetComponent(growthEntity);
+	XMStoreFloat3(&mesh.aabb._min, boundsMin);
+	XMStoreFloat3(&mesh.aabb._max, boundsMax);
+}
+
+void WickedRenderer::PlayGrowth(scene::Scene& scene, float time) {
+	MeshComponent* mesh = scene.meshes.GetComponent(growthEntity);
+	if (mesh == nullptr || mesh->vertex_positions.size() != growthKeyframes.vertexCount) {
+		return;
+	}
+	SampleGrowthKeyframes(growthKeyframes, time, mesh->vertex_positions.data());
+	if (!UploadVertexRanges(*mesh, { XMUINT2(0, growthKeyframes.vertexCount) })) {
+		mesh->SetQuantizedPositionsDisabled(true);
+		mesh->CreateRenderData();
+	}
+}
+
+float WickedRenderer::GetGrowthDuration() const {
+	return growthKeyframes.GetDuration();
+}
+
+void WickedRenderer::AddBatchedTrees(const std::vector<LSystemGeneration>& generations, const std::vector<XMFLOAT4X4>& transforms, std::vector<uint32_t>& handles) {
+	TreeMeshData meshData;
+	LoadOrBuildTreeMesh(generations, meshSettings, meshCacheDirectory, meshData);
+	for (const XMFLOAT4X4& transform : transforms) {
+		handles.push_back(treeBatch.Insert(meshData, XMLoadFloat4x4(&transform)));
+	}
+}
+
+bool WickedRenderer::RemoveBatchedTree(uint32_t handle) {
+	return treeBatch.Remove(handle);
+}
+
+// Copy the ranges the batch changed into the mesh's CPU arrays and its existing GPU buffer, false if the buffer layout
+// doesn't allow patching or a new UV is outside the range the buffer was quantized to
+static bool UploadBatchRanges(MeshComponent& mesh, const TreeBatch& batch, uint32_t foliageBase) {
+	using namespace wi::graphics;
+	if (!mesh.generalBuffer.IsValid() || !mesh.ib.IsValid() || !mesh.vb_pos_wind.IsValid() || !mesh.vb_nor.IsValid() || !mesh.vb_uvs.IsValid() ||
+		mesh.position_format != MeshComponent::Vertex_POS32W::FORMAT || mesh.vertex_positions.size() != batch.vertex_positions.size() ||
+		mesh.indices.size() != foliageBase + batch.foliageIndices.size()) {
+		return false;
+	}
+	for (const TreeBatchRange& range : batch.GetChangedVertices()) {
+		for (uint32_t v = range.offset; v < range.offset + range.count; ++v) {
+			const XMFLOAT2& uv = batch.vertex_uvs[v];
+			if (uv.x < mesh.uv_range_min.x || uv.y < mesh.uv_range_min.y || uv.x > mesh.uv_range_max.x || uv.y > mesh.uv_range_max.y) {
+				return false;
+			}
+		}
+	}
+
+	GraphicsDevice* device = GetDevice();
+	CommandList cmd = device->BeginCommandList();
+
+	GPUBarrier toCopy[] = { GPUBarrier::Buffer(&mesh.generalBuffer, ResourceState::SHADER_RESOURCE, ResourceState::COPY_DST) };
+	device->Barrier(toCopy, 1, cmd);
+
+	for (const TreeBatchRange& range : batch.GetChangedVertices()) {
+		std::copy_n(batch.vertex_positions.begin() + range.offset, range.count, mesh.vertex_positions.begin() + range.offset);
+		std::copy_n(batch.vertex_normals.begin() + range.offset, range.count, mesh.vertex_normals.begin() + range.offset);
+		std::copy_n(batch.vertex_uvs.begin() + range.offset, range.count, mesh.vertex_uvset_0.begin() + range.offset);
+
+		const uint64_t positionBytes = range.count * sizeof(MeshComponent::Vertex_POS32W);
+		const uint64_t normalBytes = range.count * sizeof(MeshComponent::Vertex_NOR);
+		const uint64_t uvBytes = range.count * sizeof(MeshComponent::Vertex_UVS);
+		GraphicsDevice::GPUAllocation allocation = device->AllocateGPU(positionBytes + normalBytes + uvBytes, cmd);
+		auto* positions = static_cast<MeshComponent::Vertex_POS32W*>(allocation.data);
+		auto* normals = reinterpret_cast<MeshComponent::Vertex_NOR*>(static_cast<uint8_t*>(allocation.data) + positionBytes);
+		auto* uvs = reinterpret_cast<MeshComponent::Vertex_UVS*>(static_cast<uint8_t*>(allocation.data) + positionBytes + normalBytes);
+		for (uint32_t i = 0; i < range.count; ++i) {
+			const uint32_t v = range.offset + i;
+			positions[i].FromFULL(mesh.vertex_positions[v], 0);
+			normals[i].FromFULL(mesh.vertex_normals[v]);
+			uvs[i].uv0.FromFULL(mesh.vertex_uvset_0[v], mesh.uv_range_min, mesh.uv_range_max);
+			uvs[i].uv1.FromFULL(XMFLOAT2(0, 0), mesh.uv_range_min, mesh.uv_range_max);
+		}
+
+		device->CopyBuffer(&mesh.generalBuffer, mesh.vb_pos_wind.offset + range.offset * sizeof(MeshComponent::Vertex_POS32W), &allocation.buffer, allocation.offset, positionBytes, cmd);
+		device->CopyBuffer(&mesh.generalBuffer, mesh.vb_nor.offset + range.offset * sizeof(MeshComponent::Vertex_NOR), &allocation.buffer, allocation.offset + positionBytes, normalBytes, cmd);
+		device->CopyBuffer(&mesh.generalBuffer, mesh.vb_uvs.offset + range.offset * sizeof(MeshComponent::Vertex_UVS), &allocation.buffer, allocation.offset + positionBytes + normalBytes, uvBytes, cmd);
+	}
+
+	// Inserted trees and the degenerate triangles filling removed ones, in the index format the buffer was made with
+	const uint64_t stride = mesh.GetIndexStride();
+	auto uploadIndices = [&](const std::vector<uint32_t>& source, const std::vector<TreeBatchRange>& ranges, uint32_t base) {
+		for (const TreeBatchRange& range : ranges) {
+			std::copy_n(source.begin() + range.offset, range.count, mesh.indices.begin() + base + range.offset);
+			GraphicsDevice::GPUAllocation allocation = device->AllocateGPU(range.count * stride, cmd);
+			for (uint32_t i = 0; i < range.count; ++i) {
+				const uint32_t index = source[range.offset + i];
+				if (stride == sizeof(uint16_t)) {
+					static_cast<uint16_t*>(allocation.data)[i] = static_cast<uint16_t>(index);
+				}
+				else {
+					static_cast<uint32_t*>(allocation.data)[i] = index;
+				}
+			}
+			device->CopyBuffer(&mesh.generalBuffer, mesh.ib.offset + (base + range.offset) * stride, &allocation.buffer, allocation.offset, range.count * stride, cmd);
+		}
+	};
+	uploadIndices(batch.barkIndices, batch.GetChangedBarkIndices(), 0);
+	uploadIndices(batch.foliageIndices, batch.GetChangedFoliageIndices(), foliageBase);
+
+	GPUBarrier toRead[] = { GPUBarrier::Buffer(&mesh.generalBuffer, ResourceState::COPY_DST, ResourceState::SHADER_RESOURCE) };
+	device->Barrier(toRead, 1, cmd);
+	return true;
+}
+
+void WickedRenderer::PublishBatch(scene::Scene& scene) {
+	if (!treeBatch.IsDirty()) {
+		return;
+	}
+	if (batchEntity == ecs::INVALID_ENTITY) {
+		batchEntity = ecs::CreateEntity();
+		scene.names.Create(batchEntity) = "Tree batch";
+		scene.layers.Create(batchEntity);
+		scene.transforms.Create(batchEntity);
+		scene.objects.Create(batchEntity).meshID = batchEntity;
+		// Patched in place between reallocations, which needs full precision positions
+		scene.meshes.Create(batchEntity).SetQuantizedPositionsDisabled(true);
+	}
+
+	// Bark pool then foliage pool, both at allocator capacity so trees can come and go without new buffers.
+	// Each subset is drawn up to the high water mark of its pool.
+	const uint32_t barkCount = treeBatch.GetBarkIndexCount();
+	const uint32_t foliageCount = treeBatch.GetFoliageIndexCount();
+	const uint32_t foliageBase = static_cast<uint32_t>(treeBatch.barkIndices.size());
+	MeshComponent* mesh = scene.meshes.GetComponent(batchEntity);
+	size_t uploadedVertices = 0;
+	size_t uploadedIndices = 0;
+	if (!treeBatch.HasCapacityChanged() && mesh->subsets.size() == 2 && UploadBatchRanges(*mesh, treeBatch, foliageBase)) {
+		mesh->subsets[0].indexCount = barkCount;
+		mesh->subsets[1].indexCount = foliageCount;
+		for (const TreeBatchRange& range : treeBatch.GetChangedVertices()) {
+			uploadedVertices += range.count;
+		}
+		for (const TreeBatchRange& range : treeBatch.GetChangedBarkIndices()) {
+			uploadedIndices += range.count;
+		}
+		for (const TreeBatchRange& range : treeBatch.GetChangedFoliageIndices()) {
+			uploadedIndices += range.count;
+		}
+	}
+	else {
+		// The pools grew, new buffers at the new capacity
+		TreeMeshData meshData;
+		meshData.vertex_positions = treeBatch.vertex_positions;
+		meshData.vertex_normals = treeBatch.vertex_normals;
+		meshData.vertex_uvs = treeBatch.vertex_uvs;
+		meshData.indices.reserve(treeBatch.barkIndices.size() + treeBatch.foliageIndices.size());
+		meshData.indices.insert(meshData.indices.end(), treeBatch.barkIndices.begin(), treeBatch.barkIndices.end());
+		meshData.indices.insert(meshData.indices.end(), treeBatch.foliageIndices.begin(), treeBatch.foliageIndices.end());
+		meshData.subsets.push_back({ 0, barkCount, 0, TreeMeshPart::Bark });
+		meshData.subsets.push_back({ foliageBase, foliageCount, 0, TreeMeshPart::Foliage });
+		uploadedVertices = meshData.vertex_positions.size();
+		uploadedIndices = meshData.indices.size();
+		PublishMesh(scene, batchEntity, meshData);
+		mesh = scene.meshes.GetComponent(batchEntity);
+	}
+	treeBatch.ClearChanges();
+
+	// Vertices of removed trees are still in the buffer, only live trees count towards the bounds
+	treeBatch.GetBounds(mesh->aabb._min, mesh->aabb._max);
+	wi::backlog::post("Tree batch: " + std::to_string(treeBatch.GetTreeCount()) + " trees, " + std::to_string(treeBatch.GetVertexAllocator().GetUsed()) + " of " +
+		std::to_string(treeBatch.GetVertexAllocator().GetCapacity()) + " vertices used, uploaded " + std::to_string(uploadedVertices) + " vertices and " +
+		std::to_string(uploadedIndices) + " indices", wi::backlog::LogLevel::Default);
+}
+
+const TreeBatch& WickedRenderer::GetBatch() const {
+	return treeBatch;
+}
+
+void WickedRenderer::CreateTreeSubtreeInstanced(scene::Scene& scene, const std::string& name, const std::vector<LSystemGeneration>& generations, const SubtreeHashSettings& hashSettings) {
+	auto start = std::chrono::high_resolution_clock::now();
+	if (subtreeRoot != ecs::INVALID_ENTITY) {
+		scene.Entity_Remove(subtreeRoot);
+	}
+	subtreeRoot = ecs::CreateEntity();
+	if (!name.empty()) {
+		scene.names.Create(subtreeRoot) = name;
+	}
+	scene.layers.Create(subtreeRoot);
+	scene.transforms.Create(subtreeRoot);
+
+	// Culling thresholds are relative to the thickest node of what is meshed, so they would differ between pieces
+	TreeMeshSettings pieceSettings = meshSettings;
+	pieceSettings.lods = { TreeLODLevel{ meshSettings.lods.empty() ? 16u : meshSettings.lods[0].segments, 0.0f, meshSettings.lods.empty() ? 0.0f : meshSettings.lods[0].collinearAngle } };
+	pieceSettings.buildMeshlets = false;
+	pieceSettings.buildSkeleton = false;
+
+	TreeSubtreeInstancing instancing;
+	HashSubtrees(generations, hashSettings, instancing);
+	size_t meshedVertices = 0;
+
+	std::vector<LSystemGeneration> pieceGenerations;
+	ExtractResidualNodes(generations, instancing, pieceGenerations);
+	TreeMeshData residual;
+	BuildTreeMesh(pieceGenerations, pieceSettings, residual);
+	meshedVertices += residual.vertex_positions.size();
+	size_t drawnVertices = residual.vertex_positions.size();
+	if (!residual.indices.empty()) {
+		ecs::Entity residualEntity = ecs::CreateEntity();
+		scene.layers.Create(residualEntity);
+		scene.transforms.Create(residualEntity);
+		PublishMesh(scene, residualEntity, residual);
+		scene.objects.Create(residualEntity).meshID = residualEntity;
+		scene.Component_Attach(residualEntity, subtreeRoot);
+	}
+
+	// Prototype meshes have no object of their own, every copy is an object pointing at one
+	std::vector<ecs::Entity> prototypeMeshes(instancing.prototypes.size());
+	for (uint32_t p = 0; p < instancing.prototypes.size(); ++p) {
+		ExtractSubtreePrototype(generations, instancing, p, pieceGenerations);
+		TreeMeshData prototype;
+		BuildTreeMesh(pieceGenerations, pieceSettings, prototype);
+		meshedVertices += prototype.vertex_positions.size();
+		prototypeMeshes[p] = ecs::CreateEntity();
+		PublishMesh(scene, prototypeMeshes[p], prototype);
+		scene.Component_Attach(prototypeMeshes[p], subtreeRoot);
+	}
+
+	for (const SubtreeInstance& instance : instancing.instances) {
+		ecs::Entity instanceEntity = ecs::CreateEntity();
+		scene.layers.Create(instanceEntity);
+		TransformComponent& transform = scene.transforms.Create(instanceEntity);
+		XMVECTOR scale, rotation, translation;
+		XMMatrixDecompose(&scale, &rotation, &translation, XMLoadFloat4x4(&instance.transform));
+		XMStoreFloat4(&transform.rotation_local, rotation);
+		XMStoreFloat3(&transform.translation_local, translation);
+		transform.SetDirty();
+		scene.objects.Create(instanceEntity).meshID = prototypeMeshes[instance.prototype];
+		scene.Component_Attach(instanceEntity, subtreeRoot);
+		drawnVertices += scene.meshes.GetComponent(prototypeMeshes[instance.prototype])->vertex_positions.size();
+	}
+
+	wi::backlog::post("Subtree instanced tree: " + std::to_string(instancing.prototypes.size()) + " prototypes, " + std::to_string(instancing.instances.size()) + " instances, " +
+		std::to_string(instancing.residualNodes.size()) + " residual nodes. Meshed " + std::to_string(meshedVertices) + " vertices for " + std::to_string(drawnVertices) +
+		" drawn in " + std::to_string(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count()) + " ms", wi::backlog::LogLevel::Default);
+}
+
+static void ApplySegmentTransform(TransformComponent& transform, const SegmentInstance& instance) {
+	transform.translation_local = instance.position;
+	XMStoreFloat4(&transform.rotation_local, UnpackQuaternion(instance.rotation));
+	transform.scale_local = XMFLOAT3(instance.radius, instance.length, instance.radius);
+	transform.SetDirty();
+}
+
+// What one segment really costs in the scene: the instance record plus the four components its object is made of, each
+// with its entity handle and lookup entry in the component manager. Wicked's renderer adds its own per-object data on top.
+static size_t SegmentObjectBytes() {
+	const size_t lookupEntry = sizeof(ecs::Entity) + sizeof(size_t) + 2 * sizeof(void*);
+	return sizeof(SegmentInstance) + sizeof(LayerComponent) + sizeof(TransformComponent) + sizeof(ObjectComponent) + sizeof(HierarchyComponent) +
+		4 * (sizeof(ecs::Entity) + lookupEntry);
+}
+
+// Match the segment objects to segmentInstances: surplus objects are removed from the end and missing ones created,
+// the objects that stay keep their entities and only get the transforms listed in changed
+void WickedRenderer::SyncSegmentObjects(scene::Scene& scene, const std::vector<uint32_t>& changed) {
+	const size_t kept = std::min(instanceEntities.size(), segmentInstances.size());
+	for (size_t i = kept; i < instanceEntities.size(); ++i) {
+		scene.Entity_Remove(instanceEntities[i]);
+	}
+	instanceEntities.resize(kept);
+
+	for (uint32_t index : changed) {
+		if (index >= kept) {
+			continue;
+		}
+		TransformComponent* transform = scene.transforms.GetComponent(instanceEntities[index]);
+		if (transform != nullptr) {
+			ApplySegmentTransform(*transform, segmentInstances[index]);
+		}
+	}
+
+	for (size_t i = kept; i < segmentInstances.size(); ++i) {
+		ecs::Entity segmentEntity = ecs::CreateEntity();
+		scene.layers.Create(segmentEntity);
+		ApplySegmentTransform(scene.transforms.Create(segmentEntity), segmentInstances[i]);
+		ObjectComponent& object = scene.objects.Create(segmentEntity);
+		object.meshID = instanceMesh;
+		scene.Component_Attach(segmentEntity, instanceRoot);
+		instanceEntities.push_back(segmentEntity);
+	}
+}
+
+void WickedRenderer::CreateTreeInstanced(scene::Scene& scene, const std::string& name, const std::vector<LSystemGeneration>& generations) {
+	// The shared cylinder and every segment object hang off the old root, removing it removes the whole previous tree
+	if (instanceRoot != ecs::INVALID_ENTITY) {
+		scene.Entity_Remove(instanceRoot);
+	}
+
+	// Root entity the segments hang off, moving it moves the whole tree
+	instanceRoot = ecs::CreateEntity();
+	if (!name.empty()) {
+		scene.names.Create(instanceRoot) = name + " tree ";
+	}
+	scene.layers.Create(instanceRoot);
+	scene.transforms.Create(instanceRoot);
+
+	// One shared unit cylinder, it has no object of its own
+	instanceMesh = ecs::CreateEntity();
+	instanceEntities.clear();
+	TreeMeshData cylinder;
+	GenerateUnitCylinder(meshSettings.lods.empty() ? 16 : meshSettings.lods.front().segments, cylinder);
+	const size_t cylinderVertices = cylinder.vertex_positions.size();
+	PublishMesh(scene, instanceMesh, cylinder);
+	scene.Component_Attach(instanceMesh, instanceRoot);
+
+	BuildSegmentInstances(generations, segmentInstances);
+	SyncSegmentObjects(scene, {});
+
+	const size_t objectBytes = segmentInstances.size() * SegmentObjectBytes();
+	const size_t bakedBytes = segmentInstances.size() * cylinderVertices * (sizeof(XMFLOAT3) * 2 + sizeof(XMFLOAT2));
+	wi::backlog::post("Created instanced tree with " + std::to_string(segmentInstances.size()) + " segment objects, about " + std::to_string(SegmentObjectBytes()) +
+		" bytes each, " + std::to_string(objectBytes / 1024) + " KB in total against about " + std::to_string(bakedBytes / 1024) + " KB of baked vertices.", wi::backlog::LogLevel::Default);
+}
+
+void WickedRenderer::UpdateTreeInstanced(scene::Scene& scene, const std::vector<LSystemGeneration>& generations) {
+	if (instanceMesh == ecs::INVALID_ENTITY) {
+		return;
+	}
+
+	// A changed node count lists every instance as changed, so the objects that stay are moved into place
+	changedInstances.clear();
+	UpdateSegmentInstances(generations, segmentInstances, &changedInstances);
+	SyncSegmentObjects(scene, changedInstances);
+}
+
+void WickedRenderer::ExportCompactTree(const std::vector<LSystemGeneration>& generations, QuantizedTreeMesh& packed) {
+	TreeMeshData meshData;
+	BuildTreeMesh(generations, meshSettings, meshData);
+
+	QuantizationReport report;
+	QuantizeTreeMesh(meshData, packed, &report);
+	wi::backlog::post("Compact tree: " + std::to_string(report.sourceBytes / 1024) + " KB -> " + std::to_string(report.packedBytes / 1024) + " KB, " +
+		(packed.HasShortIndices() ? "16" : "32") + "-bit indices, position error " + std::to_string(report.maxPositionError) +
+		" (bound " + std::to_string(report.positionErrorBound) + "), normal error " + std::to_string(report.maxNormalErrorDegrees) +
+		" deg, uv error " + std::to_string(report.maxUVError), wi::backlog::LogLevel::Default);
+}
+
+const TreeMeshletData& WickedRenderer::GetMeshlets() const {
+	return treeMeshlets;
+}
+
+void WickedRenderer::SetMeshSettings(const TreeMeshSettings& settings) {
+	meshSettings = settings;
+}
+
+void WickedRenderer::SetMeshCacheDirectory(const std::string& directory) {
+	meshCacheDirectory = directory;
+}
+
+const TreeMeshSettings& WickedRenderer::GetMeshSettings() const {
+	return meshSettings;
 }
 
 void WickedRenderer::SaveTree(const std::vector<LSystemGeneration>& generations, const std::string& filename) {
@@ -4,9 +4,23 @@
 #include <vector>
 #include <cmath>
 #include <random>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <WickedEngine.h>
 #include <DirectXMath.h>
 #include "TwoOLSystem.h" // Include your L-system library header
+#include "TreeMesh.h"
+#include "TreeInstancing.h"
+#include "VertexQuantization.h"
+#include "TreeMeshlets.h"
+#include "TreeMeshCache.h"
+#include "TreeSkeleton.h"
+#include "TreeWind.h"
+#include "TreeGrowthKeyframes.h"
+#include "TreeBatch.h"
+#include "TreeSubtreeInstancing.h"
+#include "TreeMeshPatch.h"
 
 using namespace wi;
 
@@ -21,10 +35,81 @@ public:
 	~WickedRenderer();
 
 	void CreateTree(wi::scene::Scene& scene, const std::string& filename, const std::vector<std::vector<LSystemNode>>& generations);
+
+	// CreateTree split in two: meshing runs on a job system worker into a staging area, and PublishPending, called
+	// from the main thread once per frame, moves a finished build into the scene. A newer request (async or not)
+	// cancels the one in flight, its result is never published.
+	void CreateTreeAsync(const std::string& name, const std::vector<LSystemGeneration>& generations);
+	bool PublishPending(wi::scene::Scene& scene);
+	bool IsBuildPending() const;
 	void SaveTree(const std::vector<LSystemGeneration>& generations, const std::string& filename);
 	void LoadTree(const std::string& filename, std::vector<LSystemGeneration>& generations);
 
+	// Refresh the last tree made by CreateTree after its nodes changed length or radius.
+	// Only the vertex ranges of those nodes are rewritten and re-uploaded, the entity and GPU buffers are kept.
+	// A patch made for generations by GetTreePatcher() on another thread (see GrowthScheduler::SetPatcher) leaves only
+	// the copy to the mesh and the GPU for this call, without one or when it is outdated the spans are rewritten here.
+	// When nodes were added or removed the tree is remeshed in the background like CreateTreeAsync and PublishPending
+	// swaps it into the same entity. One such rebuild runs at a time, the newest layout asked for meanwhile follows it.
+	// Returns false when there is no tree to update or a new tree from CreateTreeAsync is about to replace it.
+	bool UpdateTree(wi::scene::Scene& scene, const std::vector<LSystemGeneration>& generations, const TreeMeshPatch* patch = nullptr);
+	TreeMeshPatcher* GetTreePatcher() { return &treePatcher; }
+
+	// CPU wind on the tree made by CreateTree, for when skinning is not available. With a budget, large trees are
+	// swept over several calls. Growth through UpdateTree keeps working, wind is applied around the grown shape.
+	TreeWindStats UpdateTreeWind(wi::scene::Scene& scene, const std::vector<LSystemGeneration>& generations, float time, const TreeWindSettings& settings, double budgetMilliseconds = 0.0);
+
+	// Bake the growth of a tree into keyframes (0 = one per generation) and publish it fully grown.
+	// PlayGrowth then poses it at any time between 0 and GetGrowthDuration() by interpolating positions, without remeshing.
+	void CreateTreeGrowth(wi::scene::Scene& scene, const std::string& name, const std::vector<LSystemGeneration>& generations, uint32_t keyframeCount = 0);
+	void PlayGrowth(wi::scene::Scene& scene, float time);
+	float GetGrowthDuration() const;
+
+	// Batching mode for forests: the tree is meshed once with the current settings and LOD0 is baked into a shared batch
+	// at each transform, handles are appended for RemoveBatchedTree. PublishBatch sends all changes since the last call
+	// to the scene as one mesh entity with one subset per material. Its buffers are sized to the batch capacity and only
+	// the ranges inserts and removals touched are uploaded, they are recreated only when the batch grows.
+	void AddBatchedTrees(const std::vector<LSystemGeneration>& generations, const std::vector<DirectX::XMFLOAT4X4>& transforms, std::vector<uint32_t>& handles);
+	bool RemoveBatchedTree(uint32_t handle);
+	void PublishBatch(wi::scene::Scene& scene);
+	const TreeBatch& GetBatch() const;
+
+	// Repeating subtrees (equal up to a rigid transform, see HashSubtrees) are meshed once and placed as instances,
+	// the remaining nodes form one ordinary mesh. Uses LOD0 of the current settings without culling.
+	void CreateTreeSubtreeInstanced(wi::scene::Scene& scene, const std::string& name, const std::vector<LSystemGeneration>& generations, const SubtreeHashSettings& hashSettings = SubtreeHashSettings());
+
+	// Alternative to CreateTree that bakes no triangles: every node becomes an object drawing one shared unit cylinder.
+	// Wicked's scene has no way to draw a mesh from our own instance buffer, it instances objects that share a mesh, so
+	// each segment costs an object's components (a few hundred bytes) rather than only its 32 byte SegmentInstance.
+	// UpdateTreeInstanced only touches the transforms of nodes that grew and keeps the objects when nodes are added or removed.
+	void CreateTreeInstanced(wi::scene::Scene& scene, const std::string& name, const std::vector<LSystemGeneration>& generations);
+	void UpdateTreeInstanced(wi::scene::Scene& scene, const std::vector<LSystemGeneration>& generations);
+
+	// Mesh with the current settings into 16 byte interleaved vertices and 16-bit indices where they fit, for storage and streaming
+	void ExportCompactTree(const std::vector<LSystemGeneration>& generations, QuantizedTreeMesh& packed);
+
+	// Clusters of the last tree made by CreateTree, empty unless TreeMeshSettings::buildMeshlets is set.
+	// Bounds are taken when the mesh is built and are not refit by in-place UpdateTree patches.
+	const TreeMeshletData& GetMeshlets() const;
+
+	// Settings used by the next CreateTree call, e.g. TreeMeshSettings::LODChain() for an LOD0-LOD3 chain
+	void SetMeshSettings(const TreeMeshSettings& settings);
+	const TreeMeshSettings& GetMeshSettings() const;
+
+	// CreateTree keeps finished meshes here, keyed by node data and settings, and reuses them instead of meshing again. Empty disables the cache.
+	void SetMeshCacheDirectory(const std::string& directory);
+
 private:
+	void PublishMesh(scene::Scene& scene, ecs::Entity meshEntity, TreeMeshData& meshData, const TreeSkeleton* skeleton = nullptr, TreeSkinWeights* skin = nullptr);
+	ecs::Entity CreateArmature(scene::Scene& scene, ecs::Entity meshEntity, const TreeSkeleton& skeleton);
+	void TrackTree(const std::vector<LSystemGeneration>& generations, TreeMeshData& meshData);
+	void ApplyTreePatch(scene::MeshComponent& mesh, const TreeMeshPatch& patch);
+	void PublishTree(scene::Scene& scene, const std::string& name, const std::vector<LSystemGeneration>& generations, TreeMeshData& meshData, TreeMeshletData& meshlets,
+		const TreeSkeleton& skeleton, TreeSkinWeights& skin);
+	void SyncSegmentObjects(scene::Scene& scene, const std::vector<uint32_t>& changed);
+	void StartBuild(const std::string& name, std::vector<LSystemGeneration> generations, ecs::Entity target);
+	const wi::Resource& GetLeafTexture();
+
 	ecs::Entity entity = ecs::INVALID_ENTITY;
 	ecs::Entity partEntity = ecs::INVALID_ENTITY;
 	scene::TransformComponent tfm;
@@ -35,6 +120,53 @@ private:
 	DirectX::XMFLOAT4 colorSaddleBrown;
 */
 	int segments = 16;
+	TreeMeshSettings meshSettings;
+	std::string meshCacheDirectory;
+
+	TreeMeshletData treeMeshlets;
+	wi::Resource leafTexture;   // Alpha cutout shared by every foliage material, created on first use
+
+	// Background builds, only the build whose token matches latestBuild may publish
+	struct PendingTree {
+		uint64_t token = 0;
+		std::string name;
+		ecs::Entity target = ecs::INVALID_ENTITY;   // Tree to remesh in place, a new tree is created when invalid
+		std::vector<LSystemGeneration> generations;
+		TreeMeshData meshData;
+		TreeMeshletData meshlets;
+		TreeSkeleton skeleton;
+		TreeSkinWeights skin;
+	};
+	std::atomic<uint64_t> latestBuild{ 0 };
+	wi::jobsystem::context buildContext;
+	mutable std::mutex pendingMutex;
+	std::shared_ptr<PendingTree> pendingTree;
+	ecs::Entity buildTarget = ecs::INVALID_ENTITY;              // Target of the newest build, main thread only
+	std::vector<LSystemGeneration> queuedRebuild;               // Newest layout UpdateTree asked for while a rebuild ran
+	bool rebuildQueued = false;
+
+	// Layout of the tracked tree for UpdateTree, shared with a growth worker
+	TreeMeshPatcher treePatcher;
+	TreeMeshPatch updatePatch;               // Made on the main thread when UpdateTree gets no usable patch
+	TreeWindDeformer windDeformer;
+
+	// Growth playback state
+	ecs::Entity growthEntity = ecs::INVALID_ENTITY;
+	TreeGrowthKeyframes growthKeyframes;
+
+	// Batched trees
+	ecs::Entity batchEntity = ecs::INVALID_ENTITY;
+	TreeBatch treeBatch;
+
+	// Subtree instanced tree, everything hangs off subtreeRoot
+	ecs::Entity subtreeRoot = ecs::INVALID_ENTITY;
+
+	// Instanced tree state
+	ecs::Entity instanceRoot = ecs::INVALID_ENTITY;
+	ecs::Entity instanceMesh = ecs::INVALID_ENTITY;
+	std::vector<ecs::Entity> instanceEntities;
+	std::vector<SegmentInstance> segmentInstances;
+	std::vector<uint32_t> changedInstances;
 	std::uniform_real_distribution<float> disAngle{ 0.0f, 45.0f };
 
 	// Private members already initialized in the header